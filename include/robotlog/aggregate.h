@@ -0,0 +1,163 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include "field.h"
+#include "logmessage.h"
+#include "telemetry.h"
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace ROBOTLOG {
+/**
+ * @brief A channel of numbers summed up over a window instead of logged one
+ * by one
+ *
+ * Made by logger.aggregate(). Your code calls add() as often as it likes, and
+ * once a window the worker task writes a DATA record with the channel's name
+ * as the message and these fields:
+ *
+ * min, max the smallest and largest sample, so spikes still show
+ * mean the average of the window
+ * last the newest sample
+ * n how many samples there were
+ *
+ * Windows with no samples write nothing. add() never locks, it's a few atomic
+ * operations on whichever of the two windows is filling. The worker switches
+ * windows, and reads the old one once every add() that was already in it has
+ * finished (on its next loop, if one was caught halfway).
+ */
+class Aggregate {
+private:
+  struct alignas(64) Window {
+    std::atomic<std::uint32_t> writers = 0; // add() calls in the middle of it
+    std::atomic<std::uint32_t> count = 0;
+    std::atomic<double> sum = 0;
+    std::atomic<double> min = std::numeric_limits<double>::infinity();
+    std::atomic<double> max = -std::numeric_limits<double>::infinity();
+    std::atomic<double> last = 0;
+  };
+
+  const char *name;
+  std::uint32_t periodUs;
+  std::uint64_t nextDueUs = 0;
+  Window windows[2];
+  std::atomic<std::uint32_t> filling = 0;
+  bool switched = false; // waiting on the other window's writers
+
+public:
+  /**
+   * @param name name to log the summaries as, should be a string literal
+   * @param window how long each summary covers
+   */
+  Aggregate(const char *name, Rate window)
+      : name(name), periodUs(window.periodUs) {}
+  Aggregate(const Aggregate &) = delete;
+  Aggregate &operator=(const Aggregate &) = delete;
+
+  const char *getName() { return this->name; }
+
+  /**
+   * @brief Add a sample to the current window, from any task
+   */
+  void add(double value) {
+    std::uint32_t at;
+    while (true) {
+      at = this->filling.load();
+      this->windows[at].writers.fetch_add(1);
+      // if the worker switched in between it may already be reading this one
+      if (this->filling.load() == at) {
+        break;
+      }
+      this->windows[at].writers.fetch_sub(1);
+    }
+    Window &window = this->windows[at];
+    double seen = window.sum.load(std::memory_order_relaxed);
+    while (!window.sum.compare_exchange_weak(seen, seen + value,
+                                             std::memory_order_relaxed)) {
+    }
+    seen = window.min.load(std::memory_order_relaxed);
+    while (value < seen && !window.min.compare_exchange_weak(
+                               seen, value, std::memory_order_relaxed)) {
+    }
+    seen = window.max.load(std::memory_order_relaxed);
+    while (value > seen && !window.max.compare_exchange_weak(
+                               seen, value, std::memory_order_relaxed)) {
+    }
+    window.last.store(value, std::memory_order_relaxed);
+    window.count.fetch_add(1, std::memory_order_relaxed);
+    window.writers.fetch_sub(1, std::memory_order_release);
+  }
+
+  bool isDue(std::uint64_t nowUs) { return nowUs >= this->nextDueUs; }
+
+  std::uint64_t usUntilDue(std::uint64_t nowUs) {
+    return this->nextDueUs > nowUs ? this->nextDueUs - nowUs : 0;
+  }
+
+  /**
+   * @brief End the window and build its DATA record
+   *
+   * Stays due if an add() is still writing to the window, so the worker
+   * comes back for it next loop.
+   *
+   * @param nowUs the current pros::micros()
+   * @param nowMs the current pros::millis(), the record's timestamp
+   * @param msg set to the summary if the window had any samples
+   * @return whether msg was set
+   */
+  bool poll(std::uint64_t nowUs, std::uint32_t nowMs, LogMessage &msg) {
+    std::uint32_t done = this->filling.load(std::memory_order_relaxed);
+    if (!this->switched) {
+      this->filling.store(done ^ 1);
+      this->switched = true;
+    } else {
+      done ^= 1;
+    }
+    Window &window = this->windows[done];
+    // seq_cst, like the store to filling above and add()'s fetch_add and
+    // load: either add() sees the switch and backs off, or this sees its
+    // writer. With acquire the load could be done before the store and miss
+    // an add() that still went ahead on this window
+    if (window.writers.load() != 0) {
+      return false;
+    }
+    this->switched = false;
+    if (this->nextDueUs == 0) {
+      this->nextDueUs = nowUs;
+    }
+    this->nextDueUs += this->periodUs;
+    if (this->nextDueUs <= nowUs) {
+      this->nextDueUs = nowUs + this->periodUs;
+    }
+
+    std::uint32_t count = window.count.load(std::memory_order_relaxed);
+    double sum = window.sum.load(std::memory_order_relaxed);
+    double min = window.min.load(std::memory_order_relaxed);
+    double max = window.max.load(std::memory_order_relaxed);
+    double last = window.last.load(std::memory_order_relaxed);
+    window.count.store(0, std::memory_order_relaxed);
+    window.sum.store(0, std::memory_order_relaxed);
+    window.min.store(std::numeric_limits<double>::infinity(),
+                     std::memory_order_relaxed);
+    window.max.store(-std::numeric_limits<double>::infinity(),
+                     std::memory_order_relaxed);
+    if (count == 0) {
+      return false;
+    }
+    std::vector<Field> fields;
+    fields.reserve(5);
+    fields.emplace_back("min", min);
+    fields.emplace_back("max", max);
+    fields.emplace_back("mean", sum / count);
+    fields.emplace_back("last", last);
+    fields.emplace_back("n", count);
+    msg = LogMessage(Level::DATA, this->name, "aggregate", 0, nowMs,
+                     std::move(fields));
+    return true;
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
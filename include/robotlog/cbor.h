@@ -0,0 +1,524 @@
+#ifndef CBOR_H
+#define CBOR_H
+
+#include "logmessage.h"
+#include "sink.h"
+#include "stringtable.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace ROBOTLOG {
+namespace CBOR {
+/*
+! Record layout (RFC 8949 CBOR)
+* Every file starts with the self-describe tag 55799 (bytes D9 D9 F7), so tools
+* (and `file`) can tell what it is.
+* Every record is then one array:
+?   [time, level, file, line, message]
+?   [time, level, file, line, message, {key: value, ...}]
+* with the map only there for structured logs. Doubles that fit in a float
+* exactly are written as 4 bytes, the rest as 8 bytes, so nothing is lost.
+*
+! Repeated strings
+* File names, field keys and event names repeat on nearly every record, so the
+* first time one is written it's wrapped in tag 6 (define), which gives it the
+* next index in the string table, and after that it's just tag 7 (ref) with
+* that index. The table starts over at every self-describe tag, which the sink
+* writes each time it's created, so each boot's section decodes on its own.
+*
+* Tags 6 and 7 aren't registered with IANA for this (or anything else), they
+* are this format's own. A generic CBOR decoder shows a defined string as tag
+* 6 around the text and a reference as tag 7 around a bare number. The
+* registered stringref tags (256 and 25) don't fit: they put every string
+* over a few bytes in the table, and need a boot's whole section to be one
+* item rather than records appended one at a time. Read files with
+* vexlog-convert, or CBOR::Reader, to get the strings back.
+*/
+enum Major : std::uint8_t {
+  UNSIGNED = 0,
+  NEGATIVE = 1,
+  BYTES = 2,
+  TEXT = 3,
+  ARRAY = 4,
+  MAP = 5,
+  TAG = 6,
+  SIMPLE = 7,
+};
+
+constexpr std::uint64_t SELF_DESCRIBE_TAG = 55799;
+constexpr std::uint64_t STRING_DEFINE_TAG = 6; // not registered, see above
+constexpr std::uint64_t STRING_REF_TAG = 7;    // not registered, see above
+
+/**
+ * @brief The string table used for CBOR files, see stringtable.h
+ */
+using StringTable = BasicStringTable<128, 2048, 64>;
+
+/**
+ * @brief Writes CBOR into a fixed buffer, without allocating
+ *
+ * Works the same way as JSON::JsonWriter: bytes build up in the buffer and
+ * are handed to the drain callback when it fills up or drain() is called.
+ */
+class Writer {
+public:
+  typedef void (*DrainFn)(void *context, const char *data, std::size_t length);
+
+private:
+  char *buffer;
+  std::size_t capacity;
+  std::size_t length = 0;
+  DrainFn drainFn;
+  void *context;
+  StringTable *strings = nullptr;
+
+public:
+  /**
+   * @param buffer memory to build output in, must outlive the writer
+   * @param capacity size of buffer in bytes, at least 16
+   * @param drainFn called with the buffered bytes whenever it fills up
+   * @param context passed straight through to drainFn
+   */
+  Writer(char *buffer, std::size_t capacity, DrainFn drainFn, void *context)
+      : buffer(buffer), capacity(capacity), drainFn(drainFn),
+        context(context) {}
+
+  void drain() {
+    if (this->length > 0) {
+      this->drainFn(this->context, this->buffer, this->length);
+      this->length = 0;
+    }
+  }
+
+  void raw(const void *data, std::size_t count) {
+    const char *bytes = static_cast<const char *>(data);
+    while (count > 0) {
+      if (this->length == this->capacity) {
+        this->drain();
+      }
+      std::size_t room = this->capacity - this->length;
+      std::size_t chunk = count < room ? count : room;
+      std::memcpy(this->buffer + this->length, bytes, chunk);
+      this->length += chunk;
+      bytes += chunk;
+      count -= chunk;
+    }
+  }
+
+  /**
+   * @brief Write an item head, using the shortest encoding for the argument
+   */
+  void head(Major major, std::uint64_t value) {
+    std::uint8_t bytes[9];
+    std::size_t count;
+    std::uint8_t type = static_cast<std::uint8_t>(major << 5);
+    if (value < 24) {
+      bytes[0] = type | static_cast<std::uint8_t>(value);
+      count = 1;
+    } else if (value <= 0xFF) {
+      bytes[0] = type | 24;
+      count = 2;
+    } else if (value <= 0xFFFF) {
+      bytes[0] = type | 25;
+      count = 3;
+    } else if (value <= 0xFFFFFFFFULL) {
+      bytes[0] = type | 26;
+      count = 5;
+    } else {
+      bytes[0] = type | 27;
+      count = 9;
+    }
+    for (std::size_t i = 1; i < count; i++) {
+      bytes[i] = static_cast<std::uint8_t>(value >> (8 * (count - 1 - i)));
+    }
+    this->raw(bytes, count);
+  }
+
+  void integer(std::int64_t value) {
+    if (value >= 0) {
+      this->head(UNSIGNED, static_cast<std::uint64_t>(value));
+    } else {
+      // -1 - n, done in unsigned so INT64_MIN doesn't overflow
+      this->head(NEGATIVE, ~static_cast<std::uint64_t>(value));
+    }
+  }
+
+  /**
+   * @brief Write a double, as a float if that loses nothing
+   */
+  void number(double value) {
+    float narrow = static_cast<float>(value);
+    if (static_cast<double>(narrow) == value || value != value) {
+      std::uint32_t bits;
+      std::memcpy(&bits, &narrow, sizeof(bits));
+      std::uint8_t bytes[5] = {0xFA, static_cast<std::uint8_t>(bits >> 24),
+                               static_cast<std::uint8_t>(bits >> 16),
+                               static_cast<std::uint8_t>(bits >> 8),
+                               static_cast<std::uint8_t>(bits)};
+      this->raw(bytes, sizeof(bytes));
+      return;
+    }
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    std::uint8_t bytes[9];
+    bytes[0] = 0xFB;
+    for (int i = 0; i < 8; i++) {
+      bytes[1 + i] = static_cast<std::uint8_t>(bits >> (8 * (7 - i)));
+    }
+    this->raw(bytes, sizeof(bytes));
+  }
+
+  void boolean(bool value) {
+    std::uint8_t byte = value ? 0xF5 : 0xF4;
+    this->raw(&byte, 1);
+  }
+
+  void text(std::string_view str) {
+    this->head(TEXT, str.size());
+    this->raw(str.data(), str.size());
+  }
+
+  /**
+   * @brief Use a string table for repeated strings
+   *
+   * @param strings the table, or nullptr to always write strings in full
+   */
+  void setStringTable(StringTable *strings) { this->strings = strings; }
+
+  /**
+   * @brief Write a string that's likely to repeat
+   *
+   * Goes through the string table (if there is one), so after the first time
+   * it's only a couple of bytes.
+   */
+  void string(std::string_view str) {
+    if (this->strings != nullptr) {
+      bool added;
+      int index = this->strings->find(str, added);
+      if (added) {
+        this->head(TAG, STRING_DEFINE_TAG);
+      } else if (index >= 0) {
+        this->head(TAG, STRING_REF_TAG);
+        this->head(UNSIGNED, static_cast<std::uint64_t>(index));
+        return;
+      }
+    }
+    this->text(str);
+  }
+
+  void field(const Field &field) {
+    switch (field.type) {
+    case Field::BOOL:
+      this->boolean(field.b);
+      break;
+    case Field::INT:
+      this->integer(field.i);
+      break;
+    case Field::DOUBLE:
+      this->number(field.d);
+      break;
+    case Field::STRING:
+      this->text(field.s);
+      break;
+    default: {
+      std::uint8_t null = 0xF6;
+      this->raw(&null, 1);
+    }
+    }
+  }
+
+  /**
+   * @brief Write a whole log message as one record, see the layout above
+   */
+  void record(LogMessage &msg) {
+    const std::vector<Field> &fields = msg.getFields();
+    this->head(ARRAY, fields.empty() ? 5 : 6);
+    this->head(UNSIGNED, msg.getTime());
+    this->integer(static_cast<std::int64_t>(msg.getLevel()));
+    this->string(msg.getFileView());
+    this->integer(msg.getLineNumber());
+    if (fields.empty()) {
+      this->text(msg.getMessageView());
+    } else {
+      this->string(msg.getMessageView()); // an event name, so it repeats
+      this->head(MAP, fields.size());
+      for (const Field &field : fields) {
+        this->string(field.key);
+        this->field(field);
+      }
+    }
+  }
+};
+
+/**
+ * @brief Pulls CBOR items back out of a buffer
+ *
+ * Only understands what Writer produces (no indefinite lengths). Every read
+ * returns false instead of reading past the end, so a record cut off by a
+ * power loss just stops the decode.
+ */
+class Reader {
+private:
+  const std::uint8_t *data;
+  std::size_t size;
+  std::size_t offset = 0;
+  std::deque<std::string> strings; // deque so views into it stay valid
+
+public:
+  Reader(const void *data, std::size_t size)
+      : data(static_cast<const std::uint8_t *>(data)), size(size) {}
+
+  std::size_t position() { return this->offset; }
+  bool atEnd() { return this->offset >= this->size; }
+
+  /**
+   * @brief Read an item head
+   *
+   * @param major set to the major type
+   * @param info set to the low 5 bits of the first byte
+   * @param value set to the argument (length, integer, ...)
+   */
+  bool head(std::uint8_t &major, std::uint8_t &info, std::uint64_t &value) {
+    if (this->offset >= this->size) {
+      return false;
+    }
+    std::uint8_t first = this->data[this->offset];
+    major = first >> 5;
+    info = first & 0x1F;
+    std::size_t count = 0;
+    if (info < 24) {
+      value = info;
+    } else if (info <= 27) {
+      count = std::size_t(1) << (info - 24);
+    } else {
+      return false;
+    }
+    if (this->offset + 1 + count > this->size) {
+      return false;
+    }
+    if (count > 0) {
+      value = 0;
+      for (std::size_t i = 0; i < count; i++) {
+        value = (value << 8) | this->data[this->offset + 1 + i];
+      }
+    }
+    this->offset += 1 + count;
+    return true;
+  }
+
+  bool integer(std::int64_t &value) {
+    std::uint8_t major, info;
+    std::uint64_t arg;
+    if (!this->head(major, info, arg)) {
+      return false;
+    }
+    if (major == UNSIGNED) {
+      value = static_cast<std::int64_t>(arg);
+    } else if (major == NEGATIVE) {
+      value = static_cast<std::int64_t>(~arg);
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  bool text(std::string_view &value) {
+    std::uint8_t major, info;
+    std::uint64_t length;
+    if (!this->head(major, info, length)) {
+      return false;
+    }
+    if (major == TAG && length == STRING_DEFINE_TAG) {
+      // only ever around plain text, so a damaged file full of define tags
+      // can't recurse
+      if (!this->head(major, info, length) || major != TEXT ||
+          length > this->size - this->offset) {
+        return false;
+      }
+      value = std::string_view(
+          reinterpret_cast<const char *>(this->data + this->offset), length);
+      this->offset += length;
+      this->strings.emplace_back(value);
+      value = this->strings.back();
+      return true;
+    }
+    if (major == TAG && length == STRING_REF_TAG) {
+      std::uint64_t index;
+      if (!this->head(major, info, index) || major != UNSIGNED ||
+          index >= this->strings.size()) {
+        return false;
+      }
+      value = this->strings[index];
+      return true;
+    }
+    if (major != TEXT || length > this->size - this->offset) {
+      return false;
+    }
+    value = std::string_view(
+        reinterpret_cast<const char *>(this->data + this->offset), length);
+    this->offset += length;
+    return true;
+  }
+
+  /**
+   * @brief Read any value that can be a field
+   *
+   * @param field gets the type and value, but not the key
+   */
+  bool value(Field &field) {
+    std::uint8_t major, info;
+    std::uint64_t arg;
+    std::size_t start = this->offset;
+    if (!this->head(major, info, arg)) {
+      return false;
+    }
+    switch (major) {
+    case UNSIGNED:
+    case NEGATIVE:
+      field.type = Field::INT;
+      field.i = static_cast<std::int64_t>(major == UNSIGNED ? arg : ~arg);
+      return true;
+    case TEXT:
+    case TAG:
+      this->offset = start;
+      {
+        std::string_view str;
+        if (!this->text(str)) {
+          return false;
+        }
+        field.type = Field::STRING;
+        field.s.assign(str.data(), str.size());
+      }
+      return true;
+    case SIMPLE:
+      if (info == 20 || info == 21) {
+        field.type = Field::BOOL;
+        field.b = info == 21;
+      } else if (info == 26) {
+        std::uint32_t bits = static_cast<std::uint32_t>(arg);
+        float narrow;
+        std::memcpy(&narrow, &bits, sizeof(narrow));
+        field.type = Field::DOUBLE;
+        field.d = narrow;
+      } else if (info == 27) {
+        field.type = Field::DOUBLE;
+        std::memcpy(&field.d, &arg, sizeof(field.d));
+      } else {
+        field.type = Field::NONE;
+      }
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  /**
+   * @brief Read one record written by Writer::record()
+   *
+   * Tags (like the self-describe tag at the start of each file) in front of
+   * the record are skipped, and a self-describe tag starts a new string
+   * table. Field keys are copied into keys, which has to stay
+   * alive as long as the returned LogMessage is used, since Field only keeps a
+   * pointer to its key.
+   *
+   * @return false at the end of the data or if the record is broken
+   */
+  bool record(LogMessage &msg, std::unordered_set<std::string> &keys) {
+    std::uint8_t major, info;
+    std::uint64_t count;
+    do {
+      if (!this->head(major, info, count)) {
+        return false;
+      }
+      if (major == TAG && count == SELF_DESCRIBE_TAG) {
+        this->strings.clear();
+      }
+    } while (major == TAG);
+    if (major != ARRAY || (count != 5 && count != 6)) {
+      return false;
+    }
+    std::int64_t time, level, line;
+    std::string_view file, message;
+    if (!this->integer(time) || !this->integer(level) || !this->text(file) ||
+        !this->integer(line) || !this->text(message)) {
+      return false;
+    }
+    std::vector<Field> fields;
+    if (count == 6) {
+      std::uint64_t fieldCount;
+      if (!this->head(major, info, fieldCount) || major != MAP) {
+        return false;
+      }
+      for (std::uint64_t i = 0; i < fieldCount; i++) {
+        std::string_view key;
+        Field field;
+        if (!this->text(key) || !this->value(field)) {
+          return false;
+        }
+        field.key = keys.emplace(key).first->c_str();
+        fields.push_back(std::move(field));
+      }
+    }
+    msg = LogMessage(static_cast<Level>(level), std::string(message),
+                     std::string(file), static_cast<int>(line),
+                     static_cast<std::uint32_t>(time), std::move(fields));
+    return true;
+  }
+};
+} // namespace CBOR
+
+/**
+ * @brief Sink that writes messages to a file as binary CBOR records
+ *
+ * Compared to the text log, numbers in kv() fields are stored as their actual
+ * bits (so doubles come back exactly) and records are smaller, since repeated
+ * names are only written once per session. Nothing gets
+ * allocated per field, records are built straight into a fixed buffer.
+ * Convert the file on a computer with tools/convert.cpp.
+ *
+ * Set the level to DATA to only keep DATA (and custom) level logs.
+ *
+ * @example ROBOTLOG::CborFileSink telemetry("/usd/data.cbor");
+ *          telemetry.setLevel(ROBOTLOG::DATA);
+ *          logger.addSink(&telemetry);
+ */
+class CborFileSink : public FileSink {
+private:
+  char buffer[1024];
+  CBOR::Writer writer;
+  CBOR::StringTable strings;
+
+  static void drainToFile(void *context, const char *data,
+                          std::size_t length) {
+    static_cast<CborFileSink *>(context)->writeBytes(data, length);
+  }
+
+public:
+  /**
+   * @brief Construct a new CborFileSink
+   *
+   * @param filePath the file to append records to
+   */
+  CborFileSink(std::string filePath)
+      : FileSink(filePath), writer(buffer, sizeof(buffer), &drainToFile, this) {
+    // every session starts with the tag, which also resets the string table
+    this->writer.setStringTable(&this->strings);
+    this->writer.head(CBOR::TAG, CBOR::SELF_DESCRIBE_TAG);
+  }
+
+  void write(LogMessage &msg) override { this->writer.record(msg); }
+
+  void flush() override {
+    this->writer.drain();
+    FileSink::flush();
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include "field.h"
+#include "logmessage.h"
+#include "pros/serial.hpp"
+#include "telemetry.h"
+#include <cstdint>
+#include <vector>
+
+namespace ROBOTLOG {
+/*
+! Clock sync records
+* millis() starts at boot and drifts against every other clock, so to line a
+* coprocessor's or camera's log up with the brain's, the logger can write
+* DATA records pairing the two clocks, with the clock's name as the message:
+?   brain_us    pros::micros() when the other clock read ext
+?   ext         the other clock, in whatever units it counts in
+?   window_us   brain_us is only known to within +-window_us/2
+* tools/clocksync.cpp fits a line through them, which gives the offset and
+* drift vexlog-merge needs to put both logs on one timeline. The fit averages
+* over every pair, so it ends up much more exact than any one of them.
+*/
+constexpr const char *CLOCK_SYNC_FILE = "clock_sync";
+
+/**
+ * @brief Build a sync record
+ */
+inline LogMessage clockSyncRecord(const char *name, std::uint64_t brainUs,
+                                  std::int64_t external,
+                                  std::uint64_t windowUs, std::uint32_t nowMs) {
+  std::vector<Field> fields;
+  fields.reserve(3);
+  fields.emplace_back("brain_us", brainUs);
+  fields.emplace_back("ext", external);
+  fields.emplace_back("window_us", windowUs);
+  return LogMessage(Level::DATA, name, CLOCK_SYNC_FILE, 0, nowMs,
+                    std::move(fields));
+}
+
+/**
+ * @brief A counter another device sends over a smart port, read by the logger
+ *
+ * The other end writes its clock as a line of ASCII digits ("123456\n")
+ * whenever it likes, a few times a second is plenty. Each poll reads whatever
+ * arrived without waiting, and the newest complete line becomes a sync
+ * record. The line was sent some time between the last poll and this one,
+ * minus how long its own bytes took on the wire, and that window is what
+ * gets recorded, so polling more often gives tighter pairs. A fixed delay in
+ * the device's own serial buffering can't be seen from here, and shows up in
+ * the fit as part of the offset.
+ */
+class SerialClock {
+private:
+  const char *name;
+  pros::Serial serial;
+  std::uint32_t periodUs;
+  std::uint64_t nsPerByte; // 8N1, 10 bits a byte
+  std::uint64_t nextDueUs = 0;
+  std::uint64_t lastPollUs = 0;
+  std::int64_t value = 0; // the line being read so far
+  std::size_t digits = 0;
+
+public:
+  /**
+   * @param name name to log the records as, should be a string literal
+   * @param port the smart port the device is on
+   * @param baudrate the same as the device's
+   * @param poll how often to check for a new line
+   */
+  SerialClock(const char *name, std::uint8_t port, std::int32_t baudrate,
+              Rate poll)
+      : name(name), serial(port, baudrate), periodUs(poll.periodUs),
+        nsPerByte(10000000000ULL / static_cast<std::uint64_t>(baudrate)) {}
+
+  bool isDue(std::uint64_t nowUs) { return nowUs >= this->nextDueUs; }
+
+  std::uint64_t usUntilDue(std::uint64_t nowUs) {
+    return this->nextDueUs > nowUs ? this->nextDueUs - nowUs : 0;
+  }
+
+  /**
+   * @brief Read what arrived since the last poll
+   *
+   * @param nowUs the current pros::micros()
+   * @param nowMs the current pros::millis(), the record's timestamp
+   * @param msg set to the sync record if a whole line arrived
+   * @return whether msg was set
+   */
+  bool poll(std::uint64_t nowUs, std::uint32_t nowMs, LogMessage &msg) {
+    this->nextDueUs = nowUs + this->periodUs;
+    std::uint8_t buffer[64];
+    bool found = false;
+    std::int64_t latest = 0;
+    std::size_t lineBytes = 0;
+    std::size_t bytesAfter = 0; // how many came in after the newest line
+    std::int32_t available = this->serial.get_read_avail();
+    while (available > 0) {
+      std::int32_t count = this->serial.read(
+          buffer, available < static_cast<std::int32_t>(sizeof(buffer))
+                      ? available
+                      : static_cast<std::int32_t>(sizeof(buffer)));
+      if (count <= 0) {
+        break;
+      }
+      available -= count;
+      for (std::int32_t i = 0; i < count; i++) {
+        std::uint8_t c = buffer[i];
+        bytesAfter++;
+        if (c >= '0' && c <= '9') {
+          this->value = this->value * 10 + (c - '0');
+          this->digits++;
+        } else if (c == '\n' && this->digits > 0) {
+          found = true;
+          latest = this->value;
+          lineBytes = this->digits + 1;
+          bytesAfter = 0;
+          this->value = 0;
+          this->digits = 0;
+        } else if (c != '\r') {
+          this->value = 0; // noise, wait for the next line
+          this->digits = 0;
+        }
+      }
+    }
+    std::uint64_t since = this->lastPollUs;
+    this->lastPollUs = nowUs;
+    if (!found || since == 0) {
+      return false; // nothing new, or no idea how long it was waiting
+    }
+    // when its first byte went out, from how long the rest took to arrive
+    std::uint64_t wire = (lineBytes + bytesAfter) * this->nsPerByte / 1000;
+    std::uint64_t latestUs = nowUs > wire ? nowUs - wire : 0;
+    std::uint64_t lineUs = lineBytes * this->nsPerByte / 1000;
+    std::uint64_t earliestUs = since > lineUs ? since - lineUs : 0;
+    if (latestUs < earliestUs) {
+      latestUs = earliestUs;
+    }
+    msg = clockSyncRecord(this->name, (earliestUs + latestUs) / 2, latest,
+                          latestUs - earliestUs, nowMs);
+    return true;
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
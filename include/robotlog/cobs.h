@@ -0,0 +1,231 @@
+#ifndef COBS_H
+#define COBS_H
+
+#include "frame.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ROBOTLOG {
+namespace COBS {
+/*
+! COBS framed records
+* For streams (a serial port, the console) rather than files. Each record is
+?   COBS(record bytes, CRC-32 of them, little endian) 0x00
+* COBS (consistent overhead byte stuffing) rewrites the bytes so there are no
+* zeros in them, for at most 1 extra byte every 254, so a 0x00 only ever ends
+* a frame. A receiver that starts in the middle of a frame, or loses bytes,
+* throws away what it has at the next zero and carries on from there, and the
+* CRC (Frame::crc32) catches frames that got damaged without losing bytes.
+*/
+constexpr std::uint8_t DELIMITER = 0;
+constexpr std::size_t CRC_SIZE = 4;
+
+/**
+ * @brief The most bytes frame() can write for a record of size bytes
+ */
+constexpr std::size_t maxFrameSize(std::size_t size) {
+  return size + CRC_SIZE + (size + CRC_SIZE) / 254 + 2;
+}
+
+/**
+ * @brief COBS encodes bytes one at a time, straight into the output
+ */
+class Encoder {
+private:
+  std::uint8_t *out;
+  std::size_t code = 0;   // where the current run's length byte goes
+  std::size_t length = 1; // bytes written, the first length byte included
+  std::uint8_t run = 1;   // the current run's length byte
+
+public:
+  explicit Encoder(std::uint8_t *out) : out(out) {}
+
+  void put(std::uint8_t byte) {
+    if (byte != 0) {
+      this->out[this->length++] = byte;
+      this->run++;
+    }
+    if (byte == 0 || this->run == 0xFF) {
+      this->out[this->code] = this->run;
+      this->code = this->length++;
+      this->run = 1;
+    }
+  }
+
+  /**
+   * @brief Close the last run
+   *
+   * @return how many bytes were written to out
+   */
+  std::size_t finish() {
+    this->out[this->code] = this->run;
+    return this->length;
+  }
+};
+
+/**
+ * @brief Frame a record, see the layout above
+ *
+ * @param out at least maxFrameSize(size) bytes
+ * @return how many bytes were written, the delimiter included
+ */
+inline std::size_t frame(const void *record, std::size_t size,
+                         std::uint8_t *out) {
+  const std::uint8_t *bytes = static_cast<const std::uint8_t *>(record);
+  Encoder encoder(out);
+  for (std::size_t i = 0; i < size; i++) {
+    encoder.put(bytes[i]);
+  }
+  std::uint8_t crc[CRC_SIZE];
+  Frame::put32(crc, Frame::crc32(bytes, size));
+  for (std::uint8_t byte : crc) {
+    encoder.put(byte);
+  }
+  std::size_t length = encoder.finish();
+  out[length++] = DELIMITER;
+  return length;
+}
+
+/**
+ * @brief Undo COBS in place
+ *
+ * @param data a frame without its delimiter
+ * @return the decoded size, or size + 1 if it isn't valid COBS
+ */
+inline std::size_t decode(std::uint8_t *data, std::size_t size) {
+  std::size_t in = 0;
+  std::size_t out = 0;
+  while (in < size) {
+    std::uint8_t run = data[in++];
+    if (run == 0 || in + run - 1 > size) {
+      return size + 1;
+    }
+    for (std::uint8_t i = 1; i < run; i++) {
+      data[out++] = data[in++];
+    }
+    if (run != 0xFF && in < size) {
+      data[out++] = 0;
+    }
+  }
+  return out;
+}
+
+/**
+ * @brief Pulls records back out of a stream of frames, for host tools
+ *
+ * Feed it bytes as they come in, in any sized pieces, and it calls back with
+ * every record whose CRC checks out. Given a second callback it also picks
+ * out plain text printed onto the same stream (by printf on the brain, say),
+ * passing it through a line at a time: a run of printable ASCII ending in a
+ * newline or a delimiter can't be a frame, since every record starts with a
+ * byte over 0x7F.
+ */
+class Receiver {
+private:
+  std::vector<std::uint8_t> frame;
+  std::size_t maxFrame;
+  bool printable = true; // the frame so far could be text
+
+  static bool isText(std::uint8_t c) {
+    return (c >= 0x20 && c < 0x7F) || c == '\n' || c == '\r' || c == '\t' ||
+           c == '\033';
+  }
+
+public:
+  std::size_t records = 0;
+  std::size_t badFrames = 0;    // wrong CRC, not COBS, or too long
+  std::size_t skippedBytes = 0; // in frames that were thrown away
+  std::size_t textBytes = 0;
+
+  explicit Receiver(std::size_t maxFrame = 64 * 1024) : maxFrame(maxFrame) {}
+
+  /**
+   * @brief Take some more of the stream
+   *
+   * @param f called as f(const std::uint8_t *record, std::size_t size)
+   */
+  template <typename F> void feed(const std::uint8_t *data, std::size_t size,
+                                  F f) {
+    auto none = [](const char *, std::size_t) {};
+    this->scan<false>(data, size, f, none);
+  }
+
+  /**
+   * @brief Take some more of a stream that has text mixed in
+   *
+   * @param f called as f(const std::uint8_t *record, std::size_t size)
+   * @param text called as text(const char *text, std::size_t size)
+   */
+  template <typename F, typename T>
+  void feed(const std::uint8_t *data, std::size_t size, F f, T text) {
+    this->scan<true>(data, size, f, text);
+  }
+
+private:
+  template <bool TEXT, typename F, typename T>
+  void scan(const std::uint8_t *data, std::size_t size, F &f, T &text) {
+    for (std::size_t i = 0; i < size; i++) {
+      std::uint8_t c = data[i];
+      if (c == DELIMITER) {
+        this->finishFrame<TEXT>(f, text);
+        continue;
+      }
+      if (this->frame.size() >= this->maxFrame) {
+        if (TEXT && this->printable) {
+          this->passText(text);
+        } else {
+          this->skippedBytes++;
+          continue;
+        }
+      }
+      this->frame.push_back(c);
+      if (TEXT) {
+        this->printable = this->printable && isText(c);
+        // a newline at the very start could be a frame's first run length
+        if (c == '\n' && this->printable && this->frame.size() > 1) {
+          this->passText(text);
+        }
+      }
+    }
+  }
+
+  template <typename T> void passText(T &text) {
+    this->textBytes += this->frame.size();
+    text(reinterpret_cast<const char *>(this->frame.data()),
+         this->frame.size());
+    this->frame.clear();
+  }
+
+  template <bool TEXT, typename F, typename T>
+  void finishFrame(F &f, T &text) {
+    bool printable = this->printable;
+    this->printable = true;
+    if (this->frame.empty()) {
+      return; // back to back delimiters, e.g. the one a sender starts with
+    }
+    if (TEXT && printable) {
+      this->passText(text);
+      return;
+    }
+    std::size_t size = this->frame.size();
+    std::size_t length = size < this->maxFrame
+                             ? decode(this->frame.data(), size)
+                             : size + 1;
+    if (length > size || length < CRC_SIZE ||
+        Frame::crc32(this->frame.data(), length - CRC_SIZE) !=
+            Frame::get32(this->frame.data() + length - CRC_SIZE)) {
+      this->badFrames++;
+      this->skippedBytes += size + 1;
+    } else {
+      this->records++;
+      f(static_cast<const std::uint8_t *>(this->frame.data()),
+        length - CRC_SIZE);
+    }
+    this->frame.clear();
+  }
+};
+} // namespace COBS
+} // namespace ROBOTLOG
+
+#endif
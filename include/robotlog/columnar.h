@@ -0,0 +1,617 @@
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include "gorilla.h"
+#include "logmessage.h"
+#include "sink.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ROBOTLOG {
+namespace Columnar {
+/*
+! File layout
+* The file is a list of chunks, each with an 8 byte header:
+?   'V' 'C' type(1) reserved(1) payloadLength(4)
+* All numbers are little endian.
+*
+? SESSION   written when the sink is created, channel ids restart after it
+? CHANNEL   id(2) name(...)
+? DATA      id(2) count(2) firstTime(4) timeDeltas(varint * count-1)
+?           values(8 * count, raw doubles)
+? GORILLA   id(2) count(2) firstTime(4) bits(...), the same samples as DATA
+?           but compressed, see gorilla.h
+? INDEX     segmentStart(8) previousIndex(8) entryCount(4) entries(24 each)
+?           where an entry is offset(8) id(2) type(1) 0(1) count(4)
+?           firstTime(4) lastTime(4), one per chunk since segmentStart
+? TRAILER   indexOffset(8), always the last 16 bytes after a clean close()
+*
+* A reader that finds a TRAILER at the end of the file follows the INDEX chain
+* back and only has to touch the chunks of the channel it wants. If the robot
+* lost power first, it falls back to walking the chunk headers, which still
+* skips over every other channel's data.
+*/
+enum ChunkType : std::uint8_t {
+  SESSION = 0,
+  CHANNEL = 1,
+  DATA = 2,
+  INDEX = 3,
+  TRAILER = 4,
+  GORILLA = 5,
+};
+
+constexpr std::size_t HEADER_SIZE = 8;
+constexpr std::size_t ENTRY_SIZE = 24;
+constexpr std::uint64_t NO_INDEX = ~0ULL;
+
+inline void put16(std::uint8_t *out, std::uint16_t value) {
+  std::memcpy(out, &value, sizeof(value));
+}
+inline void put32(std::uint8_t *out, std::uint32_t value) {
+  std::memcpy(out, &value, sizeof(value));
+}
+inline void put64(std::uint8_t *out, std::uint64_t value) {
+  std::memcpy(out, &value, sizeof(value));
+}
+inline std::uint16_t get16(const std::uint8_t *in) {
+  std::uint16_t value;
+  std::memcpy(&value, in, sizeof(value));
+  return value;
+}
+inline std::uint32_t get32(const std::uint8_t *in) {
+  std::uint32_t value;
+  std::memcpy(&value, in, sizeof(value));
+  return value;
+}
+inline std::uint64_t get64(const std::uint8_t *in) {
+  std::uint64_t value;
+  std::memcpy(&value, in, sizeof(value));
+  return value;
+}
+
+inline void header(std::uint8_t *out, ChunkType type, std::uint32_t length) {
+  out[0] = 'V';
+  out[1] = 'C';
+  out[2] = type;
+  out[3] = 0;
+  put32(out + 4, length);
+}
+
+/**
+ * @brief One entry of the index, describing one chunk
+ */
+struct Entry {
+  std::uint64_t offset;
+  std::uint16_t id;
+  ChunkType type;
+  std::uint32_t count;
+  std::uint32_t firstTime;
+  std::uint32_t lastTime;
+};
+
+/**
+ * @brief A timestamped sample read back out of a file
+ */
+struct Sample {
+  std::uint32_t time;
+  double value;
+};
+
+/**
+ * @brief Reads channels back out of a columnar file
+ *
+ * Works on a buffer holding the whole file, which is meant to be a memory
+ * mapping so only the pages that actually get read are loaded.
+ */
+class Reader {
+private:
+  const std::uint8_t *data;
+  std::size_t size;
+  std::vector<Entry> entries;
+  bool indexed = false;
+
+  bool validChunk(std::uint64_t offset, ChunkType type) {
+    return offset + HEADER_SIZE <= this->size &&
+           this->data[offset] == 'V' && this->data[offset + 1] == 'C' &&
+           this->data[offset + 2] == type &&
+           offset + HEADER_SIZE + get32(this->data + offset + 4) <= this->size;
+  }
+
+  /**
+   * @brief Whether an entry from the index points at a whole chunk of its
+   * type, with as much payload as the readers below look at
+   */
+  bool validEntry(const Entry &entry) {
+    if (!this->validChunk(entry.offset, entry.type)) {
+      return false;
+    }
+    std::uint32_t length = get32(this->data + entry.offset + 4);
+    switch (entry.type) {
+    case SESSION:
+      return true;
+    case CHANNEL:
+      return length >= 2;
+    case DATA:
+    case GORILLA:
+      return length >= 8;
+    default:
+      return false;
+    }
+  }
+
+  /**
+   * @brief Build entries by walking chunk headers from begin to end
+   */
+  void scan(std::uint64_t begin, std::uint64_t end,
+            std::vector<Entry> &out) {
+    std::uint64_t offset = begin;
+    while (offset + HEADER_SIZE <= end) {
+      const std::uint8_t *chunk = this->data + offset;
+      std::uint32_t length = get32(chunk + 4);
+      if (chunk[0] != 'V' || chunk[1] != 'C' ||
+          offset + HEADER_SIZE + length > end) {
+        break; // cut off by a power loss
+      }
+      ChunkType type = static_cast<ChunkType>(chunk[2]);
+      const std::uint8_t *payload = chunk + HEADER_SIZE;
+      Entry entry = {offset, 0, type, 0, 0, 0};
+      if (type == CHANNEL && length >= 2) {
+        entry.id = get16(payload);
+        out.push_back(entry);
+      } else if ((type == DATA || type == GORILLA) && length >= 8) {
+        entry.id = get16(payload);
+        entry.count = get16(payload + 2);
+        out.push_back(entry);
+      } else if (type == SESSION) {
+        out.push_back(entry);
+      }
+      offset += HEADER_SIZE + length;
+    }
+  }
+
+  /**
+   * @brief Build entries from the INDEX chain, false if there isn't one
+   */
+  bool readIndex() {
+    if (this->size < 16 || !this->validChunk(this->size - 16, TRAILER)) {
+      return false;
+    }
+    std::vector<std::vector<Entry>> segments;
+    std::uint64_t indexOffset = get64(this->data + this->size - 8);
+    std::uint64_t coveredFrom = this->size;
+    while (indexOffset != NO_INDEX) {
+      // each index points further back, so a damaged one can't loop
+      if (indexOffset >= coveredFrom ||
+          !this->validChunk(indexOffset, INDEX) ||
+          get32(this->data + indexOffset + 4) < 20) {
+        return false;
+      }
+      const std::uint8_t *payload = this->data + indexOffset + HEADER_SIZE;
+      std::uint64_t segmentStart = get64(payload);
+      std::uint64_t previous = get64(payload + 8);
+      std::uint32_t count = get32(payload + 16);
+      if (20 + static_cast<std::uint64_t>(count) * ENTRY_SIZE >
+              get32(this->data + indexOffset + 4) ||
+          segmentStart > indexOffset) {
+        return false;
+      }
+      std::vector<Entry> segment;
+      for (std::uint32_t i = 0; i < count; i++) {
+        const std::uint8_t *raw = payload + 20 + i * ENTRY_SIZE;
+        Entry entry = {get64(raw), get16(raw + 8),
+                       static_cast<ChunkType>(raw[10]), get32(raw + 12),
+                       get32(raw + 16), get32(raw + 20)};
+        if (!this->validEntry(entry)) {
+          return false; // stale or damaged, walk the file instead
+        }
+        segment.push_back(entry);
+      }
+      segments.push_back(std::move(segment));
+      coveredFrom = segmentStart;
+      indexOffset = previous;
+    }
+    // anything before the oldest index (e.g. a session that never closed)
+    // still has to be walked
+    std::vector<Entry> older;
+    this->scan(0, coveredFrom, older);
+    this->entries = std::move(older);
+    for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+      this->entries.insert(this->entries.end(), it->begin(), it->end());
+    }
+    return true;
+  }
+
+  std::string_view channelName(const Entry &entry) {
+    std::uint32_t length = get32(this->data + entry.offset + 4);
+    return std::string_view(
+        reinterpret_cast<const char *>(this->data + entry.offset +
+                                       HEADER_SIZE + 2),
+        length - 2);
+  }
+
+public:
+  Reader(const void *data, std::size_t size)
+      : data(static_cast<const std::uint8_t *>(data)), size(size) {
+    this->indexed = this->readIndex();
+    if (!this->indexed) {
+      this->entries.clear();
+      this->scan(0, this->size, this->entries);
+    }
+  }
+
+  /**
+   * @brief Whether the file had an index, or had to be walked
+   */
+  bool usedIndex() { return this->indexed; }
+
+  /**
+   * @brief Every channel name in the file, in the order first seen
+   */
+  std::vector<std::string> channels() {
+    std::vector<std::string> names;
+    for (const Entry &entry : this->entries) {
+      if (entry.type != CHANNEL) {
+        continue;
+      }
+      std::string_view name = this->channelName(entry);
+      bool seen = false;
+      for (const std::string &existing : names) {
+        seen = seen || existing == name;
+      }
+      if (!seen) {
+        names.emplace_back(name);
+      }
+    }
+    return names;
+  }
+
+  /**
+   * @brief Load every sample of one channel, across all sessions
+   *
+   * Only the DATA chunks of that channel are read.
+   */
+  std::vector<Sample> load(std::string_view name) {
+    std::vector<Sample> samples;
+    int wanted = -1; // the channel's id in the current session
+    for (const Entry &entry : this->entries) {
+      if (entry.type == SESSION) {
+        wanted = -1;
+      } else if (entry.type == CHANNEL && this->channelName(entry) == name) {
+        wanted = entry.id;
+      } else if (entry.type == DATA && entry.id == wanted) {
+        const std::uint8_t *payload = this->data + entry.offset + HEADER_SIZE;
+        const std::uint8_t *end =
+            payload + get32(this->data + entry.offset + 4);
+        std::uint16_t count = get16(payload + 2);
+        std::uint32_t time = get32(payload + 4);
+        const std::uint8_t *cursor = payload + 8;
+        std::size_t first = samples.size();
+        for (std::uint16_t i = 0; i < count; i++) {
+          if (i > 0) {
+            std::uint32_t delta = 0;
+            int shift = 0;
+            while (cursor < end && (*cursor & 0x80)) {
+              delta |= static_cast<std::uint32_t>(*cursor++ & 0x7F) << shift;
+              shift += 7;
+            }
+            if (cursor >= end) {
+              break;
+            }
+            delta |= static_cast<std::uint32_t>(*cursor++) << shift;
+            time += delta;
+          }
+          samples.push_back({time, 0});
+        }
+        if (cursor + 8 * count > end) {
+          samples.resize(first);
+          continue;
+        }
+        for (std::uint16_t i = 0; i < count; i++) {
+          std::memcpy(&samples[first + i].value, cursor + 8 * i,
+                      sizeof(double));
+        }
+      } else if (entry.type == GORILLA && entry.id == wanted) {
+        const std::uint8_t *payload = this->data + entry.offset + HEADER_SIZE;
+        std::uint32_t length = get32(this->data + entry.offset + 4);
+        std::uint16_t count = get16(payload + 2);
+        Gorilla::Decoder decoder(payload + 8, length - 8, get32(payload + 4));
+        Sample sample;
+        for (std::uint16_t i = 0; i < count; i++) {
+          if (!decoder.next(sample.time, sample.value)) {
+            break;
+          }
+          samples.push_back(sample);
+        }
+      }
+    }
+    return samples;
+  }
+};
+} // namespace Columnar
+
+/**
+ * @brief Sink that stores numeric fields as per-channel columns
+ *
+ * Every number (or bool) field of a structured log becomes a sample of the
+ * channel "<message>.<key>", so a watch called leftVel turns into the channels
+ * leftVel.v and leftVel.late_us. Names longer than MAX_NAME are skipped, and
+ * so are the fields the logger adds itself (see LoggerFields), which would
+ * turn every rate limited text message into a channel of its own. Samples are
+ * buffered per channel and written as a chunk once a channel has
+ * CHUNK_SAMPLES of them or its oldest one is older than the max chunk age, so
+ * the data for one channel ends up close together and a reader can skip
+ * everything else. Read the file on a computer with tools/columns.cpp.
+ *
+ * Call close() (e.g. from disabled()) to write the index, a file without one
+ * still reads fine, just a bit slower. Until then the index is kept in
+ * memory, and written out early every MAX_SEGMENT chunks so it can't grow
+ * without end if close() never comes.
+ *
+ * @example ROBOTLOG::ColumnarSink columns("/usd/telemetry.vxc");
+ *          logger.addSink(&columns);
+ */
+class ColumnarSink : public FileSink {
+public:
+  static constexpr std::size_t CHUNK_SAMPLES = 256;
+  static constexpr std::size_t MAX_CHANNELS = 128;
+  static constexpr std::size_t MAX_NAME = 255; // "<message>.<key>"
+  static constexpr std::size_t MAX_SEGMENT = 1024; // index entries in memory
+
+private:
+  struct Channel {
+    std::string message;
+    std::string key;
+    std::uint16_t id;
+    std::uint16_t count = 0;
+    std::uint32_t times[CHUNK_SAMPLES];
+    double values[CHUNK_SAMPLES];
+  };
+
+  std::deque<Channel> channels; // deque, so channels never move
+  std::vector<Columnar::Entry> segment;
+  std::uint64_t segmentStart;
+  std::uint64_t previousIndex = Columnar::NO_INDEX;
+  std::uint32_t maxChunkAgeMs = 1000;
+  std::uint32_t lastTime = 0;
+  std::uint32_t (*clock)() = nullptr;
+  bool compress = false;
+  // big enough for one full chunk, either 5 + 8 bytes a sample for DATA or
+  // Gorilla's worst case of 36 + 77 bits a sample
+  std::uint8_t scratch[Columnar::HEADER_SIZE + 8 + CHUNK_SAMPLES * 15];
+  static_assert(sizeof(scratch) >= 2 + MAX_NAME, "a CHANNEL chunk must fit");
+
+  void writeChunk(Columnar::ChunkType type, const std::uint8_t *payload,
+                  std::uint32_t length, Columnar::Entry entry) {
+    entry.offset = this->fileSize;
+    entry.type = type;
+    std::uint8_t head[Columnar::HEADER_SIZE];
+    Columnar::header(head, type, length);
+    this->writeBytes(reinterpret_cast<const char *>(head), sizeof(head));
+    this->writeBytes(reinterpret_cast<const char *>(payload), length);
+    this->segment.push_back(entry);
+    if (this->segment.size() >= MAX_SEGMENT) {
+      this->writeIndex();
+    }
+  }
+
+  // the index of every chunk since the last one, chained onto it
+  void writeIndex() {
+    std::uint64_t indexOffset = this->fileSize;
+    std::uint32_t length = 20 + this->segment.size() * Columnar::ENTRY_SIZE;
+    std::uint8_t head[Columnar::HEADER_SIZE + 20];
+    Columnar::header(head, Columnar::INDEX, length);
+    Columnar::put64(head + 8, this->segmentStart);
+    Columnar::put64(head + 16, this->previousIndex);
+    Columnar::put32(head + 24, this->segment.size());
+    this->writeBytes(reinterpret_cast<const char *>(head), sizeof(head));
+    for (const Columnar::Entry &entry : this->segment) {
+      std::uint8_t raw[Columnar::ENTRY_SIZE] = {};
+      Columnar::put64(raw, entry.offset);
+      Columnar::put16(raw + 8, entry.id);
+      raw[10] = entry.type;
+      Columnar::put32(raw + 12, entry.count);
+      Columnar::put32(raw + 16, entry.firstTime);
+      Columnar::put32(raw + 20, entry.lastTime);
+      this->writeBytes(reinterpret_cast<const char *>(raw), sizeof(raw));
+    }
+    this->segment.clear();
+    this->segmentStart = this->fileSize;
+    this->previousIndex = indexOffset;
+  }
+
+  Channel *findChannel(std::string_view message, const char *key) {
+    for (Channel &channel : this->channels) {
+      if (channel.message == message && channel.key == key) {
+        return &channel;
+      }
+    }
+    if (this->channels.size() >= MAX_CHANNELS ||
+        message.size() + 1 + std::strlen(key) > MAX_NAME) {
+      return nullptr; // a name that long is a text message, not a channel
+    }
+    Channel &channel = this->channels.emplace_back();
+    channel.message = message;
+    channel.key = key;
+    channel.id = static_cast<std::uint16_t>(this->channels.size() - 1);
+
+    std::string name = channel.message + "." + channel.key;
+    std::uint8_t *payload = this->scratch;
+    Columnar::put16(payload, channel.id);
+    std::memcpy(payload + 2, name.data(), name.size());
+    this->writeChunk(Columnar::CHANNEL, payload, 2 + name.size(),
+                     {0, channel.id, Columnar::CHANNEL, 0, 0, 0});
+    return &channel;
+  }
+
+  void writeGorilla(Channel &channel) {
+    std::uint8_t *payload = this->scratch;
+    Columnar::put16(payload, channel.id);
+    Columnar::put16(payload + 2, channel.count);
+    Columnar::put32(payload + 4, channel.times[0]);
+    Gorilla::BitWriter bits(payload + 8, sizeof(this->scratch) - 8);
+    Gorilla::Encoder encoder(bits);
+    for (std::uint16_t i = 0; i < channel.count; i++) {
+      encoder.add(channel.times[i], channel.values[i]);
+    }
+    this->writeChunk(Columnar::GORILLA, payload, 8 + bits.bytes(),
+                     {0, channel.id, Columnar::GORILLA, channel.count,
+                      channel.times[0], channel.times[channel.count - 1]});
+    channel.count = 0;
+  }
+
+  void writeData(Channel &channel) {
+    if (channel.count == 0) {
+      return;
+    }
+    if (this->compress) {
+      this->writeGorilla(channel);
+      return;
+    }
+    std::uint8_t *payload = this->scratch;
+    Columnar::put16(payload, channel.id);
+    Columnar::put16(payload + 2, channel.count);
+    Columnar::put32(payload + 4, channel.times[0]);
+    std::size_t length = 8;
+    for (std::uint16_t i = 1; i < channel.count; i++) {
+      std::uint32_t delta = channel.times[i] - channel.times[i - 1];
+      while (delta >= 0x80) {
+        payload[length++] = static_cast<std::uint8_t>(delta | 0x80);
+        delta >>= 7;
+      }
+      payload[length++] = static_cast<std::uint8_t>(delta);
+    }
+    std::memcpy(payload + length, channel.values,
+                channel.count * sizeof(double));
+    length += channel.count * sizeof(double);
+    this->writeChunk(Columnar::DATA, payload, length,
+                     {0, channel.id, Columnar::DATA, channel.count,
+                      channel.times[0], channel.times[channel.count - 1]});
+    channel.count = 0;
+  }
+
+public:
+  /**
+   * @brief Construct a new ColumnarSink
+   *
+   * @param filePath the file to append to
+   */
+  ColumnarSink(std::string filePath) : FileSink(filePath) {
+    // if the last session closed cleanly, chain onto its index
+    if (this->fileSize >= 16) {
+      std::ifstream existing(filePath, std::ios::binary);
+      std::uint8_t trailer[16];
+      existing.seekg(this->fileSize - 16);
+      if (existing.read(reinterpret_cast<char *>(trailer), sizeof(trailer)) &&
+          trailer[0] == 'V' && trailer[1] == 'C' &&
+          trailer[2] == Columnar::TRAILER) {
+        this->previousIndex = Columnar::get64(trailer + 8);
+      }
+    }
+    this->segmentStart = this->fileSize;
+    this->writeChunk(Columnar::SESSION, nullptr, 0,
+                     {0, 0, Columnar::SESSION, 0, 0, 0});
+  }
+
+  /**
+   * @brief Set how long a sample can sit in memory before it's written
+   *
+   * Anything still buffered is lost if the robot loses power, so this is how
+   * much data that can cost at most. Longer means bigger, faster to read
+   * chunks.
+   */
+  void setMaxChunkAge(std::uint32_t ms) { this->maxChunkAgeMs = ms; }
+
+  /**
+   * @brief Measure chunk age with a clock instead of the messages' times
+   *
+   * Without one, a chunk only gets old when newer messages arrive, so the
+   * last samples before logging goes quiet can wait in memory indefinitely.
+   * logger.addSink() sets this to pros::millis.
+   *
+   * @param clock returns the current time in milliseconds
+   */
+  void setClock(std::uint32_t (*clock)()) override { this->clock = clock; }
+
+  /**
+   * @brief Compress chunks with Gorilla (delta-of-delta times, XORed values)
+   *
+   * Slow changing channels like battery voltage or heading shrink a lot, at
+   * the cost of some CPU on the logger's task when a chunk is written. Can be
+   * changed at any time, files can mix both kinds of chunk.
+   */
+  void setCompression(bool compress) { this->compress = compress; }
+
+  void write(LogMessage &msg) override {
+    this->lastTime = msg.getTime();
+    for (const Field &field : msg.getFields()) {
+      double value;
+      if (field.type == Field::DOUBLE) {
+        value = field.d;
+      } else if (field.type == Field::INT) {
+        value = static_cast<double>(field.i);
+      } else if (field.type == Field::BOOL) {
+        value = field.b ? 1 : 0;
+      } else {
+        continue;
+      }
+      if (LoggerFields::isLoggerField(field.key)) {
+        continue;
+      }
+      Channel *channel = this->findChannel(msg.getMessageView(), field.key);
+      if (channel == nullptr) {
+        continue;
+      }
+      channel->times[channel->count] = msg.getTime();
+      channel->values[channel->count] = value;
+      channel->count++;
+      if (channel->count == CHUNK_SAMPLES) {
+        this->writeData(*channel);
+      }
+    }
+  }
+
+  void flush() override {
+    std::uint32_t now = this->clock != nullptr ? this->clock() : this->lastTime;
+    for (Channel &channel : this->channels) {
+      if (channel.count > 0 && now - channel.times[0] >= this->maxChunkAgeMs) {
+        this->writeData(channel);
+      }
+    }
+    FileSink::flush();
+  }
+
+  bool hasPending() override {
+    for (const Channel &channel : this->channels) {
+      if (channel.count > 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Write out everything buffered, followed by the index
+   *
+   * Can be called more than once, e.g. at the end of every match. Logging
+   * can keep going afterwards, the next close() indexes what came after.
+   */
+  void close() {
+    for (Channel &channel : this->channels) {
+      this->writeData(channel);
+    }
+    this->writeIndex();
+    std::uint8_t trailer[Columnar::HEADER_SIZE + 8];
+    Columnar::header(trailer, Columnar::TRAILER, 8);
+    Columnar::put64(trailer + 8, this->previousIndex);
+    this->writeBytes(reinterpret_cast<const char *>(trailer), sizeof(trailer));
+    FileSink::flush();
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef CONTROLLERSINK_H
+#define CONTROLLERSINK_H
+
+#include "logmessage.h"
+#include "pros/misc.hpp"
+#include "pros/rtos.hpp"
+#include "sink.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace ROBOTLOG {
+/**
+ * @brief Sink that shows the latest warnings and errors on the controller
+ *
+ * The controller's screen only takes one line of text every 50 ms or so, and
+ * anything sent sooner is lost. So this only remembers the newest message for
+ * each line (errors on the first, warnings on the second, anything else at or
+ * above the sink's level on the third), and sends one line per 50 ms from the
+ * logger's task, the ones that changed in turn. A burst of warnings costs one
+ * update for the last of them, and nothing but the logger's task ever talks
+ * to the controller. Lines are padded with spaces so a shorter message covers
+ * the longer one before it.
+ *
+ * Only gets warnings and errors by default, setLevel(ROBOTLOG::INFO) to use
+ * the third line too. DATA records are never shown.
+ *
+ * @example ROBOTLOG::ControllerSink driverScreen(pros::E_CONTROLLER_MASTER);
+ *          logger.addSink(&driverScreen);
+ */
+class ControllerSink : public Sink {
+public:
+  static constexpr std::size_t LINES = 3;
+  static constexpr std::size_t COLUMNS = 19;
+  static constexpr std::uint32_t UPDATE_MS = 50;
+
+private:
+  pros::Controller controller;
+  char wanted[LINES][COLUMNS + 1];
+  char shown[LINES][COLUMNS + 1];
+  bool dirty[LINES] = {false, false, false};
+  std::size_t nextLine = 0; // where to start looking for a changed line
+  std::uint32_t lastUpdate = 0;
+  bool everUpdated = false;
+  std::size_t updates = 0;
+  std::size_t coalesced = 0;
+
+  static std::size_t lineFor(Level level) {
+    if (level == ERROR) {
+      return 0;
+    }
+    return level == WARN ? 1 : 2;
+  }
+
+public:
+  /**
+   * @param id which controller to show them on
+   */
+  explicit ControllerSink(
+      pros::controller_id_e_t id = pros::E_CONTROLLER_MASTER)
+      : controller(id) {
+    this->level = WARN;
+    for (std::size_t line = 0; line < LINES; line++) {
+      std::memset(this->wanted[line], ' ', COLUMNS);
+      this->wanted[line][COLUMNS] = '\0';
+      std::memcpy(this->shown[line], this->wanted[line], COLUMNS + 1);
+    }
+  }
+
+  void write(LogMessage &msg) override {
+    if (msg.getLevel() == DATA) {
+      return; // watches and the like, far too many to read
+    }
+    std::size_t line = lineFor(msg.getLevel());
+    // "W motor 3 hot temp=55", as much as fits
+    const char *name = LogMessage::levelName(msg.getLevel());
+    std::string text = std::string(1, name != nullptr ? name[0] : '?') + " " +
+                       msg.getMessage() + msg.getFieldsAsString();
+    std::size_t length = text.size() < COLUMNS ? text.size() : COLUMNS;
+    if (this->dirty[line]) {
+      this->coalesced++; // replaced before it was ever shown
+    }
+    std::memcpy(this->wanted[line], text.data(), length);
+    std::memset(this->wanted[line] + length, ' ', COLUMNS - length);
+    this->dirty[line] =
+        std::memcmp(this->wanted[line], this->shown[line], COLUMNS) != 0;
+  }
+
+  /**
+   * @brief Send one changed line, if it's been long enough since the last
+   */
+  void flush() override {
+    std::uint32_t now = pros::millis();
+    if (!this->hasPending() ||
+        (this->everUpdated && now - this->lastUpdate < UPDATE_MS)) {
+      return;
+    }
+    std::size_t line = this->nextLine;
+    while (!this->dirty[line]) {
+      line = (line + 1) % LINES;
+    }
+    this->nextLine = (line + 1) % LINES;
+    // the slot is used up even if it didn't take, try again in the next one
+    this->lastUpdate = now;
+    this->everUpdated = true;
+    if (this->controller.set_text(static_cast<std::uint8_t>(line), 0,
+                                  this->wanted[line]) == 1) {
+      std::memcpy(this->shown[line], this->wanted[line], COLUMNS + 1);
+      this->dirty[line] = false;
+      this->updates++;
+      this->addBytes(COLUMNS);
+    }
+  }
+
+  bool hasPending() override {
+    return this->dirty[0] || this->dirty[1] || this->dirty[2];
+  }
+
+  /**
+   * @brief How many lines have been sent to the controller
+   */
+  std::size_t getUpdates() { return this->updates; }
+
+  /**
+   * @brief How many messages were replaced by a newer one before they were
+   * shown
+   */
+  std::size_t getCoalesced() { return this->coalesced; }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include "stringtable.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ROBOTLOG {
+namespace Dictionary {
+/*
+! Dictionary text format
+* Most log lines are the same text with different numbers in it, so each line
+* is split into a template (the line with every number replaced by \x1A) and
+* the numbers themselves. The first time a template shows up it's defined, and
+* every line after that is just the template's number and the arguments.
+*
+* Each line of the file is one of:
+?   \x05VEXLOG-DICT 1          start of a session, forget every template
+?   \x02<template>             define the next template (0, 1, 2, ...)
+?   \x03<id>\x1F<arg>\x1F...   a log line, using template <id>
+?   \x04<line>                 a log line kept as-is that starts with \x02-\x05
+?   <line>                     any other line is a log line kept as-is
+*
+* Numbers inside ANSI color codes are left in the template, so colored lines
+* don't end up with the color as an argument. Arguments are kept as the exact
+* text, so the decoded line is byte for byte what the logger formatted.
+*/
+constexpr char DEFINE = '\x02';
+constexpr char USE = '\x03';
+constexpr char ESCAPE = '\x04';
+constexpr char SESSION = '\x05';
+constexpr char HOLE = '\x1A';
+constexpr char ARG = '\x1F';
+constexpr std::string_view HEADER = "\x05VEXLOG-DICT 1";
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+inline bool isSpecial(char c) {
+  return c == '\n' || c == HOLE || c == ARG || (c >= DEFINE && c <= SESSION);
+}
+
+/**
+ * @brief Turns log lines into dictionary lines, in fixed memory
+ */
+class Encoder {
+public:
+  typedef void (*OutputFn)(void *context, const char *data, std::size_t length);
+  static constexpr std::size_t MAX_LINE = 192;
+
+private:
+  BasicStringTable<256, 8192, MAX_LINE> templates;
+  char templateText[MAX_LINE];
+  char use[MAX_LINE * 2 + 2]; // every byte could be an argument
+
+  static void raw(std::string_view line, OutputFn out, void *context) {
+    if (!line.empty() && line[0] >= DEFINE && line[0] <= SESSION) {
+      out(context, &ESCAPE, 1);
+    }
+    out(context, line.data(), line.size());
+    out(context, "\n", 1);
+  }
+
+public:
+  /**
+   * @brief Forget every template, and write the session header
+   */
+  void start(OutputFn out, void *context) {
+    this->templates.clear();
+    out(context, HEADER.data(), HEADER.size());
+    out(context, "\n", 1);
+  }
+
+  /**
+   * @brief Encode one log line
+   *
+   * @param line the line, without its trailing newline
+   * @param out called with the bytes to write (possibly more than once)
+   * @param context passed straight through to out
+   */
+  void line(std::string_view line, OutputFn out, void *context) {
+    if (line.size() > MAX_LINE) {
+      raw(line, out, context);
+      return;
+    }
+    std::size_t templateLength = 0;
+    std::size_t useLength = 1; // the id goes in front later
+    std::size_t i = 0;
+    while (i < line.size()) {
+      char c = line[i];
+      if (isSpecial(c)) {
+        raw(line, out, context); // can't be put in a template
+        return;
+      }
+      if (c == '\033' && i + 1 < line.size() && line[i + 1] == '[') {
+        // copy the whole color code, numbers and all
+        std::size_t end = i + 2;
+        while (end < line.size() && (line[end] < 0x40 || line[end] > 0x7E)) {
+          end++;
+        }
+        end = end < line.size() ? end + 1 : end;
+        for (; i < end; i++) {
+          if (isSpecial(line[i])) {
+            raw(line, out, context);
+            return;
+          }
+          this->templateText[templateLength++] = line[i];
+        }
+        continue;
+      }
+      bool sign = c == '-' && i + 1 < line.size() && isDigit(line[i + 1]) &&
+                  (i == 0 || !isDigit(line[i - 1]));
+      if (isDigit(c) || sign) {
+        std::size_t end = i + 1;
+        while (end < line.size() &&
+               (isDigit(line[end]) ||
+                (line[end] == '.' && end + 1 < line.size() &&
+                 isDigit(line[end + 1]) && isDigit(line[end - 1])))) {
+          end++;
+        }
+        this->templateText[templateLength++] = HOLE;
+        this->use[useLength++] = ARG;
+        for (; i < end; i++) {
+          this->use[useLength++] = line[i];
+        }
+        continue;
+      }
+      this->templateText[templateLength++] = c;
+      i++;
+    }
+
+    bool added;
+    int id = this->templates.find(
+        std::string_view(this->templateText, templateLength), added);
+    if (id < 0) {
+      raw(line, out, context);
+      return;
+    }
+    if (added) {
+      out(context, &DEFINE, 1);
+      out(context, this->templateText, templateLength);
+      out(context, "\n", 1);
+    }
+    char digits[8];
+    std::size_t count = 0;
+    do {
+      digits[count++] = static_cast<char>('0' + id % 10);
+      id /= 10;
+    } while (id > 0);
+    out(context, &USE, 1);
+    while (count > 0) {
+      out(context, &digits[--count], 1);
+    }
+    this->use[useLength++] = '\n';
+    out(context, this->use + 1, useLength - 1);
+  }
+};
+
+/**
+ * @brief Turns dictionary lines back into log lines
+ *
+ * Meant for host tools, it keeps templates in a std::vector.
+ */
+class Decoder {
+private:
+  std::vector<std::string> templates;
+
+public:
+  /**
+   * @brief The templates defined so far, in order
+   */
+  const std::vector<std::string> &getTemplates() const {
+    return this->templates;
+  }
+
+  /**
+   * @brief Start from templates found elsewhere, e.g. by reading the part of
+   * the file before this one
+   */
+  void setTemplates(std::vector<std::string> templates) {
+    this->templates = std::move(templates);
+  }
+
+  /**
+   * @brief Decode one line of the file
+   *
+   * @param line the line, without its trailing newline
+   * @param out set to the decoded log line
+   * @return true if the line was a log line, false if it only updated the
+   * dictionary (or referenced a template that was never defined)
+   */
+  bool line(std::string_view line, std::string &out) {
+    out.clear();
+    if (line.empty()) {
+      return true;
+    }
+    switch (line[0]) {
+    case SESSION:
+      this->templates.clear();
+      return false;
+    case DEFINE:
+      this->templates.emplace_back(line.substr(1));
+      return false;
+    case ESCAPE:
+      out.assign(line.substr(1));
+      return true;
+    case USE:
+      break;
+    default:
+      out.assign(line);
+      return true;
+    }
+    std::size_t id = 0;
+    std::size_t i = 1;
+    while (i < line.size() && isDigit(line[i])) {
+      id = id * 10 + (line[i] - '0');
+      i++;
+    }
+    if (id >= this->templates.size()) {
+      return false;
+    }
+    // copied a run at a time, this is most of what reading a log costs
+    std::string_view text = this->templates[id];
+    std::size_t at = 0;
+    while (true) {
+      std::size_t hole = text.find(HOLE, at);
+      out.append(text.substr(at, hole - at));
+      if (hole == std::string_view::npos) {
+        break;
+      }
+      at = hole + 1;
+      if (i < line.size() && line[i] == ARG) {
+        i++;
+      }
+      std::size_t end = line.find(ARG, i);
+      end = end == std::string_view::npos ? line.size() : end;
+      out.append(line.substr(i, end - i));
+      i = end;
+    }
+    return true;
+  }
+};
+} // namespace Dictionary
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef FIELD_H
+#define FIELD_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace ROBOTLOG {
+/**
+ * @brief A single typed key/value pair attached to a structured log record
+ *
+ * Fields are what logger.kv() stores alongside the event name. The value keeps
+ * its type (bool, integer, double or string) so sinks can serialize it without
+ * going through text first.
+ *
+ * The key is not copied, so it should be a string literal (or otherwise live
+ * for the rest of the program).
+ *
+ * @example logger.kv(ROBOTLOG::INFO, "turn", {"heading", h}, {"done", true});
+ */
+struct Field {
+  enum Type : std::uint8_t {
+    NONE = 0,
+    BOOL = 1,
+    INT = 2,
+    DOUBLE = 3,
+    STRING = 4,
+  };
+
+  const char *key = nullptr;
+  Type type = NONE;
+  union {
+    bool b;
+    std::int64_t i;
+    double d;
+  };
+  std::string s;
+
+  Field() : i(0) {}
+  Field(const char *key, bool value) : key(key), type(BOOL), b(value) {}
+  template <typename T,
+            typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+  Field(const char *key, T value)
+      : key(key), type(INT), i(static_cast<std::int64_t>(value)) {}
+  Field(const char *key, float value)
+      : key(key), type(DOUBLE), d(static_cast<double>(value)) {}
+  Field(const char *key, double value) : key(key), type(DOUBLE), d(value) {}
+  Field(const char *key, const char *value)
+      : key(key), type(STRING), i(0), s(value) {}
+  Field(const char *key, std::string value)
+      : key(key), type(STRING), i(0), s(std::move(value)) {}
+
+  /**
+   * @brief Whether this field was actually given a value
+   *
+   * Default constructed fields (the unused kv() parameters) are empty and get
+   * skipped when the record is built.
+   */
+  bool isSet() const { return this->type != NONE && this->key != nullptr; }
+};
+
+/**
+ * @brief Keys of the fields the logger adds to a message itself
+ *
+ * They say how the message got through (rate limited, collapsed, sampled),
+ * not anything the message measures, so sinks that keep numbers as channels
+ * skip them.
+ */
+namespace LoggerFields {
+constexpr const char *SUPPRESSED = "suppressed"; // held back by a RateLimit
+constexpr const char *REPEATED = "repeated";     // collapsed by RepeatFilter
+constexpr const char *SAMPLED = "sampled";       // kept 1 in this many
+
+inline bool isLoggerField(const char *key) {
+  return key != nullptr &&
+         (std::strcmp(key, SUPPRESSED) == 0 ||
+          std::strcmp(key, REPEATED) == 0 || std::strcmp(key, SAMPLED) == 0);
+}
+} // namespace LoggerFields
+} // namespace ROBOTLOG
+
+#endif
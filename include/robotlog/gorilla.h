@@ -0,0 +1,278 @@
+#ifndef GORILLA_H
+#define GORILLA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ROBOTLOG {
+namespace Gorilla {
+/*
+! Gorilla compression (Pelkonen et al., "Gorilla: A Fast, Scalable, In-Memory
+! Time Series Database")
+* Timestamps are stored as the change in the time between samples
+* (delta-of-delta), which is 0 for anything sampled at a steady rate:
+?   0                    same spacing as last time
+?   10   + 7 bits        -63 to 64
+?   110  + 9 bits        -255 to 256
+?   1110 + 12 bits       -2047 to 2048
+?   1111 + 32 bits       anything else
+* Values are XORed with the previous value. Slow moving sensors give XORs
+* that are mostly zero bits, so only the bits in between get stored:
+?   0                    same value as last time
+?   10   + bits          the meaningful bits fit in the previous window
+?   11   + 5 bits leading zeros + 6 bits length + bits
+* The first time isn't in the stream (the chunk header has it) and the first
+* value is 64 raw bits. Bits are packed most significant first.
+*/
+
+/**
+ * @brief Packs bits into a fixed byte buffer
+ */
+class BitWriter {
+private:
+  std::uint8_t *out;
+  std::size_t capacity;
+  std::size_t bits = 0;
+
+public:
+  BitWriter(std::uint8_t *out, std::size_t capacity)
+      : out(out), capacity(capacity) {
+    std::memset(out, 0, capacity);
+  }
+
+  /**
+   * @brief Write the low count bits of value
+   *
+   * @return false (and writes nothing) if the buffer is full
+   */
+  bool write(std::uint64_t value, int count) {
+    if (this->bits + count > this->capacity * 8) {
+      return false;
+    }
+    // a byte (or what's left of one) at a time
+    while (count > 0) {
+      int room = 8 - static_cast<int>(this->bits & 7);
+      int take = count < room ? count : room;
+      unsigned chunk = (value >> (count - take)) & ((1u << take) - 1);
+      this->out[this->bits >> 3] |= chunk << (room - take);
+      this->bits += take;
+      count -= take;
+    }
+    return true;
+  }
+
+  std::size_t bytes() { return (this->bits + 7) / 8; }
+};
+
+class BitReader {
+private:
+  const std::uint8_t *in;
+  std::size_t sizeBits;
+  std::size_t bits = 0;
+
+public:
+  BitReader(const std::uint8_t *in, std::size_t size)
+      : in(in), sizeBits(size * 8) {}
+
+  bool read(int count, std::uint64_t &value) {
+    if (this->bits + count > this->sizeBits) {
+      return false;
+    }
+    value = 0;
+    while (count > 0) {
+      int room = 8 - static_cast<int>(this->bits & 7);
+      int take = count < room ? count : room;
+      unsigned chunk =
+          (this->in[this->bits >> 3] >> (room - take)) & ((1u << take) - 1);
+      value = (value << take) | chunk;
+      this->bits += take;
+      count -= take;
+    }
+    return true;
+  }
+};
+
+inline int leadingZeros(std::uint64_t value) {
+  return value == 0 ? 64 : __builtin_clzll(value);
+}
+inline int trailingZeros(std::uint64_t value) {
+  return value == 0 ? 64 : __builtin_ctzll(value);
+}
+
+/**
+ * @brief Compresses one channel's samples into a BitWriter
+ */
+class Encoder {
+private:
+  BitWriter &out;
+  bool started = false;
+  std::uint32_t previousTime = 0;
+  std::int64_t previousDelta = 0;
+  std::uint64_t previousBits = 0;
+  int previousLeading = 64;
+  int previousTrailing = 64;
+
+  bool time(std::uint32_t time) {
+    std::int64_t delta =
+        static_cast<std::int64_t>(time) - static_cast<std::int64_t>(previousTime);
+    std::int64_t dod = delta - this->previousDelta;
+    this->previousTime = time;
+    this->previousDelta = delta;
+    if (dod == 0) {
+      return this->out.write(0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+      return this->out.write(0b10, 2) && this->out.write(dod + 63, 7);
+    } else if (dod >= -255 && dod <= 256) {
+      return this->out.write(0b110, 3) && this->out.write(dod + 255, 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+      return this->out.write(0b1110, 4) && this->out.write(dod + 2047, 12);
+    }
+    return this->out.write(0b1111, 4) &&
+           this->out.write(static_cast<std::uint32_t>(dod), 32);
+  }
+
+  bool value(double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    std::uint64_t xored = bits ^ this->previousBits;
+    this->previousBits = bits;
+    if (xored == 0) {
+      return this->out.write(0, 1);
+    }
+    int leading = leadingZeros(xored);
+    int trailing = trailingZeros(xored);
+    if (leading > 31) {
+      leading = 31; // only 5 bits to store it in
+    }
+    if (leading >= this->previousLeading &&
+        trailing >= this->previousTrailing) {
+      int length = 64 - this->previousLeading - this->previousTrailing;
+      return this->out.write(0b10, 2) &&
+             this->out.write(xored >> this->previousTrailing, length);
+    }
+    int length = 64 - leading - trailing;
+    this->previousLeading = leading;
+    this->previousTrailing = trailing;
+    return this->out.write(0b11, 2) && this->out.write(leading, 5) &&
+           this->out.write(length & 63, 6) && // 64 is stored as 0
+           this->out.write(xored >> trailing, length);
+  }
+
+public:
+  Encoder(BitWriter &out) : out(out) {}
+
+  /**
+   * @brief Add one sample
+   *
+   * @return false if the buffer ran out of room
+   */
+  bool add(std::uint32_t time, double value) {
+    if (!this->started) {
+      this->started = true;
+      this->previousTime = time;
+      std::memcpy(&this->previousBits, &value, sizeof(value));
+      return this->out.write(this->previousBits, 64);
+    }
+    return this->time(time) && this->value(value);
+  }
+};
+
+/**
+ * @brief Reads samples back out of what an Encoder wrote
+ */
+class Decoder {
+private:
+  BitReader in;
+  bool started = false;
+  std::uint32_t previousTime;
+  std::int64_t previousDelta = 0;
+  std::uint64_t previousBits = 0;
+  int previousLeading = 0;
+  int previousTrailing = 0;
+
+public:
+  /**
+   * @param data the compressed bits
+   * @param size size of data in bytes
+   * @param firstTime the time of the first sample
+   */
+  Decoder(const std::uint8_t *data, std::size_t size, std::uint32_t firstTime)
+      : in(data, size), previousTime(firstTime) {}
+
+  /**
+   * @brief Read the next sample
+   *
+   * The stream doesn't mark its own end, so only call this as many times as
+   * there were samples.
+   *
+   * @return false if the data ran out
+   */
+  bool next(std::uint32_t &time, double &value) {
+    std::uint64_t bits;
+    if (!this->started) {
+      this->started = true;
+      if (!this->in.read(64, this->previousBits)) {
+        return false;
+      }
+      time = this->previousTime;
+      std::memcpy(&value, &this->previousBits, sizeof(value));
+      return true;
+    }
+
+    int prefix = 0;
+    while (prefix < 4) {
+      if (!this->in.read(1, bits)) {
+        return false;
+      }
+      if (bits == 0) {
+        break;
+      }
+      prefix++;
+    }
+    static const int widths[] = {0, 7, 9, 12, 32};
+    static const std::int64_t offsets[] = {0, 63, 255, 2047, 0};
+    std::int64_t dod = 0;
+    if (prefix > 0) {
+      if (!this->in.read(widths[prefix], bits)) {
+        return false;
+      }
+      dod = prefix == 4 ? static_cast<std::int32_t>(bits)
+                        : static_cast<std::int64_t>(bits) - offsets[prefix];
+    }
+    this->previousDelta += dod;
+    this->previousTime += static_cast<std::uint32_t>(this->previousDelta);
+    time = this->previousTime;
+
+    if (!this->in.read(1, bits)) {
+      return false;
+    }
+    if (bits == 1) {
+      if (!this->in.read(1, bits)) {
+        return false;
+      }
+      if (bits == 1) {
+        std::uint64_t leading, length;
+        if (!this->in.read(5, leading) || !this->in.read(6, length)) {
+          return false;
+        }
+        if (length == 0) {
+          length = 64;
+        }
+        this->previousLeading = static_cast<int>(leading);
+        this->previousTrailing = static_cast<int>(64 - leading - length);
+      }
+      int length = 64 - this->previousLeading - this->previousTrailing;
+      if (!this->in.read(length, bits)) {
+        return false;
+      }
+      this->previousBits ^= bits << this->previousTrailing;
+    }
+    std::memcpy(&value, &this->previousBits, sizeof(value));
+    return true;
+  }
+};
+} // namespace Gorilla
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,365 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include "logmessage.h"
+#include "sink.h"
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace ROBOTLOG {
+namespace JSON {
+/**
+ * @brief Whether a single byte has to be escaped inside a JSON string
+ */
+inline bool needsEscape(unsigned char c) {
+  return c == '"' || c == '\\' || c < 0x20;
+}
+
+/**
+ * @brief Find the first byte that needs escaping, one byte at a time
+ *
+ * Kept around as the reference version of findEscape(), and so the benchmark
+ * has something to compare against.
+ *
+ * @return the index of the first byte to escape, or length if there are none
+ */
+inline std::size_t findEscapeScalar(const char *str, std::size_t length) {
+  for (std::size_t i = 0; i < length; i++) {
+    if (needsEscape(static_cast<unsigned char>(str[i]))) {
+      return i;
+    }
+  }
+  return length;
+}
+
+/**
+ * @brief Find the first byte that needs escaping
+ *
+ * Checks 16 bytes at a time with NEON on the brain (SSE2 on a laptop), then 8
+ * bytes at a time with plain 64 bit math, then finishes byte by byte. Most log
+ * messages have nothing to escape, so this is usually just the vector loop.
+ *
+ * @return the index of the first byte to escape, or length if there are none
+ */
+inline std::size_t findEscape(const char *str, std::size_t length) {
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1F);
+  for (; i + 16 <= length; i += 16) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + i));
+    __m128i hits = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                     _mm_cmpeq_epi8(chunk, backslash)),
+        // max(c, 0x1F) == 0x1F only when c <= 0x1F (unsigned)
+        _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+    int mask = _mm_movemask_epi8(hits);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__ARM_NEON)
+  const uint8x16_t quote = vdupq_n_u8('"');
+  const uint8x16_t backslash = vdupq_n_u8('\\');
+  const uint8x16_t control = vdupq_n_u8(0x20);
+  for (; i + 16 <= length; i += 16) {
+    uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t *>(str + i));
+    uint8x16_t hits =
+        vorrq_u8(vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)),
+                 vcltq_u8(chunk, control));
+    uint64x2_t wide = vreinterpretq_u64_u8(hits);
+    if ((vgetq_lane_u64(wide, 0) | vgetq_lane_u64(wide, 1)) != 0) {
+      break; // the loops below find exactly which byte it was
+    }
+  }
+#endif
+  constexpr std::uint64_t ones = 0x0101010101010101ULL;
+  constexpr std::uint64_t highs = 0x8080808080808080ULL;
+  for (; i + 8 <= length; i += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, str + i, sizeof(word));
+    std::uint64_t quotes = word ^ (ones * '"');
+    std::uint64_t slashes = word ^ (ones * '\\');
+    // the classic "has a zero byte" / "has a byte less than n" tricks
+    std::uint64_t hits = ((quotes - ones) & ~quotes) |
+                         ((slashes - ones) & ~slashes) |
+                         ((word - ones * 0x20) & ~word);
+    if ((hits & highs) != 0) {
+      break;
+    }
+  }
+  return i + findEscapeScalar(str + i, length - i);
+}
+
+/**
+ * @brief Writes JSON text into a fixed buffer, without allocating
+ *
+ * When the buffer fills up (or drain() is called) its contents are handed to
+ * the drain callback and the buffer is reused. This is what lets the JSON sink
+ * build a line piece by piece without ever making a std::string.
+ */
+class JsonWriter {
+public:
+  typedef void (*DrainFn)(void *context, const char *data, std::size_t length);
+
+private:
+  char *buffer;
+  std::size_t capacity;
+  std::size_t length = 0;
+  DrainFn drainFn;
+  void *context;
+
+  void reserve(std::size_t count) {
+    if (this->length + count > this->capacity) {
+      this->drain();
+    }
+  }
+
+public:
+  /**
+   * @param buffer memory to build output in, must outlive the writer
+   * @param capacity size of buffer in bytes, at least 64
+   * @param drainFn called with the buffered bytes whenever it fills up
+   * @param context passed straight through to drainFn
+   */
+  JsonWriter(char *buffer, std::size_t capacity, DrainFn drainFn,
+             void *context)
+      : buffer(buffer), capacity(capacity), drainFn(drainFn),
+        context(context) {}
+
+  /**
+   * @brief Hand everything buffered so far to the drain callback
+   */
+  void drain() {
+    if (this->length > 0) {
+      this->drainFn(this->context, this->buffer, this->length);
+      this->length = 0;
+    }
+  }
+
+  std::size_t buffered() { return this->length; }
+
+  void raw(char c) {
+    this->reserve(1);
+    this->buffer[this->length++] = c;
+  }
+
+  void raw(const char *data, std::size_t count) {
+    while (count > 0) {
+      this->reserve(1);
+      std::size_t room = this->capacity - this->length;
+      std::size_t chunk = count < room ? count : room;
+      std::memcpy(this->buffer + this->length, data, chunk);
+      this->length += chunk;
+      data += chunk;
+      count -= chunk;
+    }
+  }
+
+  /**
+   * @brief Write a quoted, escaped JSON string
+   *
+   * Runs of bytes that don't need escaping are copied in one go, findEscape()
+   * is what finds where each run ends.
+   */
+  void string(std::string_view str) {
+    static const char hex[] = "0123456789abcdef";
+    this->raw('"');
+    const char *data = str.data();
+    std::size_t remaining = str.size();
+    while (remaining > 0) {
+      std::size_t run = findEscape(data, remaining);
+      this->raw(data, run);
+      if (run == remaining) {
+        break;
+      }
+      unsigned char c = static_cast<unsigned char>(data[run]);
+      char escaped[6] = {'\\', 0, 0, 0, 0, 0};
+      std::size_t escapedLength = 2;
+      switch (c) {
+      case '"':
+        escaped[1] = '"';
+        break;
+      case '\\':
+        escaped[1] = '\\';
+        break;
+      case '\n':
+        escaped[1] = 'n';
+        break;
+      case '\r':
+        escaped[1] = 'r';
+        break;
+      case '\t':
+        escaped[1] = 't';
+        break;
+      default:
+        escaped[1] = 'u';
+        escaped[2] = '0';
+        escaped[3] = '0';
+        escaped[4] = hex[c >> 4];
+        escaped[5] = hex[c & 0xF];
+        escapedLength = 6;
+      }
+      this->raw(escaped, escapedLength);
+      data += run + 1;
+      remaining -= run + 1;
+    }
+    this->raw('"');
+  }
+
+  /**
+   * @brief Write an object key, including the colon
+   */
+  void key(std::string_view name) {
+    this->string(name);
+    this->raw(':');
+  }
+
+  void number(std::int64_t value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    this->raw(digits, result.ptr - digits);
+  }
+
+  /**
+   * @brief Write a double so it reads back as exactly the same value
+   *
+   * NaN and infinity aren't valid JSON, so they're written as null.
+   */
+  void number(double value) {
+    if (value != value || value - value != 0) {
+      this->raw("null", 4);
+      return;
+    }
+    char digits[32];
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    this->raw(digits, result.ptr - digits);
+#else
+    int count = std::snprintf(digits, sizeof(digits), "%.17g", value);
+    this->raw(digits, count);
+#endif
+  }
+
+  void boolean(bool value) {
+    if (value) {
+      this->raw("true", 4);
+    } else {
+      this->raw("false", 5);
+    }
+  }
+
+  void field(const Field &field) {
+    this->key(field.key);
+    switch (field.type) {
+    case Field::BOOL:
+      this->boolean(field.b);
+      break;
+    case Field::INT:
+      this->number(field.i);
+      break;
+    case Field::DOUBLE:
+      this->number(field.d);
+      break;
+    case Field::STRING:
+      this->string(field.s);
+      break;
+    default:
+      this->raw("null", 4);
+    }
+  }
+
+  /**
+   * @brief Write a whole log message as one line of JSON
+   *
+   * Output looks like
+   * {"t":1234,"level":"INFO","file":"main.cpp","line":12,"msg":"turn",
+   *  "fields":{"heading":90.5}}
+   * with "fields" only present for structured logs. Custom levels are written
+   * as their number.
+   */
+  void record(LogMessage &msg) {
+    this->raw("{\"t\":", 5);
+    this->number(static_cast<std::int64_t>(msg.getTime()));
+    this->raw(",\"level\":", 9);
+    const char *name = LogMessage::levelName(msg.getLevel());
+    if (name != nullptr) {
+      this->string(name);
+    } else {
+      this->number(static_cast<std::int64_t>(msg.getLevel()));
+    }
+    this->raw(",\"file\":", 8);
+    this->string(msg.getFileView());
+    this->raw(",\"line\":", 8);
+    this->number(static_cast<std::int64_t>(msg.getLineNumber()));
+    this->raw(",\"msg\":", 7);
+    this->string(msg.getMessageView());
+    const std::vector<Field> &fields = msg.getFields();
+    if (!fields.empty()) {
+      this->raw(",\"fields\":{", 11);
+      for (std::size_t i = 0; i < fields.size(); i++) {
+        if (i > 0) {
+          this->raw(',');
+        }
+        this->field(fields[i]);
+      }
+      this->raw('}');
+    }
+    this->raw("}\n", 2);
+  }
+};
+} // namespace JSON
+
+/**
+ * @brief Sink that writes every message as a line of JSON (JSON Lines)
+ *
+ * Meant for post-match analysis, every line is a standalone JSON object with
+ * the timestamp, level, file, line, message and any kv() fields, so scripts can
+ * read it with a JSON parser instead of picking apart the text format.
+ *
+ * @example ROBOTLOG::JsonLinesSink json("/usd/events.jsonl");
+ *          logger.addSink(&json);
+ */
+class JsonLinesSink : public FileSink {
+private:
+  char buffer[2048];
+  JSON::JsonWriter writer;
+
+  static void drainToFile(void *context, const char *data,
+                          std::size_t length) {
+    static_cast<JsonLinesSink *>(context)->writeBytes(data, length);
+  }
+
+public:
+  /**
+   * @brief Construct a new JsonLinesSink
+   *
+   * @param filePath the file to append JSON lines to
+   */
+  JsonLinesSink(std::string filePath)
+      : FileSink(filePath),
+        writer(buffer, sizeof(buffer), &drainToFile, this) {}
+
+  void write(LogMessage &msg) override { this->writer.record(msg); }
+
+  void flush() override {
+    this->writer.drain();
+    FileSink::flush();
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
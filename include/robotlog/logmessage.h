@@ -0,0 +1,305 @@
+#ifndef LOGMESSAGE_H
+#define LOGMESSAGE_H
+
+#include "colors.h"
+#include "field.h"
+#include <cstdint>
+#include <optional>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ROBOTLOG {
+enum Level {
+  DEBUG = 0,
+  debug = 0,
+  INFO = 1,
+  info = 1,
+  WARN = 2,
+  WARNING = 2,
+  warn = 2,
+  warning = 2,
+  ERR = 3,
+  ERROR = 3,
+  err = 3,
+  error = 3,
+
+  // data is used to override the string format, and instead writes the direct
+  // data,
+  DATA = 4,
+  data = 4,
+};
+
+struct LogMessage {
+  /*
+  A Message Can Include the following:
+
+  file the file where a log entry was passed from
+  func the function a log entry was passed from
+  line the line a log was called from
+  level the level a log was set to, debug, info, warning, error, data
+  message the message of a log (or the event name of a structured log)
+  time the pros::millis() timestamp the log was created at
+  fields typed key/value pairs of a structured log, see logger.kv()
+  */
+
+private:
+  std::optional<std::string> file;
+  std::optional<int> line;
+  std::optional<Level> level;
+  std::optional<std::string> message;
+  std::uint32_t time = 0;
+  std::uint32_t queuedUs = 0; // pros::micros() when it was queued, for stats
+  std::vector<Field> fields;
+
+public:
+  LogMessage(Level level, std::string message, std::string file, int line,
+             std::uint32_t time = 0) {
+    this->level = std::make_optional(level);
+    this->message = std::make_optional(message);
+    this->file = std::make_optional(file);
+    this->line = std::make_optional(line);
+    this->time = time;
+  }
+
+  LogMessage(Level level, std::string message, std::string file, int line,
+             std::uint32_t time, std::vector<Field> fields)
+      : LogMessage(level, message, file, line, time) {
+    this->fields = std::move(fields);
+  }
+
+  std::string getFile() { return this->file.value_or(""); }
+  std::string getLine() {
+    std::ostringstream oss;
+    oss << this->line.value_or(-1);
+    return oss.str();
+  }
+  Level getLevel() { return this->level.value_or(ROBOTLOG::Level::INFO); }
+  std::string getMessage() { return this->message.value_or(""); }
+  std::uint32_t getTime() { return this->time; }
+  int getLineNumber() { return this->line.value_or(-1); }
+  std::uint32_t getQueuedUs() { return this->queuedUs; }
+  void setQueuedUs(std::uint32_t us) { this->queuedUs = us; }
+  const std::vector<Field> &getFields() { return this->fields; }
+  void addField(Field field) { this->fields.push_back(std::move(field)); }
+
+  // Views into the stored strings, for sinks that serialize a message without
+  // wanting to copy it first. Only valid while the LogMessage is alive.
+  std::string_view getFileView() {
+    return this->file ? std::string_view(*this->file) : std::string_view();
+  }
+  std::string_view getMessageView() {
+    return this->message ? std::string_view(*this->message)
+                         : std::string_view();
+  }
+
+  /**
+   * @brief Get the fields of a structured log as text
+   *
+   * Renders each field as " key=value", which is what gets appended to the
+   * message in the text format. Returns an empty string for normal logs.
+   */
+  std::string getFieldsAsString() {
+    std::ostringstream oss;
+    for (const Field &field : this->fields) {
+      oss << " " << field.key << "=";
+      switch (field.type) {
+      case Field::BOOL:
+        oss << (field.b ? "true" : "false");
+        break;
+      case Field::INT:
+        oss << field.i;
+        break;
+      case Field::DOUBLE:
+        oss << field.d;
+        break;
+      case Field::STRING:
+        oss << field.s;
+        break;
+      default:
+        break;
+      }
+    }
+    return oss.str();
+  }
+
+  /**
+   * @brief Get the plain name of a level
+   *
+   * Unlike getLevelAsString() this returns a string literal, so nothing gets
+   * allocated. Custom levels return nullptr.
+   */
+  static const char *levelName(Level level) {
+    switch (level) {
+    case DEBUG:
+      return "DEBUG";
+    case INFO:
+      return "INFO";
+    case WARN:
+      return "WARN";
+    case ERR:
+      return "ERR";
+    case DATA:
+      return "DATA";
+    default:
+      return nullptr;
+    }
+  }
+  std::string getLevelAsString() {
+    switch (this->level.value()) {
+    case DEBUG:
+      return "DEBUG";
+    case INFO:
+      return "INFO";
+    case WARN:
+      return "WARN";
+    case ERR:
+      return "ERR";
+    case DATA:
+      return "";
+    default:
+      return std::to_string(this->level.value());
+    }
+
+    return "";
+  }
+
+  std::string getLevelAsStringBrackets() {
+    switch (this->level.value()) {
+    case DEBUG:
+      return "[DEBUG]";
+    case INFO:
+      return "[INFO]";
+    case WARN:
+      return "[WARN]";
+    case ERR:
+      return "[ERR]";
+    case DATA:
+      return "";
+    default:
+      return "";
+    }
+    return "[" + std::to_string(this->level.value()) + "]";
+  }
+
+  std::string getLevelAsStringWithColors(
+      std::string COLOR_ERR = ROBOTLOG::Colors::RED,
+      std::string COLOR_WARN = ROBOTLOG::Colors::YELLOW,
+      std::string COLOR_INFO = ROBOTLOG::Colors::GREEN,
+      std::string COLOR_DEBUG = ROBOTLOG::Colors::MAGENTA) {
+    switch (this->level.value()) {
+    case DEBUG:
+      return COLOR_DEBUG + "DEBUG" + Colors::RESET;
+      break;
+    case INFO:
+      return COLOR_INFO + "INFO" + Colors::RESET;
+      break;
+    case WARN:
+      return COLOR_WARN + "WARN" + Colors::RESET;
+      break;
+    case ERR:
+      return COLOR_ERR + "ERR" + Colors::RESET;
+      break;
+    case DATA:
+      return "";
+      break;
+    default:
+      return Colors::WHITE + "[" + std::to_string(this->level.value()) + "]" +
+             Colors::RESET;
+    }
+    return "";
+  }
+
+  std::string
+  getLevelAsStringFull(std::string COLOR_ERR = ROBOTLOG::Colors::RED,
+                       std::string COLOR_WARN = ROBOTLOG::Colors::YELLOW,
+                       std::string COLOR_INFO = ROBOTLOG::Colors::HI_GREEN,
+                       std::string COLOR_DEBUG = ROBOTLOG::Colors::MAGENTA) {
+    switch (this->level.value()) {
+    case DEBUG:
+      return COLOR_DEBUG + "[DEBUG]" + Colors::RESET;
+      break;
+    case INFO:
+      return COLOR_INFO + "[INFO]" + Colors::RESET;
+      break;
+    case WARN:
+      return COLOR_WARN + "[WARN]" + Colors::RESET;
+      break;
+    case ERR:
+      return COLOR_ERR + "[ERR]" + Colors::RESET;
+      break;
+    case DATA:
+      return "";
+      break;
+    default:
+      return Colors::WHITE + "[" + std::to_string(this->level.value()) + "]" +
+             Colors::RESET;
+    }
+
+    return "";
+  }
+
+  std::string format(std::string formatString,
+                     std::string COLOR_ERR = ROBOTLOG::Colors::RED,
+                     std::string COLOR_WARN = ROBOTLOG::Colors::YELLOW,
+                     std::string COLOR_INFO = ROBOTLOG::Colors::WHITE,
+                     std::string COLOR_DEBUG = ROBOTLOG::Colors::MAGENTA) {
+    /*
+    ! Characteristics of a Format String
+    * <LEVEL> - Log Level
+    ? <FILE> - File the logger was (Called From or Made In, Haven't Decided Yet)
+    TODO: Decide <FILE> Characteristics
+
+    * <FUNC> - Function .log was called from
+    ? <LINE> - Line .log was called from
+    * <MESSAGE> - Message to Include with Log
+    * <TIME> - pros::millis() when it was logged, put it first so
+    vexlog-merge can line files up by it
+
+    ! COLORS
+    ! Colors can be set for the LEVEL with the following
+    ? <LEVEL> - No Color
+    ? <CLEVEL> - Colorizes only the level text, doesn't add []
+    ? <BLEVEL> - Adds Brackets, doesn't add color
+    ? <CBLEVEL> - Colorizes both level text, and adds brackets which are colored
+    the same way
+    */
+    if (this->getLevel() == data ||
+        this->getLevel() == DATA) { // If it's a DATA log, you don't want any
+                                    // extra formatting to parse.
+      return this->getMessage() + this->getFieldsAsString();
+    }
+
+    formatString =
+        std::regex_replace(formatString, std::regex("<LEVEL>"), // Level Only
+                           this->getLevelAsString());
+    formatString = std::regex_replace(
+        formatString, std::regex("<BLEVEL>"), // Brackets no Color
+        this->getLevelAsStringBrackets());
+    formatString = std::regex_replace(
+        formatString, std::regex("<CLEVEL>"), // Color and Level
+        this->getLevelAsStringWithColors(COLOR_ERR, COLOR_WARN, COLOR_INFO,
+                                         COLOR_DEBUG));
+    formatString = std::regex_replace(
+        formatString, std::regex("<CBLEVEL>"), // Color and Brackets
+        this->getLevelAsStringFull(COLOR_ERR, COLOR_WARN, COLOR_INFO,
+                                   COLOR_DEBUG));
+
+    formatString = std::regex_replace(formatString, std::regex("<FILE>"),
+                                      this->getFile()); // File
+    formatString = std::regex_replace(formatString, std::regex("<LINE>"),
+                                      this->getLine()); // Line
+    formatString = std::regex_replace(formatString, std::regex("<TIME>"),
+                                      std::to_string(this->time)); // Time
+    formatString =
+        std::regex_replace(formatString, std::regex("<MESSAGE>"), // Message
+                           this->getMessage() + this->getFieldsAsString());
+
+    return formatString;
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef LOGPARSE_H
+#define LOGPARSE_H
+
+#include "frame.h"
+#include "logmessage.h"
+#include "rotation.h"
+#include "session.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ROBOTLOG {
+namespace LogParse {
+/*
+! Reading logs back, for host tools
+* What vexlog-query and vexlog-merge both need to turn the logger's output
+* back into records: text lines in the default format, the fixed layout of
+* JsonLinesSink's lines, and which parts of a text log are in which format.
+* Kept in one place so every tool reads the same line the same way.
+*/
+constexpr int NO_LEVEL = -1; // a level name nothing knows
+
+/**
+ * @brief What a line says about itself, views into the line
+ */
+struct Record {
+  int level = NO_LEVEL;
+  std::string_view levelText;
+  std::string_view file;
+  int line = 0;
+  std::string_view message;
+  std::optional<std::uint32_t> time;
+};
+
+/**
+ * @brief DEBUG, INFO, WARN, ERR, DATA or a custom level's number, NO_LEVEL
+ * for anything else
+ */
+inline int parseLevel(std::string_view name) {
+  if (name == "DEBUG") {
+    return DEBUG;
+  } else if (name == "INFO") {
+    return INFO;
+  } else if (name == "WARN") {
+    return WARN;
+  } else if (name == "ERR") {
+    return ERR;
+  } else if (name == "DATA") {
+    return DATA;
+  }
+  int level = 0;
+  for (char c : name) {
+    if (c < '0' || c > '9') {
+      return NO_LEVEL;
+    }
+    level = level * 10 + (c - '0');
+  }
+  return name.empty() ? NO_LEVEL : level;
+}
+
+/**
+ * @brief The integer at i, leaving i just past it
+ */
+inline std::int64_t parseNumber(std::string_view text, std::size_t &i) {
+  bool negative = i < text.size() && text[i] == '-';
+  i += negative;
+  std::int64_t value = 0;
+  while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+    value = value * 10 + (text[i++] - '0');
+  }
+  return negative ? -value : value;
+}
+
+/**
+ * @brief Past any color codes at i, the logger puts them around levels
+ */
+inline std::size_t skipColors(std::string_view text, std::size_t i) {
+  while (i + 1 < text.size() && text[i] == '\033' && text[i + 1] == '[') {
+    i += 2;
+    while (i < text.size() && (text[i] < 0x40 || text[i] > 0x7E)) {
+      i++;
+    }
+    i++;
+  }
+  return std::min(i, text.size());
+}
+
+inline bool startsWith(std::string_view text, std::size_t i,
+                       std::string_view prefix) {
+  return i <= text.size() && text.substr(i).starts_with(prefix);
+}
+
+/**
+ * @brief "12345 " at the start of a line, what <TIME> first in the format
+ * writes, taken off the front of text
+ */
+inline std::optional<std::uint32_t> leadingTime(std::string_view &text) {
+  std::size_t i = 0;
+  while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+    i++;
+  }
+  if (i == 0 || i > 10 || i >= text.size() || text[i] != ' ') {
+    return std::nullopt;
+  }
+  std::size_t at = 0;
+  std::uint32_t time = static_cast<std::uint32_t>(parseNumber(text, at));
+  text.remove_prefix(i + 1);
+  return time;
+}
+
+/**
+ * @brief "[LEVEL] file:line - message", the default format without the time,
+ * with or without colors
+ *
+ * DATA lines are written without any of that, so anything else is taken to
+ * be one, with the whole text as the message.
+ */
+inline Record parseTextBody(std::string_view text) {
+  Record record;
+  record.level = DATA;
+  record.message = text;
+  std::size_t i = skipColors(text, 0);
+  if (i >= text.size() || text[i] != '[') {
+    return record;
+  }
+  std::size_t close = text.find(']', i);
+  if (close == std::string_view::npos) {
+    return record;
+  }
+  record.levelText = text.substr(i + 1, close - i - 1);
+  record.level = parseLevel(record.levelText);
+  i = skipColors(text, close + 1);
+  i += i < text.size() && text[i] == ' ';
+  std::size_t dash = text.find(" - ", i);
+  std::size_t colon = text.rfind(':', dash);
+  if (dash == std::string_view::npos || colon == std::string_view::npos ||
+      colon < i) {
+    record.message = text.substr(i);
+    return record;
+  }
+  record.file = text.substr(i, colon - i);
+  i = colon + 1;
+  record.line = static_cast<int>(parseNumber(text, i));
+  record.message = text.substr(dash + 3);
+  return record;
+}
+
+/**
+ * @brief A whole text line, with the time in front if the format starts
+ * with <TIME>
+ */
+inline Record parseText(std::string_view text) {
+  std::string_view rest = text;
+  std::optional<std::uint32_t> time = leadingTime(rest);
+  Record record = parseTextBody(rest);
+  record.time = time;
+  if (record.levelText.empty() && record.level == DATA) {
+    record.message = text; // a DATA line keeps all of itself
+  }
+  return record;
+}
+
+/**
+ * @brief The string value starting at i (on its opening quote), still
+ * escaped, leaving i past its closing quote
+ */
+inline std::string_view jsonString(std::string_view text, std::size_t &i) {
+  std::size_t start = ++i;
+  while (i < text.size() && text[i] != '"') {
+    i += text[i] == '\\' ? 2 : 1;
+  }
+  std::size_t end = std::min(i, text.size());
+  i++;
+  return text.substr(start, end - start);
+}
+
+/**
+ * @brief Undo the escapes JsonWriter puts in a string
+ */
+inline void unescapeJson(std::string_view raw, std::string &out) {
+  out.clear();
+  for (std::size_t j = 0; j < raw.size(); j++) {
+    char c = raw[j];
+    if (c == '\\' && j + 1 < raw.size()) {
+      c = raw[++j];
+      c = c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' : c;
+    }
+    out.push_back(c);
+  }
+}
+
+inline std::string unescapeJson(std::string_view raw) {
+  std::string out;
+  unescapeJson(raw, out);
+  return out;
+}
+
+inline std::string baseName(const std::string &path) {
+  std::size_t slash = path.find_last_of('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+inline bool isFrameHeader(const char *data, std::uint64_t size) {
+  if (size < Frame::HEADER_SIZE) {
+    return false;
+  }
+  const std::uint8_t *bytes = reinterpret_cast<const std::uint8_t *>(data);
+  return bytes[0] == 'V' && bytes[1] == 'F' &&
+         Frame::crc32(bytes, 20) == Frame::get32(bytes + 20);
+}
+
+/**
+ * @brief A stretch of a text log in one format
+ */
+struct Region {
+  std::uint64_t start = 0;
+  std::uint64_t end = 0;
+  bool framed = false;
+  bool dictionary = false;
+};
+
+/**
+ * @brief The formats of a text log's parts, from its session index if it has
+ * one
+ *
+ * @param path the log's path, the .idx is looked for next to it
+ * @param data the whole log
+ * @param size its size
+ */
+inline std::vector<Region> textRegions(const std::string &path,
+                                       const char *data, std::uint64_t size) {
+  std::vector<Region> regions;
+  std::string indexPath = path.substr(0, extensionStart(path)) + ".idx";
+  for (const SessionEntry &entry : SessionIndex(indexPath).load()) {
+    if (baseName(entry.file) != baseName(path) || entry.offset >= size ||
+        (!regions.empty() && entry.offset < regions.back().start)) {
+      continue;
+    }
+    if (!regions.empty()) {
+      regions.back().end = entry.offset;
+    }
+    regions.push_back({entry.offset, size, entry.framed, entry.dictionary});
+  }
+  if (regions.empty() || regions.front().start > 0) {
+    // nothing says what this is, so go by how it starts
+    std::uint64_t end = regions.empty() ? size : regions.front().start;
+    const char *start = data;
+    if (size > SESSION_PREFIX.size() &&
+        std::string_view(data, SESSION_PREFIX.size()) == SESSION_PREFIX) {
+      const char *newline =
+          static_cast<const char *>(std::memchr(data, '\n', end));
+      start = newline != nullptr ? newline + 1 : start;
+    }
+    bool framed = isFrameHeader(start, data + end - start);
+    regions.insert(regions.begin(), {0, end, framed, true});
+  }
+  return regions;
+}
+} // namespace LogParse
+} // namespace ROBOTLOG
+
+#endif
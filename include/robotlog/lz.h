@@ -0,0 +1,231 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ROBOTLOG {
+namespace LZ {
+/*
+! Block compression
+* Blocks are compressed on their own (nothing is shared between blocks), so a
+* block can always be decoded without the ones before it. The compressed data
+* uses the same sequences as an LZ4 block:
+?   token(1)              high 4 bits literal count, low 4 bits match length-4
+?   [255...] literals     counts of 15 continue in extra bytes, until one < 255
+?   offset(2)             how far back the match starts, little endian
+?   [255...]              extra match length bytes, same as for literals
+* The last sequence is only literals. Following LZ4's rules, the last 5 bytes
+* are always literals and no match starts in the last 12, so a standard LZ4
+* decoder can read these blocks too.
+*
+* The blocks are written to files as frames, see frame.h.
+*/
+constexpr std::size_t BLOCK_SIZE = 4096;
+constexpr std::size_t MIN_MATCH = 4;
+constexpr std::size_t LAST_LITERALS = 5;
+constexpr std::size_t MATCH_LIMIT = 12;
+constexpr std::size_t ERROR = ~static_cast<std::size_t>(0);
+
+inline std::uint32_t read32(const std::uint8_t *in) {
+  std::uint32_t value;
+  std::memcpy(&value, in, sizeof(value));
+  return value;
+}
+
+/**
+ * @brief Compresses blocks of up to BLOCK_SIZE bytes, in fixed memory
+ *
+ * The only state is the hash table of recent positions (8 KB), so keep one
+ * around instead of making one per block.
+ */
+class Compressor {
+private:
+  static constexpr int HASH_BITS = 12;
+  std::uint16_t table[1 << HASH_BITS];
+
+  static std::uint32_t hash(std::uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+  }
+
+  // a literal or match length past the 4 bits in the token
+  static bool length(std::uint8_t *&op, std::uint8_t *end, std::size_t value) {
+    while (value >= 255) {
+      if (op >= end) {
+        return false;
+      }
+      *op++ = 255;
+      value -= 255;
+    }
+    if (op >= end) {
+      return false;
+    }
+    *op++ = static_cast<std::uint8_t>(value);
+    return true;
+  }
+
+  static bool sequence(std::uint8_t *&op, std::uint8_t *end,
+                       const std::uint8_t *literals, std::size_t literalCount,
+                       std::size_t offset, std::size_t matchLength) {
+    if (op >= end) {
+      return false;
+    }
+    std::uint8_t *token = op++;
+    *token = static_cast<std::uint8_t>(
+        (literalCount < 15 ? literalCount : 15) << 4);
+    if (literalCount >= 15 && !length(op, end, literalCount - 15)) {
+      return false;
+    }
+    if (static_cast<std::size_t>(end - op) < literalCount) {
+      return false;
+    }
+    std::memcpy(op, literals, literalCount);
+    op += literalCount;
+    if (offset == 0) {
+      return true; // the last sequence has no match
+    }
+    if (end - op < 2) {
+      return false;
+    }
+    *op++ = static_cast<std::uint8_t>(offset);
+    *op++ = static_cast<std::uint8_t>(offset >> 8);
+    std::size_t extra = matchLength - MIN_MATCH;
+    *token |= extra < 15 ? extra : 15;
+    return extra < 15 || length(op, end, extra - 15);
+  }
+
+public:
+  /**
+   * @brief Compress one block
+   *
+   * @param in the block, at most BLOCK_SIZE bytes
+   * @param size size of the block
+   * @param out where to put the compressed bytes
+   * @param capacity room in out
+   * @return the compressed size, or 0 if it didn't fit in capacity
+   */
+  std::size_t compress(const std::uint8_t *in, std::size_t size,
+                       std::uint8_t *out, std::size_t capacity) {
+    std::uint8_t *op = out;
+    std::uint8_t *end = out + capacity;
+    std::size_t anchor = 0;
+    if (size > MATCH_LIMIT) {
+      std::memset(this->table, 0, sizeof(this->table));
+      std::size_t limit = size - MATCH_LIMIT;
+      std::size_t matchEnd = size - LAST_LITERALS;
+      std::size_t ip = 1;
+      while (ip < limit) {
+        std::uint32_t current = read32(in + ip);
+        std::uint32_t h = hash(current);
+        std::size_t ref = this->table[h];
+        this->table[h] = static_cast<std::uint16_t>(ip);
+        if (read32(in + ref) != current) {
+          // skip ahead faster the longer nothing has matched
+          ip += 1 + ((ip - anchor) >> 6);
+          continue;
+        }
+        std::size_t matchLength = MIN_MATCH;
+        while (ip + matchLength < matchEnd &&
+               in[ref + matchLength] == in[ip + matchLength]) {
+          matchLength++;
+        }
+        // grow the match backwards into the literals
+        while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1]) {
+          ip--;
+          ref--;
+          matchLength++;
+        }
+        if (!sequence(op, end, in + anchor, ip - anchor, ip - ref,
+                      matchLength)) {
+          return 0;
+        }
+        ip += matchLength;
+        anchor = ip;
+        if (ip - 2 < limit) {
+          this->table[hash(read32(in + ip - 2))] =
+              static_cast<std::uint16_t>(ip - 2);
+        }
+      }
+    }
+    if (!sequence(op, end, in + anchor, size - anchor, 0, 0)) {
+      return 0;
+    }
+    return op - out;
+  }
+};
+
+/**
+ * @brief Decompress one block
+ *
+ * Checks every length against both buffers, so corrupt data can't read or
+ * write out of bounds.
+ *
+ * @param in the compressed block
+ * @param size size of the compressed block
+ * @param out where to put the decompressed bytes
+ * @param capacity room in out
+ * @return the decompressed size, or ERROR if the block is corrupt
+ */
+inline std::size_t decompress(const std::uint8_t *in, std::size_t size,
+                              std::uint8_t *out, std::size_t capacity) {
+  const std::uint8_t *ip = in;
+  const std::uint8_t *inEnd = in + size;
+  std::size_t written = 0;
+  auto extra = [&](std::size_t &value) {
+    std::uint8_t byte;
+    do {
+      if (ip >= inEnd) {
+        return false;
+      }
+      byte = *ip++;
+      value += byte;
+    } while (byte == 255);
+    return true;
+  };
+  while (ip < inEnd) {
+    std::uint8_t token = *ip++;
+    std::size_t literals = token >> 4;
+    if (literals == 15 && !extra(literals)) {
+      return ERROR;
+    }
+    if (literals > static_cast<std::size_t>(inEnd - ip) ||
+        literals > capacity - written) {
+      return ERROR;
+    }
+    std::memcpy(out + written, ip, literals);
+    ip += literals;
+    written += literals;
+    if (ip == inEnd) {
+      return written; // the last sequence
+    }
+    if (inEnd - ip < 2) {
+      return ERROR;
+    }
+    std::size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    std::size_t matchLength = token & 15;
+    if (matchLength == 15 && !extra(matchLength)) {
+      return ERROR;
+    }
+    matchLength += MIN_MATCH;
+    if (offset == 0 || offset > written || matchLength > capacity - written) {
+      return ERROR;
+    }
+    if (offset >= matchLength) {
+      std::memcpy(out + written, out + written - offset, matchLength);
+    } else {
+      // byte by byte, the match overlaps what it's copying
+      for (std::size_t i = 0; i < matchLength; i++) {
+        out[written + i] = out[written - offset + i];
+      }
+    }
+    written += matchLength;
+  }
+  return written;
+}
+
+} // namespace LZ
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef MEMORYSINK_H
+#define MEMORYSINK_H
+
+#include "cbor.h"
+#include "logmessage.h"
+#include "sink.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ROBOTLOG {
+/**
+ * @brief Sink that keeps records in memory, for code to read back
+ *
+ * For tests on a computer (write messages, then check what came out), and for
+ * showing things on the robot, like the last error on an auton selector.
+ * Records go into a fixed size ring as formatted text lines (without the
+ * newline) or as standalone CBOR records a CBOR::Reader can read one at a
+ * time.
+ *
+ * The logger's task is the only writer and one other task can read, without
+ * either of them ever locking. Reading hands out string_views straight into
+ * the ring, which stay valid until the callback returns. The writer never
+ * overwrites a record that hasn't been drained, so when the ring is full new
+ * records are dropped (and counted) until the reader makes room.
+ *
+ * @example ROBOTLOG::MemorySink recent(8192);
+ *          logger.addSink(&recent);
+ *          // later, on any one task
+ *          recent.drain([](std::string_view line) { ... });
+ */
+class MemorySink : public Sink {
+public:
+  enum Format { TEXT, BINARY };
+  static constexpr std::size_t RECORD_CAPACITY = 1024; // binary records
+
+private:
+  static constexpr std::uint32_t WRAP = 0xFFFFFFFF; // the rest is unused
+  static constexpr std::size_t HEADER = 4;          // each record's length
+
+  std::vector<std::uint8_t> ring;
+  std::atomic<std::size_t> head = 0; // where the writer goes next
+  std::atomic<std::size_t> tail = 0; // the oldest record not drained
+  std::atomic<std::size_t> written = 0;
+  std::atomic<std::size_t> dropped = 0;
+  Format format;
+  std::string formatString;
+  char record[RECORD_CAPACITY];
+  CBOR::Writer writer;
+  std::size_t recordLength = 0;
+  bool tooLong = false;
+
+  static std::size_t padded(std::size_t size) {
+    return (HEADER + size + 3) & ~static_cast<std::size_t>(3);
+  }
+
+  // called once with the whole record, a second time means it didn't fit
+  static void drained(void *context, const char *, std::size_t length) {
+    MemorySink *sink = static_cast<MemorySink *>(context);
+    if (sink->recordLength > 0) {
+      sink->tooLong = true;
+    }
+    sink->recordLength = length;
+  }
+
+  void push(const void *data, std::size_t size) {
+    std::size_t need = padded(size);
+    std::size_t capacity = this->ring.size();
+    std::size_t at = this->head.load(std::memory_order_relaxed);
+    std::size_t oldest = this->tail.load(std::memory_order_acquire);
+    std::size_t next;
+    // head never catches up to tail, equal means empty
+    if (at >= oldest) {
+      if (capacity - at >= need + (oldest == 0 ? 4 : 0)) {
+        next = at + need;
+      } else if (oldest > need) {
+        std::uint32_t wrap = WRAP;
+        std::memcpy(this->ring.data() + at, &wrap, HEADER);
+        at = 0;
+        next = need;
+      } else {
+        this->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    } else if (oldest - at > need) {
+      next = at + need;
+    } else {
+      this->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    std::uint32_t length = static_cast<std::uint32_t>(size);
+    std::memcpy(this->ring.data() + at, &length, HEADER);
+    std::memcpy(this->ring.data() + at + HEADER, data, size);
+    this->head.store(next == capacity ? 0 : next, std::memory_order_release);
+    this->written.fetch_add(1, std::memory_order_relaxed);
+    this->addBytes(size);
+  }
+
+  template <typename F> std::size_t read(F &f, bool consume) {
+    std::size_t capacity = this->ring.size();
+    std::size_t at = this->tail.load(std::memory_order_relaxed);
+    std::size_t end = this->head.load(std::memory_order_acquire);
+    std::size_t count = 0;
+    while (at != end) {
+      std::uint32_t length;
+      std::memcpy(&length, this->ring.data() + at, HEADER);
+      if (length == WRAP) {
+        at = 0;
+        continue;
+      }
+      f(std::string_view(
+          reinterpret_cast<const char *>(this->ring.data() + at + HEADER),
+          length));
+      count++;
+      at += padded(length);
+      at = at == capacity ? 0 : at;
+      if (consume) {
+        this->tail.store(at, std::memory_order_release);
+      }
+    }
+    return count;
+  }
+
+public:
+  /**
+   * @param capacity bytes of records to keep, each takes 4 more plus up to 3
+   * of padding
+   * @param format TEXT for formatted lines, BINARY for CBOR records
+   * @param formatString how TEXT lines are formatted, like the logger's
+   */
+  explicit MemorySink(
+      std::size_t capacity = 16384, Format format = TEXT,
+      std::string formatString = "<TIME> <BLEVEL> <FILE>:<LINE> - <MESSAGE>")
+      : ring((capacity + 3) & ~static_cast<std::size_t>(3)), format(format),
+        formatString(std::move(formatString)),
+        writer(record, sizeof(record), &drained, this) {}
+  MemorySink(const MemorySink &) = delete;
+  MemorySink &operator=(const MemorySink &) = delete;
+
+  void write(LogMessage &msg) override {
+    if (this->format == TEXT) {
+      std::string line = msg.format(this->formatString);
+      this->push(line.data(), line.size());
+      return;
+    }
+    this->recordLength = 0;
+    this->tooLong = false;
+    this->writer.record(msg);
+    this->writer.drain();
+    if (this->tooLong) {
+      this->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    this->push(this->record, this->recordLength);
+  }
+
+  /**
+   * @brief Look at every record in the ring, oldest first, and leave them
+   * there
+   *
+   * @param f called as f(std::string_view record)
+   * @return how many records there were
+   */
+  template <typename F> std::size_t snapshot(F f) {
+    return this->read(f, false);
+  }
+
+  /**
+   * @brief Take every record out of the ring, oldest first
+   *
+   * Each one's space is given back as soon as f returns.
+   *
+   * @param f called as f(std::string_view record)
+   * @return how many records there were
+   */
+  template <typename F> std::size_t drain(F f) { return this->read(f, true); }
+
+  /**
+   * @brief Throw away everything in the ring
+   */
+  void clear() {
+    this->drain([](std::string_view) {});
+  }
+
+  /**
+   * @brief How many records went into the ring
+   */
+  std::size_t getWritten() {
+    return this->written.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief How many records didn't fit, because the ring was full or a
+   * binary record was over RECORD_CAPACITY bytes
+   */
+  std::size_t getDropped() {
+    return this->dropped.load(std::memory_order_relaxed);
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
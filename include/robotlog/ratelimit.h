@@ -0,0 +1,131 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include "telemetry.h"
+#include <chrono>
+#include <cstdint>
+
+namespace ROBOTLOG {
+/**
+ * @brief Decides whether one call site gets to log this time
+ *
+ * The rlog_every(), rlog_first_n() and rlog_limit() macros keep one of these
+ * in a static at the call site, and check it before the message is even
+ * built, so a log in a 10 ms loop that's being held back costs a clock read
+ * and a compare. Whatever was held back is counted, and reported on the next
+ * message that gets through.
+ *
+ * A call site reached from several tasks at once isn't locked, at worst an
+ * extra message gets through.
+ */
+class RateLimit {
+private:
+  enum Kind { EVERY, FIRST_N, BUCKET };
+  static constexpr std::uint64_t TOKEN = 1000000; // in millionths of one
+
+  Kind kind;
+  std::uint64_t periodUs = 0;
+  std::uint32_t limit = 0;     // first_n's n, or the bucket's size
+  std::uint32_t perSecond = 0; // the bucket's refill
+  std::uint64_t tokens = 0;
+  std::uint64_t lastUs = 0;
+  bool started = false;
+  std::uint32_t count = 0;
+  std::uint32_t suppressed = 0;
+
+  explicit RateLimit(Kind kind) : kind(kind) {}
+
+public:
+  /**
+   * @brief At most one message per period
+   */
+  static RateLimit every(Rate rate) {
+    RateLimit limit(EVERY);
+    limit.periodUs = rate.periodUs;
+    return limit;
+  }
+
+  template <typename Rep, typename Period>
+  static RateLimit every(std::chrono::duration<Rep, Period> period) {
+    return every(Rate{static_cast<std::uint32_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(period)
+            .count())});
+  }
+
+  /**
+   * @brief Only the first n messages, ever
+   */
+  static RateLimit firstN(std::uint32_t n) {
+    RateLimit limit(FIRST_N);
+    limit.limit = n;
+    return limit;
+  }
+
+  /**
+   * @brief A token bucket: bursts of up to burst messages, and perSecond on
+   * average after that
+   */
+  static RateLimit bucket(std::uint32_t perSecond, std::uint32_t burst) {
+    RateLimit limit(BUCKET);
+    limit.perSecond = perSecond;
+    limit.limit = burst;
+    limit.tokens = static_cast<std::uint64_t>(burst) * TOKEN;
+    return limit;
+  }
+
+  /**
+   * @brief Whether a message can go through now
+   *
+   * @param nowUs the current pros::micros()
+   * @param held set to how many were held back since the last one that went
+   * through, if this one does
+   */
+  bool allow(std::uint64_t nowUs, std::uint32_t &held) {
+    bool ok = false;
+    switch (this->kind) {
+    case EVERY:
+      ok = !this->started || nowUs - this->lastUs >= this->periodUs;
+      if (ok) {
+        this->lastUs = nowUs;
+      }
+      break;
+    case FIRST_N:
+      ok = this->count < this->limit;
+      if (ok) {
+        this->count++;
+      }
+      break;
+    case BUCKET: {
+      if (this->started) {
+        std::uint64_t full = static_cast<std::uint64_t>(this->limit) * TOKEN;
+        std::uint64_t refill = (nowUs - this->lastUs) * this->perSecond;
+        this->tokens =
+            full - this->tokens < refill ? full : this->tokens + refill;
+      }
+      this->lastUs = nowUs;
+      ok = this->tokens >= TOKEN;
+      if (ok) {
+        this->tokens -= TOKEN;
+      }
+      break;
+    }
+    }
+    this->started = true;
+    if (!ok) {
+      this->suppressed++;
+      return false;
+    }
+    held = this->suppressed;
+    this->suppressed = 0;
+    return true;
+  }
+
+  /**
+   * @brief Count a message something else threw away before allow() saw it,
+   * so the next one that goes through reports it too
+   */
+  void hold() { this->suppressed++; }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef RECORDFRAMER_H
+#define RECORDFRAMER_H
+
+#include "cbor.h"
+#include "cobs.h"
+#include "logmessage.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace ROBOTLOG {
+/**
+ * @brief Turns messages into COBS frames of standalone CBOR records
+ *
+ * What SerialSink sends, and what the console sends with
+ * logger.setConsoleFraming(true). There's no string table, so a receiver can
+ * start reading at any frame. A record's first byte is always a CBOR array
+ * head (0x85 or 0x86), so no frame is ever plain ASCII text, which is how a
+ * receiver tells frames apart from other prints on the same stream.
+ */
+class RecordFramer {
+public:
+  static constexpr std::size_t RECORD_CAPACITY = 1024;
+  static constexpr std::size_t MAX_FRAME = COBS::maxFrameSize(RECORD_CAPACITY);
+
+private:
+  char record[RECORD_CAPACITY];
+  CBOR::Writer writer;
+  std::size_t recordLength = 0;
+  bool tooLong = false;
+
+  // called once with the whole record, a second time means it didn't fit
+  static void drained(void *context, const char *, std::size_t length) {
+    RecordFramer *framer = static_cast<RecordFramer *>(context);
+    if (framer->recordLength > 0) {
+      framer->tooLong = true;
+    }
+    framer->recordLength = length;
+  }
+
+public:
+  RecordFramer() : writer(record, sizeof(record), &drained, this) {}
+  RecordFramer(const RecordFramer &) = delete;
+  RecordFramer &operator=(const RecordFramer &) = delete;
+
+  /**
+   * @brief Frame one message
+   *
+   * @param out where the frame goes, delimiter included
+   * @param room how many bytes out has, MAX_FRAME is always enough
+   * @return the frame's length, or 0 if the record is over RECORD_CAPACITY
+   * bytes or the frame might not fit in room
+   */
+  std::size_t frame(LogMessage &msg, std::uint8_t *out, std::size_t room) {
+    this->recordLength = 0;
+    this->tooLong = false;
+    this->writer.record(msg);
+    this->writer.drain();
+    if (this->tooLong || COBS::maxFrameSize(this->recordLength) > room) {
+      return 0;
+    }
+    return COBS::frame(this->record, this->recordLength, out);
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef REPEATFILTER_H
+#define REPEATFILTER_H
+
+#include "field.h"
+#include "logmessage.h"
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+namespace ROBOTLOG {
+/**
+ * @brief Where the logger collapses repeated messages, see
+ * logger.setCollapseRepeats()
+ */
+enum class RepeatMode {
+  OFF,
+  WORKER,   // on the logger's task, repeats still go through the queue
+  PRODUCER, // on the task that logs, repeats never get queued
+};
+
+/**
+ * @brief Collapses a run of identical messages into the first one plus a count
+ *
+ * A sensor that unplugs mid match can log the same warning every loop, which
+ * is thousands of lines saying one thing. This lets the first one through,
+ * counts the ones after it that are identical (same level, call site,
+ * message and fields), and when something else comes along writes one more
+ * record for the run: the same message with a "repeated" field. A run that
+ * goes on for REPORT_MS gets its record then, and keeps counting.
+ *
+ * Messages are compared directly, cheapest part first (line, level, how many
+ * fields, then the bytes), so a different message usually costs a couple of
+ * integer compares and nothing gets hashed. DATA records are never collapsed,
+ * a value holding steady is still data.
+ *
+ * Not locked, the logger keeps it behind its own mutex.
+ */
+class RepeatFilter {
+public:
+  static constexpr std::uint32_t REPORT_MS = 1000;
+
+private:
+  std::optional<LogMessage> last;
+  std::uint32_t repeats = 0;
+  std::uint32_t runStartMs = 0; // the first repeat's time
+  std::uint32_t runEndMs = 0;   // the latest one's
+  std::uint64_t collapsed = 0;
+
+  static bool sameField(const Field &a, const Field &b) {
+    if (a.type != b.type) {
+      return false;
+    }
+    // keys are string literals, usually the very same one
+    if (a.key != b.key && (a.key == nullptr || b.key == nullptr ||
+                           std::strcmp(a.key, b.key) != 0)) {
+      return false;
+    }
+    switch (a.type) {
+    case Field::BOOL:
+      return a.b == b.b;
+    case Field::INT:
+      return a.i == b.i;
+    case Field::DOUBLE:
+      return a.d == b.d;
+    case Field::STRING:
+      return a.s == b.s;
+    default:
+      return true;
+    }
+  }
+
+  std::optional<LogMessage> summary() {
+    if (this->repeats == 0) {
+      return std::nullopt;
+    }
+    LogMessage &run = *this->last;
+    std::vector<Field> fields = run.getFields();
+    fields.emplace_back(LoggerFields::REPEATED, this->repeats);
+    this->repeats = 0;
+    return LogMessage(run.getLevel(), run.getMessage(), run.getFile(),
+                      run.getLineNumber(), this->runEndMs, std::move(fields));
+  }
+
+public:
+  /**
+   * @brief Whether two messages say exactly the same thing, times aside
+   */
+  static bool same(LogMessage &a, LogMessage &b) {
+    if (a.getLineNumber() != b.getLineNumber() ||
+        a.getLevel() != b.getLevel() ||
+        a.getFields().size() != b.getFields().size() ||
+        a.getMessageView() != b.getMessageView() ||
+        a.getFileView() != b.getFileView()) {
+      return false;
+    }
+    for (std::size_t i = 0; i < a.getFields().size(); i++) {
+      if (!sameField(a.getFields()[i], b.getFields()[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Check one message against the one before it
+   *
+   * @param msg the message, remembered for next time if it's a new one
+   * @param summary set to the record for the run msg ends, if there was one,
+   * to be written before msg
+   * @return false if msg is a repeat and shouldn't be written
+   */
+  bool admit(LogMessage &msg, std::optional<LogMessage> &summary) {
+    if (msg.getLevel() == DATA) {
+      return true;
+    }
+    if (this->last && same(*this->last, msg)) {
+      if (this->repeats == 0) {
+        this->runStartMs = msg.getTime();
+      }
+      this->repeats++;
+      this->runEndMs = msg.getTime();
+      this->collapsed++;
+      return false;
+    }
+    summary = this->summary();
+    this->last = msg;
+    return true;
+  }
+
+  /**
+   * @brief The record for a run that's been going for REPORT_MS, so a storm
+   * that never ends still shows up
+   */
+  std::optional<LogMessage> due(std::uint32_t nowMs) {
+    if (this->repeats == 0 || nowMs - this->runStartMs < REPORT_MS) {
+      return std::nullopt;
+    }
+    return this->summary();
+  }
+
+  /**
+   * @brief How many messages have been collapsed into a count
+   */
+  std::uint64_t getCollapsed() { return this->collapsed; }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -1,226 +1,45 @@
 #ifndef ROBOTLOG_H
 #define ROBOTLOG_H
 
+#include "aggregate.h"
+#include "cbor.h"
+#include "clocksync.h"
 #include "colors.h"
+#include "controllersink.h"
+#include "field.h"
+#include "json.h"
+#include "logmessage.h"
 #include "main.h"
+#include "memorysink.h"
 #include "pros/rtos.hpp"
+#include "ratelimit.h"
+#include "repeatfilter.h"
+#include "sampling.h"
+#include "screensink.h"
+#include "serialsink.h"
+#include "sink.h"
+#include "stats.h"
+#include "telemetry.h"
+#include "textfile.h"
 #include <atomic>
 #include <chrono>
 #include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <ostream>
 #include <queue>
 #include <regex>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #define __FILENAME__                                                           \
   (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 
 namespace ROBOTLOG {
-enum Level {
-  DEBUG = 0,
-  debug = 0,
-  INFO = 1,
-  info = 1,
-  WARN = 2,
-  WARNING = 2,
-  warn = 2,
-  warning = 2,
-  ERR = 3,
-  ERROR = 3,
-  err = 3,
-  error = 3,
-
-  // data is used to override the string format, and instead writes the direct
-  // data,
-  DATA = 4,
-  data = 4,
-};
-
-struct LogMessage {
-  /*
-  A Message Can Include the following:
-
-  file the file where a log entry was passed from
-  func the function a log entry was passed from
-  line the line a log was called from
-  level the level a log was set to, debug, info, warning, error, data
-  message the message of a log
-  */
-
-private:
-  std::optional<std::string> file;
-  std::optional<int> line;
-  std::optional<Level> level;
-  std::optional<std::string> message;
-
-public:
-  LogMessage(Level level, std::string message, std::string file, int line) {
-    this->level = std::make_optional(level);
-    this->message = std::make_optional(message);
-    this->file = std::make_optional(file);
-    this->line = std::make_optional(line);
-  }
-
-  std::string getFile() { return this->file.value_or(""); }
-  std::string getLine() {
-    std::ostringstream oss;
-    oss << this->line.value_or(-1);
-    return oss.str();
-  }
-  Level getLevel() { return this->level.value_or(ROBOTLOG::Level::INFO); }
-  std::string getMessage() { return this->message.value_or(""); }
-  std::string getLevelAsString() {
-    switch (this->level.value()) {
-    case DEBUG:
-      return "DEBUG";
-    case INFO:
-      return "INFO";
-    case WARN:
-      return "WARN";
-    case ERR:
-      return "ERR";
-    case DATA:
-      return "";
-    default:
-      return std::to_string(this->level.value());
-    }
-
-    return "";
-  }
-
-  std::string getLevelAsStringBrackets() {
-    switch (this->level.value()) {
-    case DEBUG:
-      return "[DEBUG]";
-    case INFO:
-      return "[INFO]";
-    case WARN:
-      return "[WARN]";
-    case ERR:
-      return "[ERR]";
-    case DATA:
-      return "";
-    default:
-      return "";
-    }
-    return "[" + std::to_string(this->level.value()) + "]";
-  }
-
-  std::string getLevelAsStringWithColors(
-      std::string COLOR_ERR = ROBOTLOG::Colors::RED,
-      std::string COLOR_WARN = ROBOTLOG::Colors::YELLOW,
-      std::string COLOR_INFO = ROBOTLOG::Colors::GREEN,
-      std::string COLOR_DEBUG = ROBOTLOG::Colors::MAGENTA) {
-    switch (this->level.value()) {
-    case DEBUG:
-      return COLOR_DEBUG + "DEBUG" + Colors::RESET;
-      break;
-    case INFO:
-      return COLOR_INFO + "INFO" + Colors::RESET;
-      break;
-    case WARN:
-      return COLOR_WARN + "WARN" + Colors::RESET;
-      break;
-    case ERR:
-      return COLOR_ERR + "ERR" + Colors::RESET;
-      break;
-    case DATA:
-      return "";
-      break;
-    default:
-      return Colors::WHITE + "[" + std::to_string(this->level.value()) + "]" +
-             Colors::RESET;
-    }
-    return "";
-  }
-
-  std::string
-  getLevelAsStringFull(std::string COLOR_ERR = ROBOTLOG::Colors::RED,
-                       std::string COLOR_WARN = ROBOTLOG::Colors::YELLOW,
-                       std::string COLOR_INFO = ROBOTLOG::Colors::HI_GREEN,
-                       std::string COLOR_DEBUG = ROBOTLOG::Colors::MAGENTA) {
-    switch (this->level.value()) {
-    case DEBUG:
-      return COLOR_DEBUG + "[DEBUG]" + Colors::RESET;
-      break;
-    case INFO:
-      return COLOR_INFO + "[INFO]" + Colors::RESET;
-      break;
-    case WARN:
-      return COLOR_WARN + "[WARN]" + Colors::RESET;
-      break;
-    case ERR:
-      return COLOR_ERR + "[ERR]" + Colors::RESET;
-      break;
-    case DATA:
-      return "";
-      break;
-    default:
-      return Colors::WHITE + "[" + std::to_string(this->level.value()) + "]" +
-             Colors::RESET;
-    }
-
-    return "";
-  }
-
-  std::string format(std::string formatString,
-                     std::string COLOR_ERR = ROBOTLOG::Colors::RED,
-                     std::string COLOR_WARN = ROBOTLOG::Colors::YELLOW,
-                     std::string COLOR_INFO = ROBOTLOG::Colors::WHITE,
-                     std::string COLOR_DEBUG = ROBOTLOG::Colors::MAGENTA) {
-    /*
-    ! Characteristics of a Format String
-    * <LEVEL> - Log Level
-    ? <FILE> - File the logger was (Called From or Made In, Haven't Decided Yet)
-    TODO: Decide <FILE> Characteristics
-
-    * <FUNC> - Function .log was called from
-    ? <LINE> - Line .log was called from
-    * <MESSAGE> - Message to Include with Log
-
-    ! COLORS
-    ! Colors can be set for the LEVEL with the following
-    ? <LEVEL> - No Color
-    ? <CLEVEL> - Colorizes only the level text, doesn't add []
-    ? <BLEVEL> - Adds Brackets, doesn't add color
-    ? <CBLEVEL> - Colorizes both level text, and adds brackets which are colored
-    the same way
-    */
-    if (this->getLevel() == data ||
-        this->getLevel() == DATA) { // If it's a DATA log, you don't want any
-                                    // extra formatting to parse.
-      return this->getMessage();
-    }
-
-    formatString =
-        std::regex_replace(formatString, std::regex("<LEVEL>"), // Level Only
-                           this->getLevelAsString());
-    formatString = std::regex_replace(
-        formatString, std::regex("<BLEVEL>"), // Brackets no Color
-        this->getLevelAsStringBrackets());
-    formatString = std::regex_replace(
-        formatString, std::regex("<CLEVEL>"), // Color and Level
-        this->getLevelAsStringWithColors(COLOR_ERR, COLOR_WARN, COLOR_INFO,
-                                         COLOR_DEBUG));
-    formatString = std::regex_replace(
-        formatString, std::regex("<CBLEVEL>"), // Color and Brackets
-        this->getLevelAsStringFull(COLOR_ERR, COLOR_WARN, COLOR_INFO,
-                                   COLOR_DEBUG));
-
-    formatString = std::regex_replace(formatString, std::regex("<FILE>"),
-                                      this->getFile()); // File
-    formatString = std::regex_replace(formatString, std::regex("<LINE>"),
-                                      this->getLine()); // Line
-    formatString =
-        std::regex_replace(formatString, std::regex("<MESSAGE>"), // Message
-                           this->getMessage());
-
-    return formatString;
-  }
-};
 class LOGGER {
 private:
   pros::Task worker;
@@ -241,25 +60,336 @@ private:
                                              // <CLEVEL> or <LEVEL> to
                                              // not colorize the brackets
   ROBOTLOG::Level consoleLogLevel = ROBOTLOG::Level::INFO;
+  std::atomic<bool> consoleFraming = false;
+  ROBOTLOG::RecordFramer consoleFramer;
+  std::uint8_t consoleFrame[ROBOTLOG::RecordFramer::MAX_FRAME + 1];
   ROBOTLOG::Level fileLogLevel = ROBOTLOG::Level::DEBUG;
-  std::optional<std::string> filePath;
   std::string COLOR_ERR = ROBOTLOG::Colors::RED;
   std::string COLOR_WARN = ROBOTLOG::Colors::YELLOW;
   std::string COLOR_INFO = ROBOTLOG::Colors::GREEN;
   std::string COLOR_DEBUG = ROBOTLOG::Colors::MAGENTA;
   pros::Mutex logmutex;
-  std::ofstream file;
+  std::unique_ptr<ROBOTLOG::TextFileSink> file;
+  std::atomic<bool> fileDictionary = false;
+  std::atomic<bool> fileFraming = false;
+  std::atomic<bool> rotateRequested = false;
+  std::atomic<std::size_t> fileTimeIndex = 0;
+  bool sessionStarted = false;
+  // a list that's only ever appended to, so the worker and stats() can walk
+  // it without a lock while addSink() links in a new one
+  struct SinkNode {
+    ROBOTLOG::Sink *sink;
+    std::atomic<SinkNode *> next = nullptr;
+  };
+  std::atomic<SinkNode *> firstSink = nullptr;
+  SinkNode *lastSink = nullptr;
+  std::vector<std::unique_ptr<SinkNode>> sinkNodes;
+  pros::Mutex sinkMutex; // addSink() against addSink()
+  std::vector<ROBOTLOG::Watch> watches;
+  std::vector<std::unique_ptr<ROBOTLOG::SerialClock>> serialClocks;
+  std::vector<std::unique_ptr<ROBOTLOG::Aggregate>> aggregates;
+  pros::Mutex watchMutex; // watches, serialClocks and aggregates
+  std::vector<LogMessage> dueSamples; // the worker's, kept for its capacity
+  ROBOTLOG::StatsCounters counters;
+  std::atomic<std::uint32_t> statsPeriodMs = 0;
+  std::uint32_t nextStatsMs = 0;
+  std::atomic<ROBOTLOG::RepeatMode> repeatMode = ROBOTLOG::RepeatMode::OFF;
+  ROBOTLOG::RepeatFilter repeatFilter;
+  pros::Mutex repeatMutex;
+  // LoadSampling::pack(), so a producer never sees half of a new policy
+  std::atomic<std::uint64_t> samplingPolicy =
+      ROBOTLOG::LoadSampling::off().pack();
+  ROBOTLOG::TaskRandom random;
 
   static void taskEntry(void *param) {
     ROBOTLOG::LOGGER *logger = static_cast<ROBOTLOG::LOGGER *>(param);
     logger->workerTask();
   }
 
+  /**
+   * @brief Describe the session that's starting, for the file's header
+   */
+  static ROBOTLOG::Session currentSession() {
+    ROBOTLOG::Session session;
+    session.startMs = pros::millis();
+    if (pros::competition::is_disabled()) {
+      session.mode = "disabled";
+    } else if (pros::competition::is_autonomous()) {
+      session.mode = "autonomous";
+    } else {
+      session.mode = "driver";
+    }
+    session.field = pros::competition::is_connected();
+    return session;
+  }
+
+  /**
+   * @brief Call f with every sink added so far, in order
+   */
+  template <typename F> void forEachSink(F f) {
+    for (SinkNode *node = this->firstSink.load(std::memory_order_acquire);
+         node != nullptr; node = node->next.load(std::memory_order_acquire)) {
+      f(node->sink);
+    }
+  }
+
+  /**
+   * @brief Put a message on the worker's queue, as is
+   */
+  void push(LogMessage msg) {
+    msg.setQueuedUs(static_cast<std::uint32_t>(pros::micros()));
+    this->counters.enqueue(msg.getLevel());
+    this->logs.push(std::move(msg));
+  }
+
+  /**
+   * @brief Whether to log a message at this level, with the queue as deep as
+   * it is
+   *
+   * @return 0 to throw it away, otherwise it's being kept as 1 in this many
+   */
+  std::uint32_t sampleEvery(Level level) {
+    if (level != Level::DEBUG && level != Level::INFO) {
+      return 1;
+    }
+    ROBOTLOG::LoadSampling sampling = ROBOTLOG::LoadSampling::unpack(
+        this->samplingPolicy.load(std::memory_order_relaxed));
+    std::uint32_t every = sampling.every(
+        this->counters.producers.queueDepth.load(std::memory_order_relaxed));
+    if (every == 1) {
+      return 1;
+    }
+    if ((this->random.next(pros::c::task_get_current()) & (every - 1)) != 0) {
+      this->counters.drop(level);
+      return 0;
+    }
+    return every;
+  }
+
+  /**
+   * @brief Put a message on the worker's queue, unless it's a repeat being
+   * collapsed here
+   *
+   * @param sampledEvery what sampleEvery() said, to go in a "sampled" field
+   */
+  void enqueue(LogMessage msg, std::uint32_t sampledEvery = 1) {
+    if (sampledEvery > 1) {
+      msg.addField(Field(LoggerFields::SAMPLED, sampledEvery));
+    }
+    if (this->repeatMode != RepeatMode::PRODUCER) {
+      this->push(std::move(msg));
+      return;
+    }
+    Level level = msg.getLevel();
+    std::optional<LogMessage> summary;
+    // held while pushing, so another task can't get between the run's count
+    // and the message that ended it
+    this->repeatMutex.take();
+    bool admitted = this->repeatFilter.admit(msg, summary);
+    if (summary) {
+      this->push(std::move(*summary));
+    }
+    if (admitted) {
+      this->push(std::move(msg));
+    }
+    this->repeatMutex.give();
+    if (!admitted) {
+      this->counters.drop(level);
+    }
+  }
+
+  /**
+   * @brief Write a message that came off the queue
+   *
+   * Only ever called from the worker task.
+   */
+  void writeMessage(LogMessage &msg) {
+    this->counters.write(msg.getLevel());
+    this->writeOut(msg);
+  }
+
+  /**
+   * @brief Write a message the worker made itself, which never was queued
+   */
+  void writeGenerated(LogMessage &msg) {
+    this->counters.generate(msg.getLevel());
+    this->writeOut(msg);
+  }
+
+  /**
+   * @brief Send one message to the console, the file and every sink
+   */
+  void writeOut(LogMessage &msg) {
+    bool framed = this->consoleFraming;
+    std::string logmsg;
+    if (!framed || this->file) {
+      logmsg = msg.format(
+          this->logFormat.value_or("<CBLEVEL> <FILE>:<LINE> - <MESSAGE>"));
+    }
+    if (framed) {
+      // a delimiter in front too, so a print that came before doesn't run
+      // into the frame
+      this->consoleFrame[0] = ROBOTLOG::COBS::DELIMITER;
+      std::size_t length =
+          this->consoleFramer.frame(msg, this->consoleFrame + 1,
+                                    sizeof(this->consoleFrame) - 1);
+      if (length > 0) {
+        std::fwrite(this->consoleFrame, 1, length + 1, stdout);
+        this->counters.worker.consoleBytes.fetch_add(
+            length + 1, std::memory_order_relaxed);
+      }
+    } else {
+      // std::cout << logmsg << "\n";
+      std::printf("%s\n", logmsg.c_str());
+      this->counters.worker.consoleBytes.fetch_add(logmsg.size() + 1,
+                                                   std::memory_order_relaxed);
+    }
+
+    if (this->file) {
+      if (this->file->isFramed() != this->fileFraming) {
+        this->file->setFraming(this->fileFraming);
+      }
+      if (this->file->isDictionary() != this->fileDictionary) {
+        this->file->setDictionary(this->fileDictionary);
+      }
+      this->file->setTimeIndex(this->fileTimeIndex);
+      // on the worker rather than in the constructor, which runs before
+      // the SD card (or the competition state) is ready
+      if (!this->sessionStarted) {
+        this->sessionStarted = true;
+        this->file->startSession(currentSession());
+      }
+      this->file->writeLine(logmsg, msg.getTime());
+      this->counters.worker.fileBytes.store(this->file->getBytesWritten(),
+                                            std::memory_order_relaxed);
+    }
+
+    this->forEachSink([&msg](ROBOTLOG::Sink *sink) {
+      if (msg.getLevel() >= sink->getLevel()) {
+        sink->write(msg);
+      }
+    });
+  }
+
+  /**
+   * @brief Sample every watch that's due
+   *
+   * @return how many samples were written
+   */
+  int sampleWatches() {
+    // taken under the lock, written after it, so watch() and friends never
+    // wait on the SD card
+    this->dueSamples.clear();
+    this->watchMutex.take();
+    for (ROBOTLOG::Watch &watch : this->watches) {
+      std::uint64_t now = pros::micros();
+      if (watch.isDue(now)) {
+        this->dueSamples.push_back(watch.sample(now, pros::millis()));
+      }
+    }
+    for (std::unique_ptr<ROBOTLOG::SerialClock> &clock : this->serialClocks) {
+      std::uint64_t now = pros::micros();
+      LogMessage msg(Level::DATA, "", "", 0);
+      if (clock->isDue(now) && clock->poll(now, pros::millis(), msg)) {
+        this->dueSamples.push_back(std::move(msg));
+      }
+    }
+    for (std::unique_ptr<ROBOTLOG::Aggregate> &aggregate : this->aggregates) {
+      std::uint64_t now = pros::micros();
+      LogMessage msg(Level::DATA, "", "", 0);
+      if (aggregate->isDue(now) &&
+          aggregate->poll(now, pros::millis(), msg)) {
+        this->dueSamples.push_back(std::move(msg));
+      }
+    }
+    this->watchMutex.give();
+    for (LogMessage &msg : this->dueSamples) {
+      this->writeGenerated(msg);
+    }
+    return static_cast<int>(this->dueSamples.size());
+  }
+
+  /**
+   * @brief How long the worker can sleep without making a watch late
+   *
+   * @param longest the most it should sleep for
+   * @return a delay in milliseconds, between 1 and longest
+   */
+  std::uint32_t sleepTime(std::uint32_t longest) {
+    std::uint64_t now = pros::micros();
+    std::uint64_t sleepUs = longest * 1000;
+    this->watchMutex.take();
+    for (ROBOTLOG::Watch &watch : this->watches) {
+      std::uint64_t until = watch.usUntilDue(now);
+      if (until < sleepUs) {
+        sleepUs = until;
+      }
+    }
+    for (std::unique_ptr<ROBOTLOG::SerialClock> &clock : this->serialClocks) {
+      std::uint64_t until = clock->usUntilDue(now);
+      if (until < sleepUs) {
+        sleepUs = until;
+      }
+    }
+    for (std::unique_ptr<ROBOTLOG::Aggregate> &aggregate : this->aggregates) {
+      std::uint64_t until = aggregate->usUntilDue(now);
+      if (until < sleepUs) {
+        sleepUs = until;
+      }
+    }
+    this->watchMutex.give();
+    return sleepUs < 1000 ? 1 : static_cast<std::uint32_t>(sleepUs / 1000);
+  }
+
+  /**
+   * @brief Write the stats as a DATA record, if they're due
+   *
+   * @return whether they were written
+   */
+  bool logStatsIfDue() {
+    std::uint32_t period = this->statsPeriodMs;
+    std::uint32_t now = pros::millis();
+    if (period == 0 || static_cast<std::int32_t>(now - this->nextStatsMs) < 0) {
+      return false;
+    }
+    this->nextStatsMs = now + period;
+    LogMessage msg(Level::DATA, "logger", "stats", 0, now,
+                   this->stats().fields());
+    this->writeGenerated(msg);
+    return true;
+  }
+
+  /**
+   * @brief Write the count for a run of repeats that's been going on for a
+   * while
+   *
+   * @return whether it was written
+   */
+  bool reportRepeatsIfDue() {
+    this->repeatMutex.take();
+    std::optional<LogMessage> summary =
+        this->repeatFilter.due(pros::millis());
+    if (summary && this->repeatMode == RepeatMode::PRODUCER) {
+      // the run's first message could still be on the queue, so behind it
+      this->push(std::move(*summary));
+      summary.reset();
+    }
+    this->repeatMutex.give();
+    if (summary) {
+      this->writeGenerated(*summary);
+      return true;
+    }
+    return false;
+  }
+
   void workerTask() {
+    std::uint64_t windowStartUs = pros::micros();
+    std::uint64_t windowBusyUs = 0;
     while (true) {
       if (this->logs.empty()) {
-        pros::delay(10);
+        pros::delay(this->sleepTime(10));
       }
+      std::uint64_t busyStart = pros::micros();
 
       constexpr static char maxlogwrites = 10;
       long availableLogs = this->logs.size();
@@ -270,26 +400,60 @@ private:
         loopindices = maxlogwrites;
       }
 
+      // between batches, every message lands whole in one file or the other
+      if (this->rotateRequested.exchange(false) && this->file) {
+        this->file->rotate();
+      }
       for (int i = 0; i < loopindices; i++) {
         LogMessage msg = this->logs.front();
-        std::string logmsg = msg.format(
-            this->logFormat.value_or("<CBLEVEL> <FILE>:<LINE> - <MESSAGE>"));
-        // std::cout << logmsg << "\n";
-        logmsg = logmsg + "\n";
-        std::printf("%s", logmsg.c_str());
         this->logs.pop();
-
-        if (file.is_open()) {
-          file << logmsg;
+        this->counters.dequeue(static_cast<std::uint32_t>(pros::micros()) -
+                               msg.getQueuedUs());
+        if (this->repeatMode == RepeatMode::WORKER) {
+          std::optional<LogMessage> summary;
+          this->repeatMutex.take();
+          bool admitted = this->repeatFilter.admit(msg, summary);
+          this->repeatMutex.give();
+          if (summary) {
+            this->writeGenerated(*summary);
+          }
+          if (!admitted) {
+            this->counters.workerDrop(msg.getLevel());
+            continue;
+          }
         }
+        this->writeMessage(msg);
       }
-      if (file.is_open()) {
-        file << std::flush;
-        file.flush();
-        file.close();
-        file.open(filePath.value(), std::ios::app);
+      int samples = this->sampleWatches();
+      samples += this->logStatsIfDue();
+      samples += this->reportRepeatsIfDue();
+      if (this->consoleFraming && (loopindices > 0 || samples > 0)) {
+        std::fflush(stdout); // frames don't end in a newline
       }
-      pros::delay(5);
+      if (this->file) {
+        this->file->flush();
+      }
+      bool wrote = loopindices > 0 || samples > 0;
+      this->forEachSink([wrote](ROBOTLOG::Sink *sink) {
+        if (wrote || sink->hasPending()) {
+          sink->flush();
+        }
+      });
+
+      std::uint64_t now = pros::micros();
+      std::uint64_t busy =
+          this->counters.worker.busyUs.fetch_add(now - busyStart,
+                                                 std::memory_order_relaxed) +
+          (now - busyStart);
+      if (now - windowStartUs >= 1000000) {
+        this->counters.worker.busyHundredths.store(
+            static_cast<std::uint32_t>((busy - windowBusyUs) * 10000 /
+                                       (now - windowStartUs)),
+            std::memory_order_relaxed);
+        windowStartUs = now;
+        windowBusyUs = busy;
+      }
+      pros::delay(this->sleepTime(5));
     }
   }
 
@@ -310,8 +474,27 @@ public:
    */
   LOGGER(std::string filePath)
       : worker(&taskEntry, this, "(VexLog) LogProcessor (File Enabled)") {
-    this->file.open(filePath, std::ios::app);
-    this->filePath = std::make_optional(filePath);
+    this->file = std::make_unique<ROBOTLOG::TextFileSink>(filePath);
+    this->file->setClock(&pros::millis);
+    this->addlog(Level::debug, "Initalized VexLog @ " +
+                                   std::to_string(pros::millis()) + "ms");
+  }
+
+  /**
+   * @brief Construct a new LOGGER object that rotates its log file
+   *
+   * Logs go to numbered files next to filePath (main.0.txt, main.1.txt, ...),
+   * moving on to the next one when the current one gets too big (or every
+   * boot), and deleting the oldest ones to stay under the total size. All of
+   * it happens on the logger's task, nothing is opened here.
+   *
+   * @param filePath the file path to save logs to, without a number
+   * @param rotation when to start a new file, and how much space they can use
+   */
+  LOGGER(std::string filePath, ROBOTLOG::Rotation rotation)
+      : worker(&taskEntry, this, "(VexLog) LogProcessor (File Enabled)") {
+    this->file = std::make_unique<ROBOTLOG::TextFileSink>(filePath, rotation);
+    this->file->setClock(&pros::millis);
     this->addlog(Level::debug, "Initalized VexLog @ " +
                                    std::to_string(pros::millis()) + "ms");
   }
@@ -332,18 +515,255 @@ public:
   template <typename T>
   void addlog(Level level, const T &message, std::string file = __FILENAME__,
               int line = __LINE__) {
+    std::uint32_t every = this->sampleEvery(level);
+    if (every == 0) {
+      return;
+    }
     std::ostringstream messageAsString;
     messageAsString << message;
-    LogMessage lmsg(level, messageAsString.str(), file, line);
-    this->logs.push(lmsg);
+    this->enqueue(
+        LogMessage(level, messageAsString.str(), file, line, pros::millis()),
+        every);
+  }
+
+  /**
+   * @brief Add a log message to the queue, if its call site's limit allows
+   *
+   * What the rlog_every(), rlog_first_n() and rlog_limit() macros call. The
+   * message is only built (message() called and turned into text) once the
+   * limit lets it through, and then gets a "suppressed" field with how many
+   * were held back before it, if any were. Load sampling goes first, so a
+   * message it throws away doesn't use up the limit, and is counted as held
+   * back like the rest. Held back messages count as dropped in stats().
+   *
+   * @param level Log level
+   * @param limit the call site's limit, kept in a static there
+   * @param message returns the message to log
+   * @param file a string name of the file the log was called from
+   * @param line the line number the log was called from
+   */
+  template <typename F>
+  void addlogLimited(Level level, ROBOTLOG::RateLimit &limit, F message,
+                     std::string file, int line) {
+    std::uint32_t every = this->sampleEvery(level);
+    if (every == 0) {
+      limit.hold();
+      return;
+    }
+    std::uint32_t held = 0;
+    if (!limit.allow(pros::micros(), held)) {
+      this->counters.drop(level);
+      return;
+    }
+    std::ostringstream messageAsString;
+    messageAsString << message();
+    std::vector<Field> fields;
+    if (held > 0) {
+      fields.emplace_back(LoggerFields::SUPPRESSED, held);
+    }
+    this->enqueue(LogMessage(level, messageAsString.str(), file, line,
+                             pros::millis(), std::move(fields)),
+                  every);
+  }
+
+  /**
+   * @brief Add a structured log message to the queue
+   *
+   * Like addlog(), but instead of a pre-formatted message the log is an event
+   * name plus up to 8 typed fields. The fields are kept as-is (not turned into
+   * text) until a sink writes them out. Unused fields are left default
+   * constructed and get dropped.
+   *
+   * @param level Log level
+   * @param event name of the event being logged
+   * @param file a string name of the file the log was called from
+   * @param line the line number the log was called from
+   */
+  void kvlog(Level level, std::string event, std::string file, int line,
+             Field f0 = Field(), Field f1 = Field(), Field f2 = Field(),
+             Field f3 = Field(), Field f4 = Field(), Field f5 = Field(),
+             Field f6 = Field(), Field f7 = Field()) {
+    std::uint32_t every = this->sampleEvery(level);
+    if (every == 0) {
+      return;
+    }
+    std::vector<Field> fields;
+    for (Field *field : {&f0, &f1, &f2, &f3, &f4, &f5, &f6, &f7}) {
+      if (field->isSet()) {
+        fields.push_back(std::move(*field));
+      }
+    }
+    this->enqueue(LogMessage(level, event, file, line, pros::millis(),
+                             std::move(fields)),
+                  every);
+  }
+
+  /**
+   * @brief Add a sink that receives every message from the worker task
+   *
+   * The sink is not owned by the logger, keep it alive for as long as the
+   * logger is.
+   *
+   * @param sink the sink to add
+   */
+  void addSink(ROBOTLOG::Sink *sink) {
+    sink->setClock(&pros::millis); // before the worker can see it
+    this->sinkMutex.take();
+    this->sinkNodes.push_back(std::make_unique<SinkNode>());
+    SinkNode *node = this->sinkNodes.back().get();
+    node->sink = sink;
+    if (this->lastSink == nullptr) {
+      this->firstSink.store(node, std::memory_order_release);
+    } else {
+      this->lastSink->next.store(node, std::memory_order_release);
+    }
+    this->lastSink = node;
+    this->sinkMutex.give();
+  }
+
+  /**
+   * @brief Sample a variable from the logger's task at a fixed rate
+   *
+   * Every period the worker reads the variable and writes a DATA record with
+   * the value and how late the sample was, so the code updating the variable
+   * doesn't pay anything for logging it. The variable has to stay alive (a
+   * global or static), and isn't locked while it's read.
+   *
+   * @param name name to log the samples as, should be a string literal
+   * @param variable pointer to the number to sample
+   * @param rate how often to sample it
+   * @example logger.watch("leftVel", &leftVel, 50_Hz);
+   */
+  template <typename T>
+  void watch(const char *name, const T *variable, ROBOTLOG::Rate rate) {
+    this->watchMutex.take();
+    this->watches.emplace_back(name, variable, rate);
+    this->watchMutex.give();
+  }
+
+  /**
+   * @brief Sample the result of a function from the logger's task
+   *
+   * Same as watching a variable, but calls getter on the logger's task every
+   * period, which is handy for things like motor velocities.
+   *
+   * @param name name to log the samples as, should be a string literal
+   * @param getter function returning the value to log
+   * @param rate how often to sample it
+   * @example logger.watch("battery", [] { return pros::battery::get_voltage(); }, 1_Hz);
+   */
+  void watch(const char *name, std::function<double()> getter,
+             ROBOTLOG::Rate rate) {
+    this->watchMutex.take();
+    this->watches.emplace_back(name, std::move(getter), rate);
+    this->watchMutex.give();
+  }
+
+  /**
+   * @brief A channel that logs a summary of its samples once a window
+   *
+   * For numbers that change faster than anyone needs to read them, like
+   * motor currents every 10 ms. add() to the channel from any task without
+   * locking, and the worker writes one DATA record a window with the min,
+   * max, mean and last sample and how many there were (see Aggregate). Ten
+   * samples a window make one record instead of ten, and a spike still shows
+   * up in max.
+   *
+   * The channel lives as long as the logger, keep the reference (a static is
+   * handy) rather than calling this every loop.
+   *
+   * @param name name to log the summaries as, should be a string literal
+   * @param window how long each summary covers
+   * @example static ROBOTLOG::Aggregate &current = logger.aggregate("leftCurrent");
+   *          current.add(left.get_current_draw());
+   */
+  ROBOTLOG::Aggregate &
+  aggregate(const char *name, ROBOTLOG::Rate window = ROBOTLOG::Rate::ms(100)) {
+    this->watchMutex.take();
+    this->aggregates.push_back(
+        std::make_unique<ROBOTLOG::Aggregate>(name, window));
+    ROBOTLOG::Aggregate &aggregate = *this->aggregates.back();
+    this->watchMutex.give();
+    return aggregate;
+  }
+
+  /**
+   * @brief Pair another clock's time with the brain's, right now
+   *
+   * For when your code has the other clock's time in hand, like a camera
+   * frame's timestamp as it comes in. Only reads micros() and queues a sync
+   * record (see clocksync.h), so it costs the same as any other log.
+   *
+   * @param name name of the other clock, should be a string literal
+   * @param external its time, in whatever units it counts in
+   * @example logger.syncClock("camera", frame.timestampUs);
+   */
+  void syncClock(const char *name, std::int64_t external) {
+    std::uint64_t now = pros::micros();
+    this->enqueue(
+        ROBOTLOG::clockSyncRecord(name, now, external, 0, pros::millis()));
+  }
+
+  /**
+   * @brief Pair a counter another device sends over serial with the brain's
+   * clock
+   *
+   * The device writes its clock as a line of digits ("123456\n") every so
+   * often, and the logger's task checks the port every poll without waiting
+   * on it, writing a sync record for each line (see SerialClock). Nothing
+   * happens on the task that logs, and regular logs never wait on the port.
+   *
+   * @param name name of the other clock, should be a string literal
+   * @param port the smart port the device is plugged into
+   * @param baudrate the device's baud rate
+   * @param poll how often to check, more often gives tighter pairs
+   * @example logger.syncSerial("copro", 8, 115200);
+   */
+  void syncSerial(const char *name, std::uint8_t port, std::int32_t baudrate,
+                  ROBOTLOG::Rate poll = ROBOTLOG::Rate::ms(2)) {
+    this->watchMutex.take();
+    this->serialClocks.push_back(std::make_unique<ROBOTLOG::SerialClock>(
+        name, port, baudrate, poll));
+    this->watchMutex.give();
+  }
+
+  /**
+   * @brief How the logger itself is doing
+   *
+   * Counts per level of what was queued, written and dropped, how deep the
+   * queue is (and has been), how long messages wait in it, bytes out of the
+   * console, the file and each sink, and how busy the worker task is. Cheap
+   * enough to call every loop, the counters are only read and nothing is
+   * locked, so it never waits on the worker (or the SD card).
+   */
+  ROBOTLOG::LoggerStats stats() {
+    ROBOTLOG::LoggerStats stats;
+    this->counters.read(stats);
+    this->forEachSink([&stats](ROBOTLOG::Sink *sink) {
+      stats.sinkBytes.push_back(sink->getBytesWritten());
+    });
+    return stats;
+  }
+
+  /**
+   * @brief Write the headline stats as a DATA record every so often
+   *
+   * The record's message is "logger" and its file "stats", with the fields
+   * from LoggerStats::fields(), so it can be graphed like any watch.
+   *
+   * @param rate how often, Rate::ms(0) to stop
+   * @example logger.logStats(ROBOTLOG::Rate::ms(1000));
+   */
+  void logStats(ROBOTLOG::Rate rate) {
+    this->statsPeriodMs = rate.periodUs / 1000;
   }
 
   /**
    * @brief Change the Format String
    *
    * Changes the format string used to format log messages. The format string
-   * can include <LEVEL>, <CLEVEL>, <BLEVEL>, <CBLEVEL>, <FILE>, <LINE>, and
-   * <MESSAGE>. See the README for more information.
+   * can include <LEVEL>, <CLEVEL>, <BLEVEL>, <CBLEVEL>, <FILE>, <LINE>,
+   * <TIME> and <MESSAGE>. See the README for more information.
    * @param formatString the new format string
    * @return true if the format string was successfully updated, false otherwise
    */
@@ -371,6 +791,25 @@ public:
     this->addlog(level, message, file, line);
   }
 
+  /** @brief Log a structured message
+   *
+   * Log an event name with up to 8 typed key/value fields, which sinks like
+   * the JsonLinesSink write out without converting to text.
+   *
+   * The file and line in the record are this header's, not yours. Use the
+   * rkv() macro if you want the call site.
+   * @param level Log level
+   * @param event name of the event
+   * @example logger.kv(ROBOTLOG::INFO, "pose", {"x", x}, {"heading", h});
+   */
+  inline void kv(ROBOTLOG::Level level, std::string event, Field f0 = Field(),
+                 Field f1 = Field(), Field f2 = Field(), Field f3 = Field(),
+                 Field f4 = Field(), Field f5 = Field(), Field f6 = Field(),
+                 Field f7 = Field()) {
+    this->kvlog(level, event, __FILENAME__, __LINE__, f0, f1, f2, f3, f4, f5,
+                f6, f7);
+  }
+
   /** @brief Log a message with log level INFO
    *
    * Log a message with log level INFO. Automatically include the filename
@@ -431,6 +870,113 @@ public:
   void setConsoleLogLevel(ROBOTLOG::Level level) {
     this->consoleLogLevel = level;
   }
+
+  /**
+   * @brief Send binary frames to the console instead of text
+   *
+   * Every message goes out as a CBOR record in a COBS frame with a CRC (see
+   * RecordFramer), which is smaller than the formatted text and skips
+   * formatting on the brain unless there's a log file. Run
+   * `vexlog-serial --console` on the computer to turn it back into colored
+   * text, with anything else the program prints passed through as is, and a
+   * garbled frame only costing that one message. PROS wraps the console in
+   * its own framing unless `pros::c::serctl(SERCTL_DISABLE_COBS, nullptr)` is
+   * called first, read the port directly after that.
+   *
+   * @param enabled whether to send frames
+   */
+  void setConsoleFraming(bool enabled) { this->consoleFraming = enabled; }
+
+  /**
+   * @brief Collapse runs of identical messages into one plus a count
+   *
+   * When the same call site logs the same message (and fields) several times
+   * in a row, only the first is written, then the same message again with a
+   * "repeated" field once something else is logged, or every second while
+   * the run lasts. See RepeatFilter. Collapsed messages count as dropped in
+   * stats().
+   *
+   * WORKER does it on the logger's task, so logging costs nothing more but
+   * every repeat still takes a spot in the queue. PRODUCER does it when the
+   * message is logged, which costs a compare and a copy behind a mutex on
+   * your task, but keeps a storm from filling the queue at all.
+   *
+   * @param mode where to do it, RepeatMode::OFF to stop
+   * @example logger.setCollapseRepeats(ROBOTLOG::RepeatMode::WORKER);
+   */
+  void setCollapseRepeats(ROBOTLOG::RepeatMode mode) {
+    this->repeatMode = mode;
+  }
+
+  /**
+   * @brief Keep only some DEBUG and INFO messages while the queue is backed
+   * up
+   *
+   * Once the queue is deeper than the policy's start, each DEBUG or INFO
+   * message is kept at random with a chance that halves every time the depth
+   * doubles (see LoadSampling), and the rest are thrown away before they're
+   * even formatted. Warnings, errors and DATA are always kept. Every message
+   * that was sampled has a "sampled" field with the 1 in how many it was
+   * kept as, so counts can be scaled back up later. Messages thrown away
+   * count as dropped in stats().
+   *
+   * @param sampling when to start, LoadSampling::off() to keep everything
+   * @example logger.setLoadSampling(ROBOTLOG::LoadSampling::above(64));
+   */
+  void setLoadSampling(ROBOTLOG::LoadSampling sampling) {
+    this->samplingPolicy.store(sampling.pack(), std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Write the log file as templates plus arguments
+   *
+   * Lines that only differ in their numbers are written once as a template,
+   * then as just the template's id and the numbers, which usually makes the
+   * file several times smaller. Decode it on a computer with
+   * `vexlog-convert --text`. Does nothing if the logger has no file.
+   *
+   * @param enabled whether to use the dictionary format
+   */
+  void setFileDictionary(bool enabled) {
+    // the worker applies it, so the switch lands between two lines
+    this->fileDictionary = enabled;
+  }
+
+  /**
+   * @brief Write the log file in CRC checked blocks
+   *
+   * Instead of closing and reopening the file after every batch of messages
+   * so nothing is lost on a power loss, the file stays open and is written a
+   * 4 KB block at a time (or at least once a second). A power loss costs at
+   * most the last block, and `vexlog-recover` gets back every intact block
+   * even from a file that ends in garbage. Does nothing if the logger has no
+   * file.
+   *
+   * @param enabled whether to write blocks
+   */
+  void setFileFraming(bool enabled) { this->fileFraming = enabled; }
+
+  /**
+   * @brief Keep an index of times and offsets next to the log file
+   *
+   * Every interval bytes, where the log is and the time is added to
+   * /usd/main.tix (for /usd/main.txt). `vexlog-seek main.txt 73000 75000`
+   * then prints 73 to 75 seconds into the last session straight away, even
+   * from a huge file. Does nothing if the logger has no file.
+   *
+   * @param interval bytes of log between entries, e.g. 16384, or 0 for none
+   */
+  void setFileTimeIndex(std::size_t interval) {
+    this->fileTimeIndex = interval;
+  }
+
+  /**
+   * @brief Start a new log file, e.g. at the start of a match
+   *
+   * Only works if the logger was made with a Rotation. The worker task does
+   * the switch, so this returns right away.
+   */
+  void rotateFile() { this->rotateRequested = true; }
 };
 
 // /**
@@ -445,6 +991,57 @@ public:
 #define rlog(level, message)                                                   \
   LOGGER::ilog(level, message, __FILENAME__, __LINE__)
 
+// /**
+//  * Macros to rate limit one call site
+//  *
+//  * The limit lives in a static made the first time the line runs, and the
+//  * message isn't built at all unless the limit lets it through. The next
+//  * message that gets through has a "suppressed" field with how many didn't.
+//  *
+//  * @example logger.rlog_every(ROBOTLOG::WARN, 100ms, "slipping " << slip);
+//  * @example logger.rinfo_first_n(5, "pid saturated");
+//  * @example logger.rlog_limit(ROBOTLOG::INFO, 10, 20, "odom " << x);
+//  */
+#define ROBOTLOG_LIMITED(level, make, message)                                 \
+  LOGGER::addlogLimited(                                                       \
+      level,                                                                   \
+      [&]() -> ROBOTLOG::RateLimit & {                                         \
+        static ROBOTLOG::RateLimit limit = ROBOTLOG::RateLimit::make;          \
+        return limit;                                                          \
+      }(),                                                                     \
+      [&] {                                                                    \
+        std::ostringstream text;                                               \
+        text << message;                                                       \
+        return text.str();                                                     \
+      },                                                                       \
+      __FILENAME__, __LINE__)
+// at most once per period (a ROBOTLOG::Rate or a std::chrono duration)
+#define rlog_every(level, period, message)                                     \
+  ROBOTLOG_LIMITED(level, every(period), message)
+// only the first n times this line runs
+#define rlog_first_n(level, n, message)                                        \
+  ROBOTLOG_LIMITED(level, firstN(n), message)
+// a token bucket, perSecond on average with bursts of up to burst
+#define rlog_limit(level, perSecond, burst, message)                           \
+  ROBOTLOG_LIMITED(level, bucket(perSecond, burst), message)
+#define rinfo_every(period, message)                                           \
+  rlog_every(ROBOTLOG::Level::INFO, period, message)
+#define rinfo_first_n(n, message)                                              \
+  rlog_first_n(ROBOTLOG::Level::INFO, n, message)
+
+// /**
+//  * Macro to generate structured log entries
+//  *
+//  * Same as .kv(), but with the caller's filename and line number. Only
+//  * rkv() records the real call site, so prefer it over .kv().
+//  *
+//  * @param level Log level
+//  * @param event Event name
+//  * @example rkv(ROBOTLOG::INFO, "pose", {"x", x}, {"heading", h});
+//  */
+#define rkv(level, event, ...)                                                 \
+  LOGGER::kvlog(level, event, __FILENAME__, __LINE__, __VA_ARGS__)
+
 // /**
 //  * @brief Macro to generate log entries with log level INFO
 //  *
@@ -506,6 +1103,6 @@ public:
 #define rdata(message)                                                         \
   LOGGER::addlog(ROBOTLOG::Level::DATA, message, __FILENAME__, __LINE__)
 
-#endif
-
 } // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef ROTATION_H
+#define ROTATION_H
+
+#include "session.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace ROBOTLOG {
+/**
+ * @brief When to start a new log file, and how much space the files can use
+ *
+ * @example // 1 MB files, at most 16 MB in total, a new file every boot
+ *          ROBOTLOG::LOGGER logger("/usd/main.txt", {1 << 20, 16 << 20, true});
+ */
+struct Rotation {
+  /**
+   * @brief Start a new file once the current one reaches this size, 0 for never
+   */
+  std::size_t maxFileSize = 0;
+
+  /**
+   * @brief Delete the oldest files to keep the total under this, 0 for never
+   */
+  std::size_t maxTotalSize = 0;
+
+  /**
+   * @brief Start a new file every time the program starts
+   */
+  bool newFilePerBoot = false;
+};
+
+/**
+ * @brief Where a path's extension starts, or its length if it has none
+ */
+inline std::size_t extensionStart(const std::string &path) {
+  std::size_t slash = path.find_last_of('/');
+  std::size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    return path.size();
+  }
+  return dot;
+}
+
+/**
+ * @brief Keeps track of the numbered files of a rotating log
+ *
+ * A log at /usd/main.txt is written to /usd/main.0.txt, /usd/main.1.txt, ...
+ * with the highest number being the newest. Which numbers exist is kept in
+ * /usd/main.rot, since the brain has no way to list a directory, so starting
+ * up only has to open that and the current file. If it's missing the files
+ * are found by trying each number from 0. Deleting a file also deletes its
+ * time index (/usd/main.0.tix) and takes its sessions out of the session
+ * index (/usd/main.idx).
+ *
+ * Only used from the logger's worker task.
+ */
+class FileRotation {
+private:
+  Rotation rotation;
+  std::string base;
+  std::string extension;
+  std::uint32_t first = 0;
+  std::uint32_t last = 0;
+  std::deque<std::size_t> sizes; // of first .. last - 1
+  bool loaded = false;
+
+  static bool exists(const std::string &path, std::size_t &size) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+      return false;
+    }
+    size = static_cast<std::size_t>(file.tellg());
+    return true;
+  }
+
+  std::string statePath() { return this->base + ".rot"; }
+
+  // TimeIndex::indexPath() of file number index, which timeindex.h can't be
+  // included here for
+  std::string timeIndexPath(std::uint32_t index) {
+    return this->base + "." + std::to_string(index) + ".tix";
+  }
+
+  void save() {
+    std::ofstream state(this->statePath(), std::ios::trunc);
+    state << this->first << " " << this->last << "\n";
+  }
+
+  void load() {
+    this->loaded = true;
+    std::ifstream state(this->statePath());
+    if (!(state >> this->first >> this->last) || this->last < this->first) {
+      this->first = 0;
+      this->last = 0;
+      std::size_t size;
+      while (exists(this->path(this->last + 1), size)) {
+        this->last++;
+      }
+    }
+    this->sizes.clear();
+    for (std::uint32_t i = this->first; i < this->last; i++) {
+      std::size_t size = 0;
+      exists(this->path(i), size);
+      this->sizes.push_back(size);
+    }
+  }
+
+  // delete the oldest files until the closed ones plus a full current one fit
+  void trim() {
+    if (this->rotation.maxTotalSize == 0) {
+      return;
+    }
+    std::size_t total = this->rotation.maxFileSize;
+    for (std::size_t size : this->sizes) {
+      total += size;
+    }
+    std::vector<std::string> deleted;
+    while (total > this->rotation.maxTotalSize && !this->sizes.empty()) {
+      deleted.push_back(this->path(this->first));
+      std::remove(deleted.back().c_str());
+      std::remove(this->timeIndexPath(this->first).c_str());
+      total -= this->sizes.front();
+      this->sizes.pop_front();
+      this->first++;
+    }
+    if (!deleted.empty()) {
+      SessionIndex(this->base + ".idx").remove(deleted);
+    }
+  }
+
+public:
+  /**
+   * @param filePath the log's path without a number, e.g. /usd/main.txt
+   */
+  FileRotation(const std::string &filePath, Rotation rotation)
+      : rotation(rotation) {
+    std::size_t dot = extensionStart(filePath);
+    this->base = filePath.substr(0, dot);
+    this->extension = filePath.substr(dot);
+  }
+
+  Rotation getRotation() { return this->rotation; }
+
+  /**
+   * @brief The path of file number index
+   */
+  std::string path(std::uint32_t index) {
+    return this->base + "." + std::to_string(index) + this->extension;
+  }
+
+  /**
+   * @brief The file to write to after starting up
+   */
+  std::string current() {
+    if (!this->loaded) {
+      this->load();
+      std::size_t size = 0;
+      if (this->rotation.newFilePerBoot && exists(this->path(this->last), size) &&
+          size > 0) {
+        this->sizes.push_back(size);
+        this->last++;
+      }
+      this->trim();
+      this->save();
+    }
+    return this->path(this->last);
+  }
+
+  /**
+   * @brief Move on to a new file, deleting old ones if they're over the cap
+   *
+   * @param closedSize the size of the file that was just finished
+   * @return the path of the new file
+   */
+  std::string next(std::size_t closedSize) {
+    this->current();
+    this->sizes.push_back(closedSize);
+    this->last++;
+    this->trim();
+    this->save();
+    return this->path(this->last);
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
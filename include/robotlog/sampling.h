@@ -0,0 +1,105 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ROBOTLOG {
+/**
+ * @brief When to start keeping only some DEBUG and INFO messages, see
+ * logger.setLoadSampling()
+ *
+ * Below startDepth messages in the queue everything is kept. From there on 1
+ * in 2 is kept, then 1 in 4 from twice that depth, 1 in 8 from four times,
+ * and so on down to 1 in maxEvery (rounded down to a power of two).
+ */
+struct LoadSampling {
+  std::size_t startDepth = 0; // 0 keeps everything, always
+  std::uint32_t maxEvery = 64;
+
+  static LoadSampling off() { return LoadSampling(); }
+
+  /**
+   * @param startDepth the queue depth sampling starts at
+   * @param maxEvery keep at least 1 in this many
+   */
+  static LoadSampling above(std::size_t startDepth,
+                            std::uint32_t maxEvery = 64) {
+    LoadSampling sampling;
+    sampling.startDepth = startDepth;
+    sampling.maxEvery = maxEvery;
+    return sampling;
+  }
+
+  /**
+   * @brief Both settings in one word, so the logger can swap them in one
+   * atomic store (startDepth is capped at 32 bits, far past any queue)
+   */
+  std::uint64_t pack() const {
+    std::uint64_t depth = this->startDepth > 0xFFFFFFFFu ? 0xFFFFFFFFu
+                                                         : this->startDepth;
+    return depth << 32 | this->maxEvery;
+  }
+
+  static LoadSampling unpack(std::uint64_t packed) {
+    return above(static_cast<std::size_t>(packed >> 32),
+                 static_cast<std::uint32_t>(packed));
+  }
+
+  /**
+   * @brief Keep 1 in how many at this queue depth
+   */
+  std::uint32_t every(std::size_t depth) const {
+    if (this->startDepth == 0 || depth < this->startDepth ||
+        this->maxEvery < 2) {
+      return 1;
+    }
+    std::uint32_t every = 2;
+    for (std::size_t over = depth / this->startDepth;
+         over > 1 && every * 2 <= this->maxEvery; over >>= 1) {
+      every <<= 1;
+    }
+    return every;
+  }
+};
+
+/**
+ * @brief Cheap random numbers for sampling, a xorshift per task
+ *
+ * Each task gets one of a few xorshift32 states by its handle, so tasks
+ * logging at once don't all fight over one. Two tasks that land on the same
+ * state can both read it before either writes it back and get the same
+ * number, which only makes one sampling decision a bit less random.
+ */
+class TaskRandom {
+private:
+  static constexpr std::size_t SLOTS = 16;
+  std::atomic<std::uint32_t> states[SLOTS];
+
+public:
+  TaskRandom() {
+    for (std::size_t i = 0; i < SLOTS; i++) {
+      states[i].store(0x9E3779B9u * static_cast<std::uint32_t>(i + 1),
+                      std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @param task the calling task's handle
+   */
+  std::uint32_t next(const void *task) {
+    std::uint32_t hash = static_cast<std::uint32_t>(
+        reinterpret_cast<std::uintptr_t>(task) * 2654435761u);
+    std::atomic<std::uint32_t> &state = this->states[(hash >> 16) % SLOTS];
+    std::uint32_t x = state.load(std::memory_order_relaxed);
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    state.store(x, std::memory_order_relaxed);
+    return x;
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,349 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ROBOTLOG_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace ROBOTLOG {
+namespace Scan {
+/*
+! Bulk text scanning, for host tools
+* Finding every newline, every "[ERR]" or every color code in a big log one
+* byte at a time is most of what reading it costs. These compare 16 (SSE2) or
+* 32 (AVX2) bytes at once and turn the result into a bit mask, so each match
+* costs a few instructions and each 32 bytes without one costs about one.
+* Which one is used is picked when the program runs, AVX2 only if the CPU has
+* it. Anything other than x86 (like the brain) only gets the plain loops, which
+* give the same results.
+*/
+enum class Path { SCALAR, SSE2, AVX2 };
+
+inline const char *pathName(Path path) {
+  return path == Path::AVX2 ? "avx2" : path == Path::SSE2 ? "sse2" : "scalar";
+}
+
+/**
+ * @brief The fastest path this CPU can run
+ */
+inline Path best() {
+#ifdef ROBOTLOG_SCAN_X86
+  static const Path path = __builtin_cpu_supports("avx2")   ? Path::AVX2
+                           : __builtin_cpu_supports("sse2") ? Path::SSE2
+                                                            : Path::SCALAR;
+  return path;
+#else
+  return Path::SCALAR;
+#endif
+}
+
+namespace Detail {
+template <typename F>
+inline void eachByteScalar(const char *data, std::size_t size, char c,
+                           std::size_t from, F &f) {
+  for (std::size_t i = from; i < size; i++) {
+    if (data[i] == c) {
+      f(i);
+    }
+  }
+}
+
+template <typename F>
+inline void eachTokenScalar(const char *data, std::size_t size,
+                            std::string_view token, std::size_t from, F &f) {
+  for (std::size_t i = from; i + token.size() <= size; i++) {
+    if (data[i] == token[0] &&
+        std::memcmp(data + i + 1, token.data() + 1, token.size() - 1) == 0) {
+      f(i);
+    }
+  }
+}
+
+// calls f for every set bit of mask, as an offset from base
+template <typename F>
+inline void eachBit(std::uint32_t mask, std::size_t base, F &f) {
+  while (mask != 0) {
+    f(base + __builtin_ctz(mask));
+    mask &= mask - 1;
+  }
+}
+
+#ifdef ROBOTLOG_SCAN_X86
+template <typename F>
+__attribute__((target("sse2"))) inline void
+eachByteSse2(const char *data, std::size_t size, char c, F &f) {
+  const __m128i needle = _mm_set1_epi8(c);
+  std::size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    eachBit(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle)), i, f);
+  }
+  eachByteScalar(data, size, c, i, f);
+}
+
+template <typename F>
+__attribute__((target("avx2"))) inline void
+eachByteAvx2(const char *data, std::size_t size, char c, F &f) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  std::size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i bytes =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    eachBit(static_cast<std::uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, needle))),
+            i, f);
+  }
+  eachByteScalar(data, size, c, i, f);
+}
+
+// compares the token's first and last bytes at every position at once, and
+// only checks the middle where both match
+template <typename F>
+__attribute__((target("sse2"))) inline void
+eachTokenSse2(const char *data, std::size_t size, std::string_view token,
+              F &f) {
+  const __m128i first = _mm_set1_epi8(token.front());
+  const __m128i last = _mm_set1_epi8(token.back());
+  std::size_t n = token.size();
+  std::size_t i = 0;
+  for (; i + n - 1 + 16 <= size; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + n - 1));
+    std::uint32_t mask = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+    while (mask != 0) {
+      std::size_t at = i + __builtin_ctz(mask);
+      if (std::memcmp(data + at + 1, token.data() + 1, n - 2) == 0) {
+        f(at);
+      }
+      mask &= mask - 1;
+    }
+  }
+  eachTokenScalar(data, size, token, i, f);
+}
+
+template <typename F>
+__attribute__((target("avx2"))) inline void
+eachTokenAvx2(const char *data, std::size_t size, std::string_view token,
+              F &f) {
+  const __m256i first = _mm256_set1_epi8(token.front());
+  const __m256i last = _mm256_set1_epi8(token.back());
+  std::size_t n = token.size();
+  std::size_t i = 0;
+  for (; i + n - 1 + 32 <= size; i += 32) {
+    __m256i a =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    __m256i b = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(data + i + n - 1));
+    std::uint32_t mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+                         _mm256_cmpeq_epi8(b, last))));
+    while (mask != 0) {
+      std::size_t at = i + __builtin_ctz(mask);
+      if (std::memcmp(data + at + 1, token.data() + 1, n - 2) == 0) {
+        f(at);
+      }
+      mask &= mask - 1;
+    }
+  }
+  eachTokenScalar(data, size, token, i, f);
+}
+
+__attribute__((target("sse2"))) inline std::size_t
+findSse2(const char *data, std::size_t size, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  std::size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  for (; i < size && data[i] != c; i++) {
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) inline std::size_t
+findAvx2(const char *data, std::size_t size, char c) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  std::size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i bytes =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, needle));
+    if (mask != 0) {
+      return i + __builtin_ctz(static_cast<std::uint32_t>(mask));
+    }
+  }
+  for (; i < size && data[i] != c; i++) {
+  }
+  return i;
+}
+
+__attribute__((target("sse2"))) inline std::size_t
+countSse2(const char *data, std::size_t size, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  std::size_t count = 0;
+  std::size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle)));
+  }
+  for (; i < size; i++) {
+    count += data[i] == c;
+  }
+  return count;
+}
+
+__attribute__((target("avx2,popcnt"))) inline std::size_t
+countAvx2(const char *data, std::size_t size, char c) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  std::size_t count = 0;
+  std::size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i bytes =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    count += __builtin_popcount(static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, needle))));
+  }
+  for (; i < size; i++) {
+    count += data[i] == c;
+  }
+  return count;
+}
+#endif
+} // namespace Detail
+
+/**
+ * @brief Call f(offset) for every c in data, in order
+ */
+template <typename F>
+inline void eachByte(const char *data, std::size_t size, char c, F f,
+                     Path path = best()) {
+#ifdef ROBOTLOG_SCAN_X86
+  if (path == Path::AVX2) {
+    Detail::eachByteAvx2(data, size, c, f);
+    return;
+  }
+  if (path == Path::SSE2) {
+    Detail::eachByteSse2(data, size, c, f);
+    return;
+  }
+#endif
+  Detail::eachByteScalar(data, size, c, 0, f);
+}
+
+/**
+ * @brief Call f(offset) for every place token starts in data, in order
+ */
+template <typename F>
+inline void eachToken(const char *data, std::size_t size,
+                      std::string_view token, F f, Path path = best()) {
+  if (token.empty()) {
+    return;
+  }
+  if (token.size() == 1) {
+    eachByte(data, size, token[0], f, path);
+    return;
+  }
+#ifdef ROBOTLOG_SCAN_X86
+  if (path == Path::AVX2) {
+    Detail::eachTokenAvx2(data, size, token, f);
+    return;
+  }
+  if (path == Path::SSE2) {
+    Detail::eachTokenSse2(data, size, token, f);
+    return;
+  }
+#endif
+  Detail::eachTokenScalar(data, size, token, 0, f);
+}
+
+/**
+ * @brief Where the first c in data is, or size if there isn't one
+ */
+inline std::size_t find(const char *data, std::size_t size, char c,
+                        Path path = best()) {
+#ifdef ROBOTLOG_SCAN_X86
+  if (path == Path::AVX2) {
+    return Detail::findAvx2(data, size, c);
+  }
+  if (path == Path::SSE2) {
+    return Detail::findSse2(data, size, c);
+  }
+#endif
+  std::size_t i = 0;
+  for (; i < size && data[i] != c; i++) {
+  }
+  return i;
+}
+
+/**
+ * @brief How many times c is in data
+ */
+inline std::size_t count(const char *data, std::size_t size, char c,
+                         Path path = best()) {
+#ifdef ROBOTLOG_SCAN_X86
+  if (path == Path::AVX2) {
+    return Detail::countAvx2(data, size, c);
+  }
+  if (path == Path::SSE2) {
+    return Detail::countSse2(data, size, c);
+  }
+#endif
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < size; i++) {
+    total += data[i] == c;
+  }
+  return total;
+}
+
+/**
+ * @brief Copy text without its color codes (ESC [ ... final byte)
+ *
+ * The runs in between are found with find() and copied whole, so text with
+ * a few codes per line goes at close to memcpy speed.
+ *
+ * @param out at least size bytes, can't overlap data
+ * @return how many bytes were written to out
+ */
+inline std::size_t stripColors(const char *data, std::size_t size, char *out,
+                               Path path = best()) {
+  std::size_t written = 0;
+  std::size_t i = 0;
+  while (i < size) {
+    std::size_t run = find(data + i, size - i, '\033', path);
+    std::memcpy(out + written, data + i, run);
+    written += run;
+    i += run;
+    if (i >= size) {
+      break;
+    }
+    if (i + 1 < size && data[i + 1] == '[') {
+      i += 2;
+      while (i < size && (data[i] < 0x40 || data[i] > 0x7E)) {
+        i++;
+      }
+      i++; // the final byte
+    } else {
+      out[written++] = data[i++]; // not a color code, keep it
+    }
+  }
+  return written;
+}
+} // namespace Scan
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef SCREENRING_H
+#define SCREENRING_H
+
+#include "logmessage.h"
+#include "sink.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace ROBOTLOG {
+/**
+ * @brief The part of ScreenSink that doesn't need the brain: the last few
+ * lines in a ring, and redrawing the rows that changed
+ *
+ * Lines go into a fixed ring, oldest at the top, and flush() redraws at most
+ * fps times a second, and then only the rows whose text changed since the
+ * last frame. A burst of messages between two frames costs one redraw, not
+ * one per message.
+ *
+ * Rows are drawn with whatever setOutput() gives it and frames are timed with
+ * setClock()'s clock, so it runs against a fake screen on a computer. With
+ * no clock, frames are paced by the messages' own times and not timed.
+ * ScreenSink is this with pros::screen and pros::micros plugged in.
+ */
+class ScreenRing : public Sink {
+public:
+  static constexpr std::size_t MAX_ROWS = 12; // TEXT_MEDIUM fills the screen
+  static constexpr std::size_t COLUMNS = 48;
+
+  /**
+   * @brief Draws one row, padded with spaces to COLUMNS so it covers what
+   * was there before
+   */
+  typedef void (*DrawFn)(void *context, std::size_t row, const char *text,
+                         Level level);
+
+  struct Stats {
+    std::size_t frames = 0;
+    std::size_t rowsDrawn = 0;
+    std::uint32_t lastFrameUs = 0;
+    std::uint32_t maxFrameUs = 0;
+    std::uint64_t totalFrameUs = 0;
+  };
+
+private:
+  struct Row {
+    char text[COLUMNS + 1];
+    Level level = INFO;
+  };
+
+  Row ring[MAX_ROWS];
+  Row screen[MAX_ROWS]; // what's drawn right now
+  std::size_t rows;
+  std::size_t oldest = 0;
+  std::size_t count = 0;
+  bool changed = false;
+  std::uint32_t frameMs;
+  std::uint32_t lastFrame = 0;
+  bool everDrawn = false;
+  std::uint32_t newestTime = 0; // the newest message's, without a clock
+  DrawFn draw = nullptr;
+  void *context = nullptr;
+  std::uint64_t (*clock)() = nullptr;
+  Stats stats;
+
+  static void blank(Row &row) {
+    std::memset(row.text, ' ', COLUMNS);
+    row.text[COLUMNS] = '\0';
+  }
+
+public:
+  /**
+   * @param rows how many lines to show, up to MAX_ROWS
+   * @param fps the most times a second to redraw
+   */
+  explicit ScreenRing(std::size_t rows = MAX_ROWS, std::uint32_t fps = 10)
+      : rows(rows == 0 || rows > MAX_ROWS ? MAX_ROWS : rows),
+        frameMs(fps == 0 ? 1000 : 1000 / fps) {
+    this->level = INFO;
+    for (std::size_t i = 0; i < MAX_ROWS; i++) {
+      blank(this->ring[i]);
+      blank(this->screen[i]);
+    }
+  }
+
+  /**
+   * @brief Where rows are drawn
+   *
+   * @param draw called once for each row that changed
+   * @param context passed straight through to draw
+   */
+  void setOutput(DrawFn draw, void *context) {
+    this->draw = draw;
+    this->context = context;
+  }
+
+  /**
+   * @brief Pace and time frames with a clock instead of the messages' times
+   *
+   * @param clock returns the current time in microseconds
+   */
+  void setClock(std::uint64_t (*clock)()) { this->clock = clock; }
+  using Sink::setClock; // the milliseconds one addSink() passes, not needed
+
+  void write(LogMessage &msg) override {
+    std::size_t slot;
+    if (this->count < this->rows) {
+      slot = (this->oldest + this->count) % this->rows;
+      this->count++;
+    } else {
+      slot = this->oldest; // the oldest line scrolls off
+      this->oldest = (this->oldest + 1) % this->rows;
+    }
+    // "  12.3 W drive.cpp:42 motor 3 hot temp=55", as much as fits
+    Row &row = this->ring[slot];
+    const char *name = LogMessage::levelName(msg.getLevel());
+    std::string text = msg.getMessage() + msg.getFieldsAsString();
+    int length = std::snprintf(
+        row.text, sizeof(row.text), "%6.1f %c %s:%d %s",
+        msg.getTime() / 1000.0, name != nullptr ? name[0] : '?',
+        msg.getFile().c_str(), msg.getLineNumber(), text.c_str());
+    std::size_t used =
+        length < 0 ? 0
+                   : (static_cast<std::size_t>(length) < COLUMNS ? length
+                                                                 : COLUMNS);
+    std::memset(row.text + used, ' ', COLUMNS - used);
+    row.text[COLUMNS] = '\0';
+    row.level = msg.getLevel();
+    this->newestTime = msg.getTime();
+    this->changed = true;
+  }
+
+  /**
+   * @brief Redraw the rows that changed, if it's been long enough since the
+   * last frame
+   */
+  void flush() override {
+    if (!this->changed) {
+      return;
+    }
+    std::uint64_t start = this->clock != nullptr ? this->clock() : 0;
+    std::uint32_t now = this->clock != nullptr
+                            ? static_cast<std::uint32_t>(start / 1000)
+                            : this->newestTime;
+    if (this->everDrawn && now - this->lastFrame < this->frameMs) {
+      return;
+    }
+    this->lastFrame = now;
+    this->everDrawn = true;
+    this->changed = false;
+
+    for (std::size_t i = 0; i < this->rows; i++) {
+      const Row &wanted = this->ring[(this->oldest + i) % this->rows];
+      Row &shown = this->screen[i];
+      if (wanted.level == shown.level &&
+          std::memcmp(wanted.text, shown.text, COLUMNS) == 0) {
+        continue;
+      }
+      if (this->draw != nullptr) {
+        this->draw(this->context, i, wanted.text, wanted.level);
+      }
+      shown = wanted;
+      this->stats.rowsDrawn++;
+      this->addBytes(COLUMNS);
+    }
+    std::uint32_t took =
+        this->clock != nullptr
+            ? static_cast<std::uint32_t>(this->clock() - start)
+            : 0;
+    this->stats.frames++;
+    this->stats.lastFrameUs = took;
+    this->stats.totalFrameUs += took;
+    if (took > this->stats.maxFrameUs) {
+      this->stats.maxFrameUs = took;
+    }
+  }
+
+  bool hasPending() override { return this->changed; }
+
+  /**
+   * @brief How many frames were drawn, how many rows they took, and how long
+   * drawing took
+   */
+  const Stats &getStats() { return this->stats; }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SCREENSINK_H
+#define SCREENSINK_H
+
+#include "logmessage.h"
+#include "pros/rtos.hpp"
+#include "pros/screen.hpp"
+#include "screenring.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace ROBOTLOG {
+/**
+ * @brief Sink that keeps the last few log lines on the brain's screen
+ *
+ * A ScreenRing drawing with pros::screen, colored by level, and timing its
+ * frames with pros::micros. The redraw logic is all in ScreenRing, which
+ * doesn't need the brain, so that's what to test on a computer.
+ *
+ * @example ROBOTLOG::ScreenSink pitScreen;
+ *          logger.addSink(&pitScreen);
+ */
+class ScreenSink : public ScreenRing {
+private:
+  static void drawScreen(void *, std::size_t row, const char *text,
+                         Level level) {
+    std::uint32_t color = 0x00FFFFFF;
+    switch (level) {
+    case ERROR:
+      color = 0x00FF0000;
+      break;
+    case WARN:
+      color = 0x00FFFF00;
+      break;
+    case DEBUG:
+      color = 0x00FF00FF;
+      break;
+    case DATA:
+      color = 0x0000FFFF;
+      break;
+    default:
+      break;
+    }
+    pros::screen::set_pen(color);
+    pros::screen::print(pros::E_TEXT_MEDIUM, static_cast<std::int16_t>(row),
+                        "%s", text);
+  }
+
+public:
+  /**
+   * @param rows how many lines to show, up to MAX_ROWS
+   * @param fps the most times a second to redraw
+   */
+  explicit ScreenSink(std::size_t rows = MAX_ROWS, std::uint32_t fps = 10)
+      : ScreenRing(rows, fps) {
+    this->setOutput(&drawScreen, nullptr);
+    this->setClock(&pros::micros);
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef SERIALSINK_H
+#define SERIALSINK_H
+
+#include "cobs.h"
+#include "logmessage.h"
+#include "pros/serial.hpp"
+#include "recordframer.h"
+#include "sink.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace ROBOTLOG {
+/**
+ * @brief Sink that streams binary records out of a smart port
+ *
+ * For recording everything on another computer (a Raspberry Pi on a V5 to
+ * RS-485 adapter, say) without going through the USB console. Each message
+ * is a CBOR record like CborFileSink's, but without the string table so every
+ * record stands on its own, sent as a COBS frame with a CRC (see cobs.h and
+ * RecordFramer). A receiver that starts late or misses bytes picks up again at the next frame.
+ *
+ * Frames are collected in a buffer and handed to the port in as big a piece
+ * as its transmit buffer has room for, so it's one write per batch, not one
+ * per record. Nothing ever waits on the port: if it can't keep up and the
+ * buffer fills, new records are dropped (and counted) until there's room.
+ * Read the stream on the other end with tools/serial.cpp.
+ *
+ * @example ROBOTLOG::SerialSink recorder(10, 921600);
+ *          logger.addSink(&recorder);
+ */
+class SerialSink : public Sink {
+private:
+  pros::Serial serial;
+  RecordFramer framer;
+  std::vector<std::uint8_t> pending; // frames the port hasn't taken yet
+  std::size_t pendingLength = 0;
+  std::size_t dropped = 0;
+
+  // hand the port as much as it has room for, in one go
+  void push() {
+    if (this->pendingLength == 0) {
+      return;
+    }
+    std::int32_t room = this->serial.get_write_free();
+    if (room <= 0) {
+      return;
+    }
+    std::int32_t count = this->serial.write(
+        this->pending.data(),
+        static_cast<std::int32_t>(
+            std::min<std::size_t>(this->pendingLength, room)));
+    if (count <= 0) {
+      return;
+    }
+    this->addBytes(count);
+    this->pendingLength -= count;
+    std::memmove(this->pending.data(), this->pending.data() + count,
+                 this->pendingLength);
+  }
+
+public:
+  /**
+   * @brief Construct a new SerialSink
+   *
+   * @param port the smart port to send on
+   * @param baudrate up to 921600, the other end has to match
+   * @param bufferSize how many bytes of frames can wait for the port
+   */
+  SerialSink(std::uint8_t port, std::int32_t baudrate = 921600,
+             std::size_t bufferSize = 4096)
+      : serial(port, baudrate), pending(bufferSize) {
+    // so the receiver throws away anything from before
+    this->pending[this->pendingLength++] = COBS::DELIMITER;
+  }
+
+  void write(LogMessage &msg) override {
+    std::size_t length =
+        this->framer.frame(msg, this->pending.data() + this->pendingLength,
+                           this->pending.size() - this->pendingLength);
+    if (length == 0) {
+      this->dropped++;
+      return;
+    }
+    this->pendingLength += length;
+    if (this->pendingLength > this->pending.size() / 2) {
+      this->push();
+    }
+  }
+
+  void flush() override { this->push(); }
+
+  bool hasPending() override { return this->pendingLength > 0; }
+
+  /**
+   * @brief How many records didn't fit, because the port fell behind or the
+   * record was over RecordFramer::RECORD_CAPACITY bytes
+   */
+  std::size_t getDropped() { return this->dropped; }
+
+  /**
+   * @brief How many bytes the port has taken so far
+   */
+  std::uint64_t getSentBytes() { return this->getBytesWritten(); }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,328 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "field.h"
+#include "json.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// what goes in the build field of each session, override it from the Makefile
+// (e.g. -DVEXLOG_BUILD_ID=\"$(git rev-parse --short HEAD)\")
+#ifndef VEXLOG_BUILD_ID
+#define VEXLOG_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+namespace ROBOTLOG {
+/*
+! Sessions
+* Every time the program starts, the log file gets a header line
+?   #VEXLOG-SESSION {"session":12,"part":0,"build":"...","start_ms":1520,
+?                    "mode":"disabled","field":false,"format":1,...}
+* and a line with the same JSON plus the file and byte offset is added to the
+* index file next to the log (/usd/main.idx for /usd/main.txt). A new part of
+* the same session starts whenever a rotating log moves on to a new file.
+* The header is always plain text, written before the dictionary (if any)
+* restarts and at the start of a block (if framed), so reading from the offset
+* works without anything earlier in the file.
+*/
+constexpr std::string_view SESSION_PREFIX = "#VEXLOG-SESSION ";
+constexpr std::int64_t SESSION_FORMAT = 1;
+
+/**
+ * @brief What's known about a session when it starts
+ */
+struct Session {
+  std::uint32_t id = 0;
+  std::string build = VEXLOG_BUILD_ID;
+  std::uint32_t startMs = 0;
+  std::string mode; // "disabled", "autonomous" or "driver"
+  bool field = false; // connected to a field or competition switch
+};
+
+/**
+ * @brief One line of the index, one part of a session
+ */
+struct SessionEntry {
+  Session session;
+  std::uint32_t part = 0;
+  std::string file;
+  std::uint64_t offset = 0;
+  std::int64_t format = 0;
+  bool framed = false;
+  bool dictionary = false;
+};
+
+inline void appendString(void *context, const char *data, std::size_t length) {
+  static_cast<std::string *>(context)->append(data, length);
+}
+
+/**
+ * @brief The JSON for a session, as it goes in the header and the index
+ *
+ * @param withLocation whether to include the file and offset (index only)
+ */
+inline std::string sessionJson(const SessionEntry &entry, bool withLocation) {
+  std::vector<Field> fields;
+  fields.emplace_back("session", entry.session.id);
+  fields.emplace_back("part", entry.part);
+  fields.emplace_back("build", entry.session.build);
+  fields.emplace_back("start_ms", entry.session.startMs);
+  fields.emplace_back("mode", entry.session.mode);
+  fields.emplace_back("field", entry.session.field);
+  fields.emplace_back("format", entry.format);
+  fields.emplace_back("framed", entry.framed);
+  fields.emplace_back("dictionary", entry.dictionary);
+  if (withLocation) {
+    fields.emplace_back("file", entry.file);
+    fields.emplace_back("offset", static_cast<std::int64_t>(entry.offset));
+  }
+  std::string json;
+  char buffer[256];
+  JSON::JsonWriter writer(buffer, sizeof(buffer), &appendString, &json);
+  writer.raw('{');
+  for (std::size_t i = 0; i < fields.size(); i++) {
+    if (i > 0) {
+      writer.raw(',');
+    }
+    writer.field(fields[i]);
+  }
+  writer.raw('}');
+  writer.drain();
+  return json;
+}
+
+/**
+ * @brief Read the JSON written by sessionJson() back
+ *
+ * Only handles the flat objects sessionJson() writes, not JSON in general.
+ *
+ * @return false if it isn't a session
+ */
+inline bool parseSessionJson(std::string_view json, SessionEntry &entry) {
+  std::size_t i = 0;
+  auto skipSpace = [&]() {
+    while (i < json.size() && (json[i] == ' ' || json[i] == '\t')) {
+      i++;
+    }
+  };
+  auto readString = [&](std::string &out) {
+    out.clear();
+    if (i >= json.size() || json[i] != '"') {
+      return false;
+    }
+    for (i++; i < json.size() && json[i] != '"'; i++) {
+      if (json[i] == '\\' && i + 1 < json.size()) {
+        i++; // sessionJson() never writes \u escapes for what it writes
+        char c = json[i];
+        out.push_back(c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' : c);
+      } else {
+        out.push_back(json[i]);
+      }
+    }
+    return i++ < json.size();
+  };
+  skipSpace();
+  if (i >= json.size() || json[i++] != '{') {
+    return false;
+  }
+  bool sawSession = false;
+  std::string key;
+  std::string text;
+  while (true) {
+    skipSpace();
+    if (i < json.size() && json[i] == '}') {
+      return sawSession;
+    }
+    if (!readString(key)) {
+      return false;
+    }
+    skipSpace();
+    if (i >= json.size() || json[i++] != ':') {
+      return false;
+    }
+    skipSpace();
+    if (i < json.size() && json[i] == '"') {
+      if (!readString(text)) {
+        return false;
+      }
+      if (key == "build") {
+        entry.session.build = text;
+      } else if (key == "mode") {
+        entry.session.mode = text;
+      } else if (key == "file") {
+        entry.file = text;
+      }
+    } else {
+      std::size_t start = i;
+      while (i < json.size() && json[i] != ',' && json[i] != '}') {
+        i++;
+      }
+      std::string_view value = json.substr(start, i - start);
+      bool flag = value == "true";
+      std::uint64_t number = 0;
+      for (char c : value) {
+        if (c >= '0' && c <= '9') {
+          number = number * 10 + (c - '0');
+        }
+      }
+      if (key == "session") {
+        entry.session.id = static_cast<std::uint32_t>(number);
+        sawSession = true;
+      } else if (key == "part") {
+        entry.part = static_cast<std::uint32_t>(number);
+      } else if (key == "start_ms") {
+        entry.session.startMs = static_cast<std::uint32_t>(number);
+      } else if (key == "format") {
+        entry.format = static_cast<std::int64_t>(number);
+      } else if (key == "offset") {
+        entry.offset = number;
+      } else if (key == "field") {
+        entry.session.field = flag;
+      } else if (key == "framed") {
+        entry.framed = flag;
+      } else if (key == "dictionary") {
+        entry.dictionary = flag;
+      }
+    }
+    skipSpace();
+    if (i < json.size() && json[i] == ',') {
+      i++;
+    }
+  }
+}
+
+/**
+ * @brief The index file listing where every session starts
+ *
+ * One line of JSON per session part, appended as they start.
+ */
+class SessionIndex {
+private:
+  std::string path;
+
+public:
+  SessionIndex(std::string path) : path(path) {}
+
+  /**
+   * @brief Read every entry in the index
+   */
+  std::vector<SessionEntry> load() {
+    std::vector<SessionEntry> entries;
+    std::ifstream in(this->path);
+    std::string line;
+    while (std::getline(in, line)) {
+      SessionEntry entry;
+      if (parseSessionJson(line, entry)) {
+        entries.push_back(entry);
+      }
+    }
+    return entries;
+  }
+
+  /**
+   * @brief One more than the highest session id so far
+   *
+   * Ids only go up, so that's the last entry's id plus one. Only the end of
+   * the file is read, going back further if the last line was cut short by a
+   * power loss, so starting a session doesn't get slower as the index grows.
+   */
+  std::uint32_t nextId() {
+    std::ifstream in(this->path, std::ios::binary | std::ios::ate);
+    if (!in.is_open()) {
+      return 0;
+    }
+    std::streamoff end = in.tellg();
+    std::string tail;
+    for (std::streamoff back = 512;; back *= 2) {
+      std::streamoff start = back < end ? end - back : 0;
+      tail.assign(static_cast<std::size_t>(end - start), '\0');
+      in.seekg(start);
+      in.read(tail.data(), static_cast<std::streamsize>(tail.size()));
+      std::size_t lineEnd = tail.size();
+      while (lineEnd > 0) {
+        std::size_t newline = tail.rfind('\n', lineEnd - 1);
+        if (newline == std::string::npos && start > 0) {
+          break; // the line goes on before the part that was read
+        }
+        std::size_t lineStart = newline == std::string::npos ? 0 : newline + 1;
+        SessionEntry entry;
+        if (parseSessionJson(std::string_view(tail).substr(
+                                 lineStart, lineEnd - lineStart),
+                             entry)) {
+          return entry.session.id + 1;
+        }
+        lineEnd = newline == std::string::npos ? 0 : newline;
+      }
+      if (start == 0) {
+        return 0;
+      }
+    }
+  }
+
+  /**
+   * @brief Take out the entries for log files that have been deleted
+   *
+   * Rewrites the index, so only call it when files actually go.
+   *
+   * @param files the deleted files' paths, as the entries have them
+   */
+  void remove(const std::vector<std::string> &files) {
+    std::vector<std::string> kept;
+    bool removed = false;
+    {
+      std::ifstream in(this->path);
+      std::string line;
+      while (std::getline(in, line)) {
+        SessionEntry entry;
+        if (!parseSessionJson(line, entry)) {
+          removed = true; // a line cut short, it's no use to anything
+          continue;
+        }
+        bool deleted = false;
+        for (const std::string &file : files) {
+          deleted = deleted || entry.file == file;
+        }
+        removed = removed || deleted;
+        if (!deleted) {
+          kept.push_back(std::move(line));
+        }
+      }
+    }
+    if (!removed) {
+      return;
+    }
+    std::ofstream out(this->path, std::ios::trunc);
+    for (const std::string &line : kept) {
+      out << line << "\n";
+    }
+  }
+
+  /**
+   * @brief Append an entry
+   *
+   * If the last line was cut short by a power loss it gets ended first, so
+   * it's the only line lost and this one still reads back.
+   */
+  void add(const SessionEntry &entry) {
+    bool ended = true;
+    {
+      std::ifstream in(this->path, std::ios::binary | std::ios::ate);
+      char last = '\n';
+      if (in.is_open() && in.tellg() > 0 && in.seekg(-1, std::ios::end) &&
+          in.get(last)) {
+        ended = last == '\n';
+      }
+    }
+    std::ofstream out(this->path, std::ios::app);
+    if (!ended) {
+      out << "\n";
+    }
+    out << sessionJson(entry, true) << "\n";
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include "logmessage.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace ROBOTLOG {
+/**
+ * @brief Somewhere for the logger to send messages, besides the console/file
+ *
+ * Sinks are only ever called from the logger's worker task, so they don't need
+ * to be thread safe and are free to do slow things like writing to the SD
+ * card. write() is called once for every message at or above the sink's level,
+ * and flush() is called after each batch of messages the worker processes
+ * (and after every loop, while hasPending() says so).
+ *
+ * Add a sink with logger.addSink(&sink). The logger does not take ownership, so
+ * the sink has to outlive the logger (a global works fine).
+ */
+class Sink {
+protected:
+  ROBOTLOG::Level level = ROBOTLOG::Level::DEBUG;
+
+  /**
+   * @brief Count bytes of output, for stats
+   *
+   * Only the worker counts, so it's a plain load and store, but atomic so
+   * logger.stats() can read it from any task without a lock.
+   */
+  void addBytes(std::uint64_t count) {
+    this->bytes.store(this->bytes.load(std::memory_order_relaxed) + count,
+                      std::memory_order_relaxed);
+  }
+
+private:
+  // on its own cache line, away from whatever the worker is busy changing
+  alignas(64) std::atomic<std::uint64_t> bytes = 0;
+
+public:
+  virtual ~Sink() = default;
+
+  /**
+   * @brief Handle a single message
+   *
+   * @param msg the message to write
+   */
+  virtual void write(LogMessage &msg) = 0;
+
+  /**
+   * @brief Called after every batch, push anything buffered out
+   */
+  virtual void flush() {}
+
+  /**
+   * @brief Whether the sink is still holding on to something flush() should
+   * push out, so the worker keeps calling it even when nothing new comes in
+   */
+  virtual bool hasPending() { return false; }
+
+  /**
+   * @brief Give the sink a clock, for sinks that do things as time passes
+   * (not only as messages come in), logger.addSink() passes pros::millis
+   *
+   * @param clock returns the current time in milliseconds
+   */
+  virtual void setClock(std::uint32_t (*)()) {}
+
+  /**
+   * @brief Set the lowest level this sink will receive
+   *
+   * @param level the new minimum level
+   */
+  void setLevel(ROBOTLOG::Level level) { this->level = level; }
+  ROBOTLOG::Level getLevel() { return this->level; }
+
+  /**
+   * @brief How many bytes the sink has put out so far (written to its file,
+   * sent on its port, ...), for logger.stats()
+   */
+  std::uint64_t getBytesWritten() {
+    return this->bytes.load(std::memory_order_relaxed);
+  }
+};
+
+/**
+ * @brief Base for sinks that write bytes to a file on the SD card
+ *
+ * Handles opening the file in append mode and the flush/close/reopen dance that
+ * makes the data actually land on the card. Subclasses only have to turn
+ * messages into bytes and pass them to writeBytes().
+ */
+class FileSink : public Sink {
+protected:
+  std::string filePath;
+  std::ofstream file;
+  std::size_t fileSize = 0;
+
+  /**
+   * @brief Append raw bytes to the file
+   */
+  void writeBytes(const char *data, std::size_t length) {
+    if (this->file.is_open()) {
+      this->file.write(data, length);
+      this->fileSize += length;
+      this->addBytes(length);
+    }
+  }
+
+  /**
+   * @brief Whether nothing has been written to the file yet
+   *
+   * Useful for writing a header only once per file.
+   */
+  bool isEmpty() { return this->fileSize == 0; }
+
+  /**
+   * @brief Close the current file (if any) and start appending to another
+   */
+  void open(std::string filePath) {
+    if (this->file.is_open()) {
+      this->file.close();
+    }
+    this->filePath = filePath;
+    this->fileSize = 0;
+    std::ifstream existing(filePath, std::ios::binary | std::ios::ate);
+    if (existing.is_open()) {
+      this->fileSize = static_cast<std::size_t>(existing.tellg());
+    }
+    this->file.open(filePath, std::ios::app | std::ios::binary);
+  }
+
+  /**
+   * @brief For subclasses that open their file later, with open()
+   */
+  FileSink() = default;
+
+public:
+  /**
+   * @brief Construct a new FileSink
+   *
+   * @param filePath the file to append to
+   */
+  FileSink(std::string filePath) { this->open(filePath); }
+
+  /**
+   * @brief Get the size of the file, including anything written this session
+   */
+  std::size_t getFileSize() { return this->fileSize; }
+
+  void flush() override {
+    if (this->file.is_open()) {
+      // same close/reopen as the main log file, so the data actually lands on
+      // the SD card
+      this->file.flush();
+      this->file.close();
+      this->file.open(this->filePath, std::ios::app | std::ios::binary);
+    }
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "field.h"
+#include "logmessage.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ROBOTLOG {
+/**
+ * @brief What the logger has been up to, see logger.stats()
+ *
+ * Levels are indexed DEBUG, INFO, WARN, ERROR, DATA, then everything else
+ * (custom levels) together.
+ */
+struct LoggerStats {
+  static constexpr std::size_t LEVELS = 6;
+  static constexpr std::size_t BUCKETS = 24; // up to about 16 s
+
+  std::uint64_t enqueued[LEVELS] = {}; // put on the queue by your code
+  std::uint64_t written[LEVELS] = {};  // taken off it and written
+  std::uint64_t dropped[LEVELS] = {};  // held back by a limit or collapsed
+  // made and written by the worker itself: watch samples, clock syncs,
+  // aggregates, stats and repeat counts, which never were on the queue
+  std::uint64_t generated[LEVELS] = {};
+  std::size_t queueDepth = 0;
+  std::size_t peakQueueDepth = 0;
+  // time from the log call to the worker writing it, bucket i counts the ones
+  // under 2^(i+1) us (and at least 2^i), the last one everything slower
+  std::uint64_t latency[BUCKETS] = {};
+  std::uint64_t consoleBytes = 0;
+  std::uint64_t fileBytes = 0;
+  std::vector<std::uint64_t> sinkBytes; // in the order they were added
+  std::uint64_t busyUs = 0;             // the worker, not counting sleeps
+  double busyPercent = 0;               // of the last full second
+
+  static std::size_t levelIndex(Level level) {
+    return level >= DEBUG && level <= DATA ? static_cast<std::size_t>(level)
+                                           : LEVELS - 1;
+  }
+
+  static std::size_t latencyBucket(std::uint32_t us) {
+    std::size_t bucket = 0;
+    while (us > 1 && bucket < BUCKETS - 1) {
+      us >>= 1;
+      bucket++;
+    }
+    return bucket;
+  }
+
+  std::uint64_t total(const std::uint64_t (&counts)[LEVELS]) const {
+    std::uint64_t sum = 0;
+    for (std::uint64_t count : counts) {
+      sum += count;
+    }
+    return sum;
+  }
+
+  /**
+   * @brief Roughly how long the given fraction of messages waited, at most
+   *
+   * @param fraction e.g. 0.99 for the 99th percentile
+   * @return the top of the bucket it falls in, in microseconds
+   */
+  std::uint32_t latencyPercentileUs(double fraction) const {
+    std::uint64_t count = 0;
+    for (std::uint64_t bucket : this->latency) {
+      count += bucket;
+    }
+    if (count == 0) {
+      return 0;
+    }
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < BUCKETS; i++) {
+      seen += this->latency[i];
+      if (seen >= fraction * count) {
+        return std::uint32_t(1) << (i + 1);
+      }
+    }
+    return std::uint32_t(1) << BUCKETS;
+  }
+
+  /**
+   * @brief The headline numbers, as fields for a DATA record
+   */
+  std::vector<Field> fields() const {
+    std::vector<Field> fields;
+    fields.reserve(9);
+    fields.emplace_back("written", this->total(this->written));
+    fields.emplace_back("generated", this->total(this->generated));
+    fields.emplace_back("dropped", this->total(this->dropped));
+    fields.emplace_back("queue", this->queueDepth);
+    fields.emplace_back("queue_peak", this->peakQueueDepth);
+    fields.emplace_back("p50_us", this->latencyPercentileUs(0.5));
+    fields.emplace_back("p99_us", this->latencyPercentileUs(0.99));
+    fields.emplace_back("busy_pct", this->busyPercent);
+    fields.emplace_back("bytes", this->consoleBytes + this->fileBytes);
+    return fields;
+  }
+};
+
+/**
+ * @brief The counters behind LoggerStats
+ *
+ * Every task that logs bumps the producer counters and the worker bumps the
+ * rest, so the two groups sit on their own cache lines and logging doesn't
+ * wait on the worker's writes. The exception is queueDepth, which producers
+ * add to and the worker takes from: it's kept with the producers, next to
+ * the peak it feeds. Drops are counted on whichever side makes them. They're
+ * relaxed atomics, each one is exact but a read of all of them isn't one
+ * instant.
+ */
+struct StatsCounters {
+  struct alignas(64) Producers {
+    std::atomic<std::uint64_t> enqueued[LoggerStats::LEVELS] = {};
+    std::atomic<std::uint64_t> dropped[LoggerStats::LEVELS] = {};
+    std::atomic<std::size_t> queueDepth = 0;
+    std::atomic<std::size_t> peakQueueDepth = 0;
+  };
+  struct alignas(64) Worker {
+    std::atomic<std::uint64_t> written[LoggerStats::LEVELS] = {};
+    std::atomic<std::uint64_t> generated[LoggerStats::LEVELS] = {};
+    std::atomic<std::uint64_t> dropped[LoggerStats::LEVELS] = {};
+    std::atomic<std::uint64_t> latency[LoggerStats::BUCKETS] = {};
+    std::atomic<std::uint64_t> consoleBytes = 0;
+    std::atomic<std::uint64_t> fileBytes = 0;
+    std::atomic<std::uint64_t> busyUs = 0;
+    std::atomic<std::uint32_t> busyHundredths = 0; // percent, last second
+  };
+
+  Producers producers;
+  Worker worker;
+
+  void enqueue(Level level) {
+    this->producers.enqueued[LoggerStats::levelIndex(level)].fetch_add(
+        1, std::memory_order_relaxed);
+    std::size_t depth =
+        this->producers.queueDepth.fetch_add(1, std::memory_order_relaxed) + 1;
+    std::atomic<std::size_t> &peak = this->producers.peakQueueDepth;
+    std::size_t seen = peak.load(std::memory_order_relaxed);
+    while (depth > seen && !peak.compare_exchange_weak(
+                               seen, depth, std::memory_order_relaxed)) {
+    }
+  }
+
+  void drop(Level level) {
+    this->producers.dropped[LoggerStats::levelIndex(level)].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief A drop made on the worker task (a repeat collapsed there)
+   */
+  void workerDrop(Level level) {
+    this->worker.dropped[LoggerStats::levelIndex(level)].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+
+  void dequeue(std::uint32_t waitedUs) {
+    this->producers.queueDepth.fetch_sub(1, std::memory_order_relaxed);
+    this->worker.latency[LoggerStats::latencyBucket(waitedUs)].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+
+  void write(Level level) {
+    this->worker.written[LoggerStats::levelIndex(level)].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+
+  void generate(Level level) {
+    this->worker.generated[LoggerStats::levelIndex(level)].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Copy every counter out
+   */
+  void read(LoggerStats &stats) const {
+    for (std::size_t i = 0; i < LoggerStats::LEVELS; i++) {
+      stats.enqueued[i] =
+          this->producers.enqueued[i].load(std::memory_order_relaxed);
+      stats.dropped[i] =
+          this->producers.dropped[i].load(std::memory_order_relaxed) +
+          this->worker.dropped[i].load(std::memory_order_relaxed);
+      stats.written[i] =
+          this->worker.written[i].load(std::memory_order_relaxed);
+      stats.generated[i] =
+          this->worker.generated[i].load(std::memory_order_relaxed);
+    }
+    for (std::size_t i = 0; i < LoggerStats::BUCKETS; i++) {
+      stats.latency[i] =
+          this->worker.latency[i].load(std::memory_order_relaxed);
+    }
+    stats.queueDepth =
+        this->producers.queueDepth.load(std::memory_order_relaxed);
+    stats.peakQueueDepth =
+        this->producers.peakQueueDepth.load(std::memory_order_relaxed);
+    stats.consoleBytes =
+        this->worker.consoleBytes.load(std::memory_order_relaxed);
+    stats.fileBytes = this->worker.fileBytes.load(std::memory_order_relaxed);
+    stats.busyUs = this->worker.busyUs.load(std::memory_order_relaxed);
+    stats.busyPercent =
+        this->worker.busyHundredths.load(std::memory_order_relaxed) / 100.0;
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
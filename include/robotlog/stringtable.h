@@ -0,0 +1,96 @@
+#ifndef STRINGTABLE_H
+#define STRINGTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace ROBOTLOG {
+/**
+ * @brief Remembers strings already written to a file, in fixed memory
+ *
+ * An open addressed hash table over a fixed arena, so interning strings
+ * never allocates. Once the table (or arena) is full, new strings are simply
+ * not remembered and get written out in full every time.
+ *
+ * @tparam SLOTS number of hash slots, a power of two
+ * @tparam ARENA_SIZE bytes of string storage
+ * @tparam MAX_LENGTH longest string that will be remembered
+ */
+template <std::size_t SLOTS, std::size_t ARENA_SIZE, std::size_t MAX_LENGTH>
+class BasicStringTable {
+private:
+  static_assert((SLOTS & (SLOTS - 1)) == 0, "SLOTS has to be a power of two");
+  static_assert(ARENA_SIZE <= 0xFFFF, "offsets are stored in 16 bits");
+  static constexpr std::size_t MAX_ENTRIES = SLOTS * 3 / 4; // short probes
+
+  struct Slot {
+    std::uint32_t hash;
+    std::uint16_t offset;
+    std::uint16_t length;
+    std::uint16_t index;
+    bool used;
+  };
+
+  Slot slots[SLOTS];
+  char arena[ARENA_SIZE];
+  std::size_t arenaUsed = 0;
+  std::uint16_t count = 0;
+
+  static std::uint32_t hash(std::string_view str) {
+    std::uint32_t hash = 2166136261u; // FNV-1a
+    for (char c : str) {
+      hash = (hash ^ static_cast<std::uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+  }
+
+public:
+  BasicStringTable() { this->clear(); }
+
+  void clear() {
+    std::memset(this->slots, 0, sizeof(this->slots));
+    this->arenaUsed = 0;
+    this->count = 0;
+  }
+
+  /**
+   * @brief Look a string up, adding it if there's room
+   *
+   * @param str the string to look for
+   * @param added set to true if the string was new and got added
+   * @return the string's index, or -1 if it isn't (and won't be) in the table
+   */
+  int find(std::string_view str, bool &added) {
+    added = false;
+    if (str.size() < 2 || str.size() > MAX_LENGTH) {
+      return -1; // a reference wouldn't be any shorter, or it's too long
+    }
+    std::uint32_t h = hash(str);
+    std::size_t slot = h & (SLOTS - 1);
+    while (this->slots[slot].used) {
+      const Slot &entry = this->slots[slot];
+      if (entry.hash == h && entry.length == str.size() &&
+          std::memcmp(this->arena + entry.offset, str.data(), str.size()) ==
+              0) {
+        return entry.index;
+      }
+      slot = (slot + 1) & (SLOTS - 1);
+    }
+    if (this->count >= MAX_ENTRIES ||
+        this->arenaUsed + str.size() > ARENA_SIZE) {
+      return -1;
+    }
+    std::memcpy(this->arena + this->arenaUsed, str.data(), str.size());
+    this->slots[slot] = {h, static_cast<std::uint16_t>(this->arenaUsed),
+                         static_cast<std::uint16_t>(str.size()), this->count,
+                         true};
+    this->arenaUsed += str.size();
+    added = true;
+    return this->count++;
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "field.h"
+#include "logmessage.h"
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+namespace ROBOTLOG {
+/**
+ * @brief How often something should happen, stored as a period
+ *
+ * Usually made with the _Hz literal, e.g. 50_Hz.
+ */
+struct Rate {
+  std::uint32_t periodUs;
+
+  /**
+   * @brief 0 Hz (or anything under one per 71 minutes, the longest period
+   * that fits) gets that longest period
+   */
+  static constexpr Rate hz(double hz) {
+    if (!(hz > 1000000.0 / 0xFFFFFFFFu)) {
+      return Rate{0xFFFFFFFFu};
+    }
+    return Rate{static_cast<std::uint32_t>(1000000.0 / hz)};
+  }
+  static constexpr Rate ms(std::uint32_t ms) { return Rate{ms * 1000}; }
+};
+
+namespace literals {
+/**
+ * @example using namespace ROBOTLOG::literals;
+ *          logger.watch("leftVel", &leftVel, 50_Hz);
+ */
+constexpr Rate operator""_Hz(unsigned long long hz) {
+  return Rate::hz(static_cast<double>(hz));
+}
+constexpr Rate operator""_Hz(long double hz) {
+  return Rate::hz(static_cast<double>(hz));
+}
+} // namespace literals
+
+/**
+ * @brief A variable (or getter) the logger samples on its own
+ *
+ * Made by logger.watch(). The worker task checks each watch every loop, and
+ * once it's due reads the value and writes a DATA record with the watch's
+ * name as the message and two fields:
+ *
+ * v the value
+ * late_us how many microseconds after its scheduled time the sample was taken
+ *
+ * so the code that owns the variable never has to format anything.
+ */
+class Watch {
+private:
+  const char *name;
+  std::uint32_t periodUs;
+  std::uint64_t nextDueUs = 0;
+  const void *variable = nullptr;
+  Field (*read)(const void *variable) = nullptr;
+  std::function<double()> getter;
+
+public:
+  /**
+   * @brief Watch a variable
+   *
+   * @param name name to log the samples as, should be a string literal
+   * @param variable the variable to read, has to stay alive
+   * @param rate how often to sample it
+   */
+  template <typename T>
+  Watch(const char *name, const T *variable, Rate rate)
+      : name(name), periodUs(rate.periodUs), variable(variable) {
+    static_assert(std::is_arithmetic<T>::value,
+                  "only numbers and bools can be watched, use a getter for "
+                  "anything else");
+    // volatile so the compiler can't assume the value never changes
+    this->read = [](const void *variable) {
+      return Field("v", *static_cast<const volatile T *>(variable));
+    };
+  }
+
+  /**
+   * @brief Watch the result of a function
+   *
+   * @param name name to log the samples as, should be a string literal
+   * @param getter called from the worker task to get the value
+   * @param rate how often to sample it
+   */
+  Watch(const char *name, std::function<double()> getter, Rate rate)
+      : name(name), periodUs(rate.periodUs), getter(std::move(getter)) {}
+
+  const char *getName() { return this->name; }
+
+  /**
+   * @brief Whether the watch should be sampled at this time
+   */
+  bool isDue(std::uint64_t nowUs) { return nowUs >= this->nextDueUs; }
+
+  /**
+   * @brief Microseconds until the watch is next due, 0 if it already is
+   */
+  std::uint64_t usUntilDue(std::uint64_t nowUs) {
+    return this->nextDueUs > nowUs ? this->nextDueUs - nowUs : 0;
+  }
+
+  /**
+   * @brief Read the value and build its DATA record
+   *
+   * Also schedules the next sample. If the worker fell more than a whole
+   * period behind, the missed samples are skipped rather than taken in a
+   * burst.
+   *
+   * @param nowUs the current pros::micros()
+   * @param nowMs the current pros::millis(), used as the record's timestamp
+   */
+  LogMessage sample(std::uint64_t nowUs, std::uint32_t nowMs) {
+    std::uint64_t late = this->nextDueUs == 0 ? 0 : nowUs - this->nextDueUs;
+    std::vector<Field> fields;
+    fields.reserve(2);
+    if (this->read != nullptr) {
+      fields.push_back(this->read(this->variable));
+    } else {
+      fields.emplace_back("v", this->getter());
+    }
+    fields.emplace_back("late_us", late);
+
+    if (this->nextDueUs == 0) {
+      this->nextDueUs = nowUs;
+    }
+    this->nextDueUs += this->periodUs;
+    if (this->nextDueUs <= nowUs) {
+      this->nextDueUs = nowUs + this->periodUs;
+    }
+    return LogMessage(Level::DATA, this->name, "watch", 0, nowMs,
+                      std::move(fields));
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
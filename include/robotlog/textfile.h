@@ -0,0 +1,423 @@
+#ifndef TEXTFILE_H
+#define TEXTFILE_H
+
+#include "dictionary.h"
+#include "frame.h"
+#include "logmessage.h"
+#include "rotation.h"
+#include "session.h"
+#include "sink.h"
+#include "timeindex.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace ROBOTLOG {
+/**
+ * @brief Sink that writes formatted text lines to a file
+ *
+ * This is what LOGGER uses for the file passed to its constructor, and it can
+ * also be added as a sink of its own (e.g. a second file with only warnings).
+ *
+ * With the dictionary turned on, repeated lines are written as a reference to
+ * a template plus the numbers that changed (see dictionary.h), which is a lot
+ * smaller for the usual "same message, different number" logs. Turn it back
+ * into text with `vexlog-convert --text`.
+ *
+ * With framing turned on, the text is written in blocks with a CRC (see
+ * frame.h) and the file is kept open instead of being closed and reopened
+ * after every batch. A power loss costs at most the block that was still being
+ * filled, and `vexlog-recover` gets back every block that made it to the card.
+ * Compression (which implies framing) also compresses each block.
+ *
+ * Made with a Rotation, it writes numbered files instead (main.0.txt,
+ * main.1.txt, ...), see rotation.h. The file isn't opened until the first line
+ * is written, so all of that happens on the logger's task. Every file starts
+ * its own dictionary and block sequence, so each one can be read on its own.
+ *
+ * startSession() writes a session header, and adds the session to the index
+ * file next to the log, see session.h.
+ *
+ * setTimeIndex() keeps a second index next to the log, of where every so many
+ * KB of it start and at what time, so a time window can be found without
+ * reading the whole file, see timeindex.h.
+ */
+class TextFileSink : public FileSink {
+private:
+  std::string formatString = "<BLEVEL> <FILE>:<LINE> - <MESSAGE>";
+  bool dictionary = false;
+  bool dictionaryStarted = false;
+  Dictionary::Encoder encoder;
+  // only made once framing is turned on, it's about 16 KB
+  std::unique_ptr<Frame::BlockWriter> blocks;
+  bool framed = false;
+  bool wroteBlock = false;
+  std::uint32_t blockStartTime = 0;
+  std::uint32_t lastTime = 0;
+  std::uint32_t maxBlockAgeMs = 1000;
+  std::uint32_t (*clock)() = nullptr;
+  std::unique_ptr<FileRotation> rotation;
+  std::string indexPath;
+  SessionEntry session;
+  bool inSession = false;
+  std::size_t timeIndexInterval = 0;
+  std::size_t lastIndexOffset = 0;
+  bool needIndexPoint = true;
+  TimeIndex::Writer timeIndex;
+
+  std::uint32_t now() {
+    return this->clock != nullptr ? this->clock() : this->lastTime;
+  }
+
+  // a rotating sink opens its first file on the first write
+  void openIfNeeded() {
+    if (this->rotation && !this->file.is_open()) {
+      this->open(this->rotation->current());
+    }
+  }
+
+  static void output(void *context, const char *data, std::size_t length) {
+    TextFileSink *sink = static_cast<TextFileSink *>(context);
+    sink->openIfNeeded();
+    if (sink->framed) {
+      if (sink->blocks->pending() == 0) {
+        sink->blockStartTime = sink->now();
+      }
+      sink->blocks->append(data, length, &writeBlock, sink);
+    } else {
+      sink->writeBytes(data, length);
+    }
+  }
+
+  // the header of the current session part, at the start of its own block and
+  // before the dictionary restarts
+  void writeSessionHeader() {
+    if (this->framed) {
+      this->blocks->finish(&writeBlock, this);
+    }
+    this->session.file = this->filePath;
+    this->session.offset = this->getFileSize();
+    this->session.framed = this->framed;
+    this->session.dictionary = this->dictionary;
+    std::string header(SESSION_PREFIX);
+    header += sessionJson(this->session, false);
+    header += "\n";
+    output(this, header.data(), header.size());
+    this->dictionaryStarted = false;
+    this->needIndexPoint = true; // the time might have gone back
+    SessionIndex(this->indexPath).add(this->session);
+  }
+
+  // a place the file can be read from on its own: a new block, a restarted
+  // dictionary
+  void addIndexPoint(std::uint32_t time) {
+    if (this->framed) {
+      this->blocks->finish(&writeBlock, this);
+    }
+    this->dictionaryStarted = false;
+    TimeIndex::Entry entry;
+    entry.time = time;
+    entry.session = this->inSession ? this->session.session.id : 0;
+    entry.offset = static_cast<std::uint32_t>(this->getFileSize());
+    entry.flags = (this->framed ? TimeIndex::FRAMED : 0) |
+                  (this->dictionary ? TimeIndex::DICTIONARY : 0);
+    this->timeIndex.add(entry, TimeIndex::indexPath(this->filePath));
+    this->lastIndexOffset = this->getFileSize();
+    this->needIndexPoint = false;
+  }
+
+  void nextPart() {
+    this->session.part++;
+    this->writeSessionHeader();
+  }
+
+  static void writeBlock(void *context, const char *data, std::size_t length) {
+    TextFileSink *sink = static_cast<TextFileSink *>(context);
+    sink->writeBytes(data, length);
+    sink->wroteBlock = true;
+  }
+
+public:
+  /**
+   * @brief Construct a new TextFileSink
+   *
+   * @param filePath the file to append lines to
+   */
+  TextFileSink(std::string filePath)
+      : FileSink(filePath),
+        indexPath(filePath.substr(0, extensionStart(filePath)) + ".idx") {}
+
+  /**
+   * @brief Construct a new TextFileSink that rotates between numbered files
+   *
+   * @param filePath the path without a number, e.g. /usd/main.txt
+   * @param rotation when to start a new file and how many to keep
+   */
+  TextFileSink(std::string filePath, Rotation rotation)
+      : rotation(std::make_unique<FileRotation>(filePath, rotation)),
+        indexPath(filePath.substr(0, extensionStart(filePath)) + ".idx") {}
+
+  ~TextFileSink() override {
+    if (this->framed) {
+      this->blocks->finish(&writeBlock, this);
+    }
+    this->timeIndex.write(TimeIndex::indexPath(this->filePath));
+  }
+
+  /**
+   * @brief Change the format string used by write()
+   *
+   * Lines passed to writeLine() are already formatted, so this only matters
+   * when the sink was added with addSink().
+   */
+  void setFormatString(std::string formatString) {
+    this->formatString = formatString;
+  }
+
+  /**
+   * @brief Turn dictionary encoding on or off
+   *
+   * Turning it on starts a new dictionary section in the file, everything
+   * before it stays plain text. During a session, this starts a new part of
+   * it, so every part of the index is in one format.
+   */
+  void setDictionary(bool dictionary) {
+    if (dictionary == this->dictionary) {
+      return;
+    }
+    this->dictionary = dictionary;
+    this->dictionaryStarted = false;
+    if (this->inSession) {
+      this->nextPart(); // which restarts the dictionary
+    }
+  }
+
+  bool isDictionary() { return this->dictionary; }
+
+  /**
+   * @brief Turn block framing on or off
+   *
+   * Turning it off writes out the block that was being filled first. Starts
+   * a new part of the session, like setDictionary().
+   */
+  void setFraming(bool framed) {
+    if (framed == this->framed) {
+      return;
+    }
+    if (framed && !this->blocks) {
+      this->blocks = std::make_unique<Frame::BlockWriter>();
+    }
+    if (!framed) {
+      this->blocks->finish(&writeBlock, this);
+    }
+    this->framed = framed;
+    if (this->inSession) {
+      this->nextPart();
+    }
+  }
+
+  bool isFramed() { return this->framed; }
+
+  /**
+   * @brief Compress each block (turns framing on)
+   */
+  void setCompression(bool compress) {
+    if (compress) {
+      this->setFraming(true);
+    }
+    if (this->blocks) {
+      this->blocks->setCompression(compress);
+    }
+  }
+
+  /**
+   * @brief Set how long a line can wait in a block before it's written
+   *
+   * Only matters with framing on, where a block is normally written once it's
+   * full. This is the most that can be lost on a power loss, shorter means
+   * smaller blocks with more overhead (and worse compression).
+   */
+  void setMaxBlockAge(std::uint32_t ms) { this->maxBlockAgeMs = ms; }
+
+  /**
+   * @brief Measure block age with a clock instead of the messages' times
+   *
+   * Without one, a block only gets old when newer messages arrive, so the
+   * last lines before logging goes quiet can wait in memory indefinitely.
+   * The logger sets this to pros::millis for its own file, and addSink()
+   * for any other.
+   *
+   * @param clock returns the current time in milliseconds
+   */
+  void setClock(std::uint32_t (*clock)()) override { this->clock = clock; }
+
+  /**
+   * @brief Keep an index of times and offsets next to the log
+   *
+   * Every interval bytes of log, the offset of the next line and its time
+   * are added to /usd/main.tix (for /usd/main.txt, or /usd/main.3.tix for
+   * /usd/main.3.txt when rotating), and `vexlog-seek` uses that to print a
+   * time window of a huge log without reading all of it. Each of those
+   * places starts a new block and dictionary, so smaller intervals cost a
+   * little space. The index itself is written by flush(), a few entries at
+   * a time.
+   *
+   * @param interval bytes of log between entries, 0 to stop indexing
+   */
+  void setTimeIndex(std::size_t interval) {
+    this->timeIndexInterval = interval;
+  }
+
+  /**
+   * @brief Write a line that was already formatted
+   *
+   * @param line the text, without a trailing newline
+   * @param time the time of the message, used for the max block age
+   */
+  void writeLine(std::string_view line, std::uint32_t time = 0) {
+    this->lastTime = time;
+    if (this->rotation) {
+      this->openIfNeeded();
+      std::size_t size = this->getFileSize();
+      if (this->framed) {
+        size += this->blocks->pending();
+      }
+      std::size_t maxSize = this->rotation->getRotation().maxFileSize;
+      if (maxSize > 0 && size > 0 && size + line.size() + 1 > maxSize) {
+        this->rotate();
+      }
+    }
+    if (this->timeIndexInterval > 0 &&
+        (this->needIndexPoint ||
+         this->getFileSize() - this->lastIndexOffset >=
+             this->timeIndexInterval)) {
+      this->addIndexPoint(time);
+    }
+    if (this->dictionary) {
+      // started with the first line, so it lands after any session header
+      if (!this->dictionaryStarted) {
+        this->encoder.start(&output, this);
+        this->dictionaryStarted = true;
+      }
+      this->encoder.line(line, &output, this);
+    } else {
+      output(this, line.data(), line.size());
+      output(this, "\n", 1);
+    }
+  }
+
+  void write(LogMessage &msg) override {
+    this->writeLine(msg.format(this->formatString), msg.getTime());
+  }
+
+  void flush() override {
+    if (!this->framed) {
+      FileSink::flush();
+    } else {
+      if (this->blocks->pending() > 0 &&
+          this->now() - this->blockStartTime >= this->maxBlockAgeMs) {
+        this->blocks->finish(&writeBlock, this);
+      }
+      // the file stays open, every block checks itself so there's no need
+      // to close and reopen it
+      if (this->wroteBlock) {
+        this->file.flush();
+        this->wroteBlock = false;
+      }
+    }
+    // after the log, so the index never points past what's on the card
+    this->timeIndex.write(TimeIndex::indexPath(this->filePath));
+  }
+
+  /**
+   * @brief Finish the current file and move on to the next one
+   *
+   * Only does anything when the sink was made with a Rotation. Nothing
+   * buffered is lost, it's written to the old file first.
+   */
+  void rotate() {
+    if (!this->rotation) {
+      return;
+    }
+    this->openIfNeeded();
+    if (this->isEmpty() && !(this->framed && this->blocks->pending() > 0)) {
+      return; // already on a fresh file
+    }
+    if (this->framed) {
+      this->blocks->finish(&writeBlock, this);
+      this->blocks->restart();
+    }
+    this->file.flush();
+    this->timeIndex.write(TimeIndex::indexPath(this->filePath));
+    this->open(this->rotation->next(this->getFileSize()));
+    this->dictionaryStarted = false;
+    this->lastIndexOffset = 0;
+    this->needIndexPoint = true;
+    if (this->inSession) {
+      this->nextPart();
+    }
+  }
+
+  /**
+   * @brief Start a new session, writing its header and adding it to the index
+   *
+   * The session's id is picked here, one more than the last one in the index.
+   *
+   * @param session what to write in the header
+   * @return the session's id
+   */
+  std::uint32_t startSession(Session session) {
+    this->openIfNeeded();
+    SessionIndex index(this->indexPath);
+    session.id = index.nextId();
+    this->session = SessionEntry();
+    this->session.session = session;
+    this->session.format = SESSION_FORMAT;
+    this->inSession = true;
+    this->writeSessionHeader();
+    return session.id;
+  }
+
+  /**
+   * @brief Get the path of the file being written to
+   */
+  std::string getFilePath() { return this->filePath; }
+
+  /**
+   * @brief Write out the block that's being filled, even if it isn't full
+   */
+  void sync() {
+    if (this->framed) {
+      this->blocks->finish(&writeBlock, this);
+    }
+    this->flush();
+  }
+};
+
+/**
+ * @brief Sink that writes formatted text lines, compressed in blocks
+ *
+ * A TextFileSink with compression on. Text logs usually come out several
+ * times smaller, which means that much less to write to the SD card. All the
+ * memory it needs is allocated once, nothing is allocated per block.
+ *
+ * Read the file on a computer with `vexlog-recover`.
+ *
+ * @example ROBOTLOG::CompressedFileSink packed("/usd/main.vxf");
+ *          logger.addSink(&packed);
+ */
+class CompressedFileSink : public TextFileSink {
+public:
+  /**
+   * @brief Construct a new CompressedFileSink
+   *
+   * @param filePath the file to append blocks to
+   */
+  CompressedFileSink(std::string filePath) : TextFileSink(filePath) {
+    this->setCompression(true);
+  }
+};
+} // namespace ROBOTLOG
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef TIMEINDEX_H
+#define TIMEINDEX_H
+
+#include "frame.h"
+#include "rotation.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace ROBOTLOG {
+namespace TimeIndex {
+/*
+! Time index format
+* A file next to the log (/usd/main.tix for /usd/main.txt) with one 16 byte
+* entry for every so many KB of log, each pointing at a place reading can start
+* from without anything earlier in the file:
+?   time      4 bytes   millis of the first line after the offset
+?   session   4 bytes   the session that line is in, 0 outside of one
+?   offset    4 bytes   where in the log it is
+?   flags     4 bytes   FRAMED | DICTIONARY, how the log is written there
+* All little endian. At each of those places a framed log starts a new block
+* and a dictionary log restarts its dictionary, so the offset can be decoded
+* on its own. Times only go up within a session (millis restart every boot),
+* so finding a time is a binary search over that session's entries.
+*/
+constexpr std::size_t ENTRY_SIZE = 16;
+constexpr std::uint32_t FRAMED = 1;
+constexpr std::uint32_t DICTIONARY = 2;
+
+struct Entry {
+  std::uint32_t time = 0;
+  std::uint32_t session = 0;
+  std::uint32_t offset = 0; // FAT32 files can't be bigger than 4 GB anyway
+  std::uint32_t flags = 0;
+};
+
+/**
+ * @brief The index's path for a log, /usd/main.tix for /usd/main.txt
+ */
+inline std::string indexPath(const std::string &logPath) {
+  return logPath.substr(0, extensionStart(logPath)) + ".tix";
+}
+
+/**
+ * @brief Collects entries and appends them to the index a few at a time
+ *
+ * add() only copies the entry into a small array, the file is opened and
+ * written by write(), which the sink calls from flush(), so the index costs
+ * one extra write per batch that had an entry, not one per entry.
+ */
+class Writer {
+public:
+  static constexpr std::size_t CAPACITY = 16;
+
+private:
+  std::uint8_t pending[CAPACITY * ENTRY_SIZE];
+  std::size_t count = 0;
+
+public:
+  /**
+   * @brief Queue an entry, writing the queue out first if it's full
+   */
+  void add(const Entry &entry, const std::string &path) {
+    if (this->count == CAPACITY) {
+      this->write(path);
+    }
+    std::uint8_t *out = this->pending + this->count * ENTRY_SIZE;
+    Frame::put32(out, entry.time);
+    Frame::put32(out + 4, entry.session);
+    Frame::put32(out + 8, entry.offset);
+    Frame::put32(out + 12, entry.flags);
+    this->count++;
+  }
+
+  std::size_t size() { return this->count; }
+
+  /**
+   * @brief Append every queued entry to the index
+   */
+  void write(const std::string &path) {
+    if (this->count == 0) {
+      return;
+    }
+    std::ofstream out(path, std::ios::app | std::ios::binary);
+    out.write(reinterpret_cast<const char *>(this->pending),
+              this->count * ENTRY_SIZE);
+    this->count = 0;
+  }
+};
+
+/**
+ * @brief Read the entry at data
+ */
+inline Entry read(const std::uint8_t *data) {
+  Entry entry;
+  entry.time = Frame::get32(data);
+  entry.session = Frame::get32(data + 4);
+  entry.offset = Frame::get32(data + 8);
+  entry.flags = Frame::get32(data + 12);
+  return entry;
+}
+
+/**
+ * @brief Read a whole index, for host tools
+ */
+inline std::vector<Entry> load(const std::string &path) {
+  std::vector<Entry> entries;
+  std::ifstream in(path, std::ios::binary);
+  std::uint8_t data[ENTRY_SIZE];
+  while (in.read(reinterpret_cast<char *>(data), ENTRY_SIZE)) {
+    entries.push_back(read(data));
+  }
+  return entries;
+}
+
+/**
+ * @brief Which entries of an index cover a time window
+ */
+struct Range {
+  std::size_t begin = 0; // the first entry to read from
+  std::size_t end = 0;   // the entry to stop at, or the index's size for EOF
+  std::size_t probes = 0; // entries looked at by the search
+};
+
+/**
+ * @brief Find the entries a session's lines from..to are between
+ *
+ * Starts at the last entry at or before from and ends at the first entry of
+ * the session after to, so everything in the window is inside the range (and
+ * usually a bit more, the index is only every so many KB). Read each entry
+ * up to the next one's offset with its own flags, the format can change
+ * in between.
+ *
+ * @param entries the whole index, in file order
+ * @param session which session's times from and to are in
+ * @return false if the session isn't in the index
+ */
+inline bool find(const std::vector<Entry> &entries, std::uint32_t session,
+                 std::uint32_t from, std::uint32_t to, Range &range) {
+  // a session's entries are next to each other, and sessions only go up
+  auto sessionLess = [](const Entry &entry, std::uint32_t id) {
+    return entry.session < id;
+  };
+  auto first = std::lower_bound(entries.begin(), entries.end(), session,
+                                sessionLess);
+  auto last = std::lower_bound(first, entries.end(), session + 1, sessionLess);
+  if (first == last || first->session != session) {
+    return false;
+  }
+  range.probes = 0;
+  auto timeLess = [&range](std::uint32_t time, const Entry &entry) {
+    range.probes++;
+    return time < entry.time;
+  };
+  // the last entry with time <= from, or the session's first
+  auto start = std::upper_bound(first, last, from, timeLess);
+  start = start == first ? first : start - 1;
+  auto end = std::upper_bound(start, last, to, timeLess);
+  range.begin = start - entries.begin();
+  range.end = end - entries.begin();
+  return true;
+}
+} // namespace TimeIndex
+} // namespace ROBOTLOG
+
+#endif
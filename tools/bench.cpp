@@ -0,0 +1,1344 @@
+/*
+ * vexlog-bench: host benchmarks for the parts of VexLog that don't need a brain
+ *
+ * Build (from the repo root):
+ *   g++ -std=c++20 -O2 -Iinclude tools/bench.cpp -o vexlog-bench
+ *
+ * Usage:
+ *   vexlog-bench json [records]
+ *   vexlog-bench columns [seconds]
+ *   vexlog-bench gorilla [file.vxc]
+ *   vexlog-bench dict [log.txt]
+ *   vexlog-bench lz [log.txt]
+ *   vexlog-bench recover [log.txt]
+ *   vexlog-bench serial [records]
+ *   vexlog-bench corpus <out.txt> [MB] [plain|dict|framed|compressed]
+ *   vexlog-bench sessions [boots]
+ *   vexlog-bench scan [log.txt]
+ *   vexlog-bench memory [records]
+ *   vexlog-bench repeats [seconds]
+ *   vexlog-bench screen [messages]
+ *
+ * gorilla compresses every channel of a ColumnarSink file (or a synthetic
+ * two minute match if none is given) and reports size and speed.
+ *
+ * dict runs a text log (or a synthetic one, formatted the way the logger
+ * formats it) through the dictionary encoder, checks that it decodes back to
+ * the same lines, and reports bytes per line before and after.
+ *
+ * lz compresses a text log (or the same synthetic one) in blocks the way
+ * CompressedFileSink does, and weighs the time spent compressing against the
+ * bytes it saves. It also cuts the result short inside blocks to check that a
+ * truncated file still gives back every complete block.
+ *
+ * recover frames a log, damages it (flipped bits, junk, fake headers) and
+ * times the recovery scan against the same file undamaged.
+ *
+ * serial frames records the way SerialSink does, damages some frames, cuts
+ * others short, prints text in between, and feeds the stream to the
+ * receiver vexlog-serial uses in random sized pieces. It checks that every
+ * intact record and every line of text comes out, and that the damaged
+ * frames are counted as bad and their bytes as skipped.
+ *
+ * corpus writes a big log (the synthetic one over and over, 2 ms per line)
+ * through a TextFileSink in the given format, with a time index, for timing
+ * vexlog-query and vexlog-seek on more data than a robot would write.
+ *
+ * sessions boots a rotating, time indexed log over and over, timing how
+ * long starting a session takes, and checks that session ids go up by one,
+ * that deleted files take their time index and session entries with them,
+ * and that an entry added after a power loss cut the index mid line still
+ * reads back.
+ *
+ * scan times the text scanning kernels vexlog-query uses (finding newlines,
+ * level tokens and color codes) with plain loops, SSE2 and AVX2, on a text
+ * log (or the synthetic one, colors and all, repeated to 256 MB), and checks
+ * that they all find the same things.
+ *
+ * memory writes records into a MemorySink as text lines and as CBOR records,
+ * draining it as it goes, to time the logger's formatting with no I/O at all.
+ *
+ * repeats simulates a fault storm (an unplugged IMU warning every 10 ms loop,
+ * then two motors taking turns overheating, with a status line now and then)
+ * and counts the lines and bytes the logger would write with and without
+ * collapsing repeats.
+ *
+ * screen runs ScreenSink's ring against a fake screen and a fake clock,
+ * checks that frames are held to the frame rate, that only changed rows are
+ * redrawn and that the screen ends up showing the newest lines, then times
+ * logging a lot of messages through it.
+ */
+#include "robotlog/columnar.h"
+#include "robotlog/dictionary.h"
+#include "robotlog/gorilla.h"
+#include "robotlog/json.h"
+#include "robotlog/memorysink.h"
+#include "robotlog/recordframer.h"
+#include "robotlog/repeatfilter.h"
+#include "robotlog/scan.h"
+#include "robotlog/screenring.h"
+#include "robotlog/frame.h"
+#include "robotlog/textfile.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <random>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// keeps the compiler from optimizing the work away
+static volatile std::size_t sinkhole = 0;
+
+static void appendBytes(void *context, const char *data, std::size_t length) {
+  static_cast<std::string *>(context)->append(data, length);
+}
+
+static void countBytes(void *context, const char *data, std::size_t length) {
+  *static_cast<std::size_t *>(context) += length;
+  sinkhole = sinkhole + static_cast<unsigned char>(data[0]);
+}
+
+// half plain messages, half structured ones with a few fields
+static std::vector<ROBOTLOG::LogMessage> sampleMessages() {
+  std::vector<ROBOTLOG::LogMessage> messages;
+  for (int i = 0; i < 64; i++) {
+    if (i % 2 == 0) {
+      messages.emplace_back(ROBOTLOG::Level::INFO,
+                            "This is a log message with a custom level of " +
+                                std::to_string(i),
+                            "main.cpp", 100 + i, 1000 + i * 10);
+    } else {
+      std::vector<ROBOTLOG::Field> fields;
+      fields.emplace_back("x", 12.5 + i);
+      fields.emplace_back("heading", 90.0 / (i + 1));
+      fields.emplace_back("state", "driving \"fast\"");
+      fields.emplace_back("count", i);
+      messages.emplace_back(ROBOTLOG::Level::DATA, "pose", "odom.cpp", 42,
+                            1000 + i * 10, std::move(fields));
+    }
+  }
+  return messages;
+}
+
+static int benchJson(long records) {
+  std::vector<ROBOTLOG::LogMessage> messages = sampleMessages();
+
+  char buffer[2048];
+  std::size_t bytes = 0;
+  ROBOTLOG::JSON::JsonWriter writer(buffer, sizeof(buffer), &countBytes,
+                                    &bytes);
+  Clock::time_point start = Clock::now();
+  for (long i = 0; i < records; i++) {
+    writer.record(messages[i % messages.size()]);
+  }
+  writer.drain();
+  double elapsed = secondsSince(start);
+  std::printf("json serialize: %ld records, %.1f MB in %.3f s = %.1f MB/s, "
+              "%.0f ns/record\n",
+              records, bytes / 1e6, elapsed, bytes / 1e6 / elapsed,
+              elapsed * 1e9 / records);
+
+  // the escape scan on its own, on text with nothing to escape
+  std::string text(1 << 20, 'a');
+  for (std::size_t i = 0; i < text.size(); i += 61) {
+    text[i] = ' ';
+  }
+  const int passes = 200;
+  std::size_t found = 0;
+  start = Clock::now();
+  for (int i = 0; i < passes; i++) {
+    found += ROBOTLOG::JSON::findEscapeScalar(text.data(), text.size());
+    sinkhole = sinkhole + found;
+  }
+  double scalar = secondsSince(start);
+  start = Clock::now();
+  for (int i = 0; i < passes; i++) {
+    found += ROBOTLOG::JSON::findEscape(text.data(), text.size());
+    sinkhole = sinkhole + found;
+  }
+  double vector = secondsSince(start);
+  double megabytes = static_cast<double>(text.size()) * passes / 1e6;
+  std::printf("escape scan: scalar %.0f MB/s, vectorized %.0f MB/s\n",
+              megabytes / scalar, megabytes / vector);
+  return 0;
+}
+
+// 30 channels at 100 Hz, like watching every motor and sensor on a robot
+static std::uint32_t columnClockMs = 0;
+
+static std::uint32_t columnClock() { return columnClockMs; }
+
+static int benchColumns(long seconds) {
+  std::filesystem::path dir = std::filesystem::temp_directory_path();
+  std::string columnPath = (dir / "vexlog-bench.vxc").string();
+  std::string textPath = (dir / "vexlog-bench.txt").string();
+  std::filesystem::remove(columnPath);
+  const int channels = 30;
+  std::vector<std::string> names;
+  for (int c = 0; c < channels; c++) {
+    names.push_back("channel" + std::to_string(c));
+  }
+  {
+    ROBOTLOG::ColumnarSink sink(columnPath);
+    std::ofstream text(textPath, std::ios::trunc);
+    for (long t = 0; t < seconds * 1000; t += 10) {
+      for (int c = 0; c < channels; c++) {
+        std::vector<ROBOTLOG::Field> fields;
+        fields.emplace_back("v", c * 100 + std::sin(t / 1000.0 + c) * 50);
+        ROBOTLOG::LogMessage msg(ROBOTLOG::Level::DATA, names[c], "watch", 0,
+                                 static_cast<std::uint32_t>(t),
+                                 std::move(fields));
+        sink.write(msg);
+        text << msg.format("") << "\n"; // what the text log has for DATA
+      }
+      // rate limited text with the limiter's count, which isn't a channel
+      if (t % 100 == 0) {
+        std::vector<ROBOTLOG::Field> fields;
+        fields.emplace_back(ROBOTLOG::LoggerFields::SUPPRESSED, 9);
+        ROBOTLOG::LogMessage slip(
+            ROBOTLOG::Level::WARN, "slipping " + std::to_string(t * 0.001),
+            "drive.cpp", 42, static_cast<std::uint32_t>(t), std::move(fields));
+        sink.write(slip);
+      }
+      if (t % 100 == 0) {
+        sink.flush();
+      }
+    }
+    // a name that doesn't fit in a CHANNEL chunk is skipped, not written
+    std::vector<ROBOTLOG::Field> fields;
+    fields.emplace_back("v", 1.0);
+    ROBOTLOG::LogMessage huge(ROBOTLOG::Level::DATA, std::string(4096, 'x'),
+                              "watch", 0, 0, std::move(fields));
+    sink.write(huge);
+    sink.close();
+  }
+
+  // once logging goes quiet, the clock still gets the last samples written
+  bool quietOk = false;
+  {
+    std::string quietPath = (dir / "vexlog-bench-quiet.vxc").string();
+    std::filesystem::remove(quietPath);
+    ROBOTLOG::ColumnarSink sink(quietPath);
+    sink.setClock(&columnClock);
+    columnClockMs = 5000;
+    for (int i = 0; i < 10; i++) {
+      std::vector<ROBOTLOG::Field> fields;
+      fields.emplace_back("v", i);
+      ROBOTLOG::LogMessage msg(ROBOTLOG::Level::DATA, "battery", "watch", 0,
+                               columnClockMs, std::move(fields));
+      sink.write(msg);
+    }
+    sink.flush();
+    bool heldBack = sink.hasPending();
+    columnClockMs += 1000;
+    sink.flush();
+    quietOk = heldBack && !sink.hasPending();
+    std::filesystem::remove(quietPath);
+  }
+
+  std::string wanted = "channel17";
+  const int passes = 20;
+
+  Clock::time_point start = Clock::now();
+  std::size_t columnSamples = 0;
+  for (int i = 0; i < passes; i++) {
+    int fd = open(columnPath.c_str(), O_RDONLY);
+    struct stat info;
+    fstat(fd, &info);
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ROBOTLOG::Columnar::Reader reader(data, info.st_size);
+    columnSamples = reader.load(wanted + ".v").size();
+    munmap(data, info.st_size);
+    close(fd);
+  }
+  double columnTime = secondsSince(start) / passes;
+
+  std::size_t channelsFound = 0;
+  bool indexUsed = false;
+  bool damagedIndexOk = false;
+  {
+    std::ifstream in(columnPath, std::ios::binary);
+    std::vector<std::uint8_t> file((std::istreambuf_iterator<char>(in)),
+                                   std::istreambuf_iterator<char>());
+    ROBOTLOG::Columnar::Reader reader(file.data(), file.size());
+    channelsFound = reader.channels().size();
+    indexUsed = reader.usedIndex();
+    // point the index's last entry past the end, the reader has to notice
+    // and walk the chunks instead
+    std::uint64_t index =
+        ROBOTLOG::Columnar::get64(file.data() + file.size() - 8);
+    std::uint32_t length = ROBOTLOG::Columnar::get32(file.data() + index + 4);
+    ROBOTLOG::Columnar::put64(file.data() + index +
+                                  ROBOTLOG::Columnar::HEADER_SIZE + length -
+                                  ROBOTLOG::Columnar::ENTRY_SIZE,
+                              file.size() * 2);
+    ROBOTLOG::Columnar::Reader damaged(file.data(), file.size());
+    damagedIndexOk = !damaged.usedIndex() &&
+                     damaged.load(wanted + ".v").size() == columnSamples;
+  }
+
+  // what a script does with the text log: read every line, keep the ones
+  // for the channel, parse the number
+  start = Clock::now();
+  std::size_t textSamples = 0;
+  std::string prefix = wanted + " v=";
+  for (int i = 0; i < passes; i++) {
+    std::ifstream text(textPath);
+    std::string line;
+    std::vector<double> values;
+    while (std::getline(text, line)) {
+      if (line.compare(0, prefix.size(), prefix) == 0) {
+        values.push_back(std::strtod(line.c_str() + prefix.size(), nullptr));
+      }
+    }
+    textSamples = values.size();
+  }
+  double textTime = secondsSince(start) / passes;
+
+  std::printf("columns: %d channels, %ld s at 100 Hz, columnar file %ju KB, "
+              "text log %ju KB\n",
+              channels, seconds,
+              static_cast<std::uintmax_t>(
+                  std::filesystem::file_size(columnPath) / 1024),
+              static_cast<std::uintmax_t>(
+                  std::filesystem::file_size(textPath) / 1024));
+  std::printf("load one channel: columnar %.3f ms (%zu samples), text scan "
+              "%.3f ms (%zu samples), %.0fx faster\n",
+              columnTime * 1e3, columnSamples, textTime * 1e3, textSamples,
+              textTime / columnTime);
+  std::filesystem::remove(columnPath);
+  std::filesystem::remove(textPath);
+  if (!indexUsed) {
+    std::printf("  FAILED, the index chain didn't read back\n");
+    return 1;
+  }
+  if (!damagedIndexOk) {
+    std::printf("  FAILED, a damaged index wasn't caught\n");
+    return 1;
+  }
+  if (!quietOk) {
+    std::printf("  FAILED, samples stayed buffered after logging went "
+                "quiet\n");
+    return 1;
+  }
+  if (channelsFound != static_cast<std::size_t>(channels) ||
+      columnSamples != static_cast<std::size_t>(seconds * 100)) {
+    std::printf("  FAILED, expected %d channels and %ld samples, found %zu "
+                "and %zu\n",
+                channels, seconds * 100, channelsFound, columnSamples);
+    return 1;
+  }
+  return 0;
+}
+
+struct Channel {
+  std::string name;
+  std::vector<ROBOTLOG::Columnar::Sample> samples;
+};
+
+// two minutes at 100 Hz, jittery like the worker's timing
+static std::vector<Channel> syntheticMatch() {
+  std::mt19937 rng(42);
+  std::normal_distribution<double> noise(0, 1);
+  std::vector<Channel> channels(4);
+  channels[0].name = "leftVel (rpm, whole numbers)";
+  channels[1].name = "heading (deg, noisy)";
+  channels[2].name = "battery (mV)";
+  channels[3].name = "intakeOn (bool)";
+  std::uint32_t time = 0;
+  double velocity = 0, heading = 0, battery = 12800;
+  for (int i = 0; i < 12000; i++) {
+    time += 10 + (rng() % 8 == 0 ? 1 : 0);
+    velocity += std::round(noise(rng) * 3);
+    heading += 0.05 + noise(rng) * 0.01;
+    if (rng() % 200 == 0) {
+      battery -= 10;
+    }
+    channels[0].samples.push_back({time, velocity});
+    channels[1].samples.push_back({time, heading});
+    channels[2].samples.push_back({time, battery});
+    channels[3].samples.push_back({time, (i / 500) % 2 ? 1.0 : 0.0});
+  }
+  return channels;
+}
+
+static int benchGorilla(const char *path) {
+  std::vector<Channel> channels;
+  std::vector<char> file;
+  if (path != nullptr) {
+    std::ifstream in(path, std::ios::binary);
+    file.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+    ROBOTLOG::Columnar::Reader reader(file.data(), file.size());
+    for (const std::string &name : reader.channels()) {
+      channels.push_back({name, reader.load(name)});
+    }
+  } else {
+    channels = syntheticMatch();
+  }
+
+  std::size_t totalRaw = 0, totalPacked = 0, totalSamples = 0;
+  double encodeTime = 0, decodeTime = 0;
+  const std::size_t chunk = ROBOTLOG::ColumnarSink::CHUNK_SAMPLES;
+  std::uint8_t buffer[chunk * 15];
+  for (const Channel &channel : channels) {
+    std::size_t raw = 0, packed = 0;
+    // chunk it the way the sink would
+    for (std::size_t begin = 0; begin < channel.samples.size();
+         begin += chunk) {
+      std::size_t end = std::min(begin + chunk, channel.samples.size());
+      raw += 8 + (end - begin) * 8; // header + doubles
+      for (std::size_t i = begin + 1; i < end; i++) {
+        std::uint32_t delta =
+            channel.samples[i].time - channel.samples[i - 1].time;
+        raw += delta < 0x80 ? 1 : delta < 0x4000 ? 2 : 5;
+      }
+
+      Clock::time_point start = Clock::now();
+      ROBOTLOG::Gorilla::BitWriter bits(buffer, sizeof(buffer));
+      ROBOTLOG::Gorilla::Encoder encoder(bits);
+      for (std::size_t i = begin; i < end; i++) {
+        encoder.add(channel.samples[i].time, channel.samples[i].value);
+      }
+      encodeTime += secondsSince(start);
+      packed += 8 + bits.bytes();
+
+      start = Clock::now();
+      ROBOTLOG::Gorilla::Decoder decoder(buffer, bits.bytes(),
+                                         channel.samples[begin].time);
+      ROBOTLOG::Columnar::Sample sample;
+      for (std::size_t i = begin; i < end; i++) {
+        decoder.next(sample.time, sample.value);
+        if (sample.time != channel.samples[i].time ||
+            std::memcmp(&sample.value, &channel.samples[i].value, 8) != 0) {
+          std::fprintf(stderr, "%s: sample %zu didn't round trip\n",
+                       channel.name.c_str(), i);
+          return 1;
+        }
+      }
+      decodeTime += secondsSince(start);
+    }
+    std::printf("%-32s %6zu samples %8zu -> %7zu bytes (%.1fx, %.2f "
+                "bytes/sample)\n",
+                channel.name.c_str(), channel.samples.size(), raw, packed,
+                static_cast<double>(raw) / packed,
+                static_cast<double>(packed) / channel.samples.size());
+    totalRaw += raw;
+    totalPacked += packed;
+    totalSamples += channel.samples.size();
+  }
+  std::printf("total: %zu -> %zu bytes (%.1fx), encode %.0f ns/sample, "
+              "decode %.0f ns/sample\n",
+              totalRaw, totalPacked, static_cast<double>(totalRaw) / totalPacked,
+              encodeTime * 1e9 / totalSamples, decodeTime * 1e9 / totalSamples);
+  return 0;
+}
+
+// a few minutes of a robot's log, mostly the same messages with new numbers
+static std::vector<std::string> syntheticLog() {
+  const std::string format = "<CBLEVEL> <FILE>:<LINE> - <MESSAGE>";
+  std::vector<std::string> lines;
+  std::mt19937 random(7);
+  std::uniform_real_distribution<double> noise(-1.0, 1.0);
+  for (int i = 0; i < 100000; i++) {
+    std::uint32_t time = 1000 + i * 2;
+    ROBOTLOG::LogMessage msg(ROBOTLOG::Level::INFO, "", "", 0);
+    switch (i % 8) {
+    case 0:
+    case 1:
+      // what the example project logs in a loop
+      msg = ROBOTLOG::LogMessage(
+          ROBOTLOG::Level(i % 7),
+          "This is a log message with a custom level of " + std::to_string(i),
+          "main.cpp", 89, time);
+      break;
+    case 2:
+    case 3: {
+      std::vector<ROBOTLOG::Field> fields;
+      fields.emplace_back("x", std::round((12.0 + i * 0.01) * 100) / 100);
+      fields.emplace_back("y", std::round((-3.0 + noise(random)) * 100) / 100);
+      fields.emplace_back("heading", std::round(i * 0.05 * 10) / 10);
+      msg = ROBOTLOG::LogMessage(ROBOTLOG::Level::DATA, "pose", "odom.cpp", 42,
+                                 time, std::move(fields));
+      break;
+    }
+    case 4:
+      msg = ROBOTLOG::LogMessage(ROBOTLOG::Level::DEBUG,
+                                 "intake current " +
+                                     std::to_string(2000 + i % 500) + "mA",
+                                 "intake.cpp", 17, time);
+      break;
+    case 5:
+      msg = ROBOTLOG::LogMessage(
+          ROBOTLOG::Level::INFO,
+          "PID error " + std::to_string(noise(random) * 10) + " output " +
+              std::to_string(static_cast<int>(noise(random) * 127)),
+          "pid.cpp", 63, time);
+      break;
+    case 6:
+      msg = ROBOTLOG::LogMessage(ROBOTLOG::Level::WARNING,
+                                 "motor 4 temperature " +
+                                     std::to_string(45 + i / 10000) + "C",
+                                 "drive.cpp", 120, time);
+      break;
+    default:
+      msg = ROBOTLOG::LogMessage(ROBOTLOG::Level::INFO,
+                                 "auton step " + std::to_string(i % 12) +
+                                     " done after " + std::to_string(i % 997) +
+                                     "ms",
+                                 "auton.cpp", 210, time);
+      break;
+    }
+    lines.push_back(msg.format(format));
+  }
+  return lines;
+}
+
+// the lines of a text log, or the synthetic one if there's no path
+static bool loadLines(const char *path, std::vector<std::string> &lines) {
+  if (path == nullptr) {
+    lines = syntheticLog();
+    return true;
+  }
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    std::fprintf(stderr, "can't open %s\n", path);
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    lines.push_back(line);
+  }
+  if (lines.empty()) {
+    std::fprintf(stderr, "no lines\n");
+    return false;
+  }
+  return true;
+}
+
+static int benchDict(const char *path) {
+  std::vector<std::string> lines;
+  if (!loadLines(path, lines)) {
+    return 1;
+  }
+
+  std::size_t plain = 0;
+  for (const std::string &line : lines) {
+    plain += line.size() + 1;
+  }
+  std::string encoded;
+  ROBOTLOG::Dictionary::Encoder encoder;
+  Clock::time_point start = Clock::now();
+  encoder.start(&appendBytes, &encoded);
+  for (const std::string &line : lines) {
+    encoder.line(line, &appendBytes, &encoded);
+  }
+  double encodeTime = secondsSince(start);
+
+  ROBOTLOG::Dictionary::Decoder decoder;
+  std::string decoded;
+  std::size_t index = 0;
+  std::size_t mismatches = 0;
+  std::size_t templates = 0;
+  std::size_t lineStart = 0;
+  start = Clock::now();
+  while (lineStart < encoded.size()) {
+    std::size_t newline = encoded.find('\n', lineStart);
+    std::string_view line(encoded.data() + lineStart, newline - lineStart);
+    if (decoder.line(line, decoded)) {
+      if (index >= lines.size() || decoded != lines[index]) {
+        mismatches++;
+      }
+      index++;
+    } else if (line[0] == ROBOTLOG::Dictionary::DEFINE) {
+      templates++;
+    }
+    lineStart = newline + 1;
+  }
+  double decodeTime = secondsSince(start);
+
+  std::printf("dictionary: %zu lines, %zu templates\n", lines.size(),
+              templates);
+  std::printf("  plain   %9zu bytes, %.1f bytes/line\n", plain,
+              static_cast<double>(plain) / lines.size());
+  std::printf("  encoded %9zu bytes, %.1f bytes/line (%.2fx smaller)\n",
+              encoded.size(), static_cast<double>(encoded.size()) / lines.size(),
+              static_cast<double>(plain) / encoded.size());
+  std::printf("  encode %.0f ns/line, decode %.0f ns/line\n",
+              encodeTime * 1e9 / lines.size(), decodeTime * 1e9 / lines.size());
+  if (index != lines.size() || mismatches != 0) {
+    std::printf("  round trip FAILED: %zu of %zu lines decoded, %zu differ\n",
+                index, lines.size(), mismatches);
+    return 1;
+  }
+  std::printf("  round trip ok\n");
+  return 0;
+}
+
+struct FramedFile {
+  std::vector<std::uint8_t> bytes;
+  std::vector<std::size_t> blockEnds;
+};
+
+static void appendBlock(void *context, const char *data, std::size_t length) {
+  FramedFile *file = static_cast<FramedFile *>(context);
+  file->bytes.insert(file->bytes.end(), data, data + length);
+  file->blockEnds.push_back(file->bytes.size());
+}
+
+// frames the text the way TextFileSink does, one block at a time
+static FramedFile frameText(const std::string &plain, bool compress) {
+  FramedFile file;
+  ROBOTLOG::Frame::BlockWriter writer;
+  writer.setCompression(compress);
+  for (std::size_t offset = 0; offset < plain.size(); offset += 512) {
+    std::size_t length = std::min<std::size_t>(512, plain.size() - offset);
+    writer.append(plain.data() + offset, length, &appendBlock, &file);
+  }
+  writer.finish(&appendBlock, &file);
+  return file;
+}
+
+static void countBlock(void *context, const char *, std::size_t length) {
+  *static_cast<std::size_t *>(context) += length;
+}
+
+// how long framing the text takes, without storing any of it: the best of a
+// few runs, after one to warm the caches up
+static double timeFraming(const std::string &plain, bool compress,
+                          std::size_t &bytes) {
+  double best = 1e9;
+  for (int run = 0; run < 6; run++) {
+    bytes = 0;
+    Clock::time_point start = Clock::now();
+    ROBOTLOG::Frame::BlockWriter writer;
+    writer.setCompression(compress);
+    for (std::size_t offset = 0; offset < plain.size(); offset += 512) {
+      std::size_t length = std::min<std::size_t>(512, plain.size() - offset);
+      writer.append(plain.data() + offset, length, &countBlock, &bytes);
+    }
+    writer.finish(&countBlock, &bytes);
+    if (run > 0) {
+      best = std::min(best, secondsSince(start));
+    }
+  }
+  return best;
+}
+
+// the text back out of every block the scanner finds
+static std::string unframe(const std::uint8_t *file, std::size_t size,
+                           std::size_t &blocks) {
+  ROBOTLOG::Frame::Scanner scanner(file, size);
+  ROBOTLOG::Frame::Header header;
+  const std::uint8_t *payload;
+  std::uint8_t block[ROBOTLOG::Frame::BLOCK_SIZE];
+  std::string text;
+  blocks = 0;
+  while (scanner.next(header, payload)) {
+    std::size_t length = ROBOTLOG::Frame::decode(header, payload, block);
+    if (length != ROBOTLOG::LZ::ERROR) {
+      text.append(reinterpret_cast<const char *>(block), length);
+      blocks++;
+    }
+  }
+  return text;
+}
+
+static int benchLz(const char *path) {
+  std::vector<std::string> lines;
+  if (!loadLines(path, lines)) {
+    return 1;
+  }
+  std::string plain;
+  for (const std::string &line : lines) {
+    plain += line;
+    plain += '\n';
+  }
+
+  // framing without compression too, compressing means less to CRC so the
+  // difference is the real cost. Both only count the bytes they'd write, so
+  // neither pays for growing a buffer
+  std::size_t frameBytes, compressBytes;
+  double frameTime = timeFraming(plain, false, frameBytes);
+  double compressTime = timeFraming(plain, true, compressBytes);
+  FramedFile framed = frameText(plain, true);
+  std::vector<std::uint8_t> &file = framed.bytes;
+  std::vector<std::size_t> &blockEnds = framed.blockEnds;
+
+  std::size_t blocks;
+  Clock::time_point start = Clock::now();
+  std::string decoded = unframe(file.data(), file.size(), blocks);
+  double decompressTime = secondsSince(start);
+
+  // a power loss can cut the file anywhere, including inside a header
+  std::size_t truncationErrors = 0;
+  for (std::size_t b = 0; b < blockEnds.size(); b += 1 + blockEnds.size() / 64) {
+    std::size_t blockStart = b > 0 ? blockEnds[b - 1] : 0;
+    std::size_t cut = blockStart + (blockEnds[b] - blockStart) / 2;
+    std::size_t found;
+    std::string partial = unframe(file.data(), cut, found);
+    // every block before the one that was cut
+    if (found != b || plain.compare(0, partial.size(), partial) != 0) {
+      truncationErrors++;
+    }
+  }
+
+  double count = static_cast<double>(blockEnds.size());
+  double saved = static_cast<double>(plain.size()) - file.size();
+  std::printf("lz: %zu lines in %zu blocks of %zu bytes\n", lines.size(),
+              blockEnds.size(), ROBOTLOG::Frame::BLOCK_SIZE);
+  std::printf("  plain      %9zu bytes\n", plain.size());
+  std::printf("  compressed %9zu bytes (%.2fx smaller, %.0f KB saved)\n",
+              file.size(), static_cast<double>(plain.size()) / file.size(),
+              saved / 1024);
+  std::printf("  framing alone    %.1f us/block\n", frameTime * 1e6 / count);
+  std::printf("  with compression %.1f us/block, %.0f MB/s, %.2f us of extra "
+              "CPU per KB saved\n",
+              compressTime * 1e6 / count, plain.size() / 1e6 / compressTime,
+              (compressTime - frameTime) * 1e6 / (saved / 1024));
+  std::printf("  decompress %.0f MB/s\n", plain.size() / 1e6 / decompressTime);
+  if (decoded != plain || truncationErrors != 0 ||
+      compressBytes != file.size()) {
+    std::printf("  round trip FAILED (%zu truncation errors)\n",
+                truncationErrors);
+    return 1;
+  }
+  std::printf("  round trip ok, truncated files ok\n");
+  return 0;
+}
+
+// what the recovery scan costs on a badly damaged file
+static int benchRecover(const char *path) {
+  std::vector<std::string> lines;
+  if (!loadLines(path, lines)) {
+    return 1;
+  }
+  std::string plain;
+  for (const std::string &line : lines) {
+    plain += line;
+    plain += '\n';
+  }
+  FramedFile framed = frameText(plain, false);
+  std::vector<std::uint8_t> &clean = framed.bytes;
+  std::vector<std::size_t> &blockEnds = framed.blockEnds;
+
+  // junk between blocks (the card never finished a write), damaged blocks,
+  // and fake headers with the right magic
+  std::mt19937 random(11);
+  std::vector<std::uint8_t> damaged;
+  std::size_t damagedBlocks = 0;
+  std::size_t blockStart = 0;
+  for (std::size_t end : blockEnds) {
+    std::size_t before = damaged.size();
+    damaged.insert(damaged.end(), clean.begin() + blockStart,
+                   clean.begin() + end);
+    if (random() % 10 == 0) {
+      damaged[before + random() % (end - blockStart)] ^= 0x40;
+      damagedBlocks++;
+    }
+    if (random() % 10 == 0) {
+      for (int i = 0; i < 512; i++) {
+        damaged.push_back(i % 7 == 0 ? 'V' : i % 7 == 1 ? 'F' : random());
+      }
+    }
+    blockStart = end;
+  }
+
+  std::size_t blocks;
+  Clock::time_point start = Clock::now();
+  unframe(clean.data(), clean.size(), blocks);
+  double cleanTime = secondsSince(start);
+  start = Clock::now();
+  unframe(damaged.data(), damaged.size(), blocks);
+  double damagedTime = secondsSince(start);
+
+  std::printf("recover: %zu blocks, %zu damaged\n", blockEnds.size(),
+              damagedBlocks);
+  std::printf("  clean   %9zu bytes, %.0f MB/s\n", clean.size(),
+              clean.size() / 1e6 / cleanTime);
+  std::printf("  damaged %9zu bytes, %.0f MB/s, %zu blocks recovered\n",
+              damaged.size(), damaged.size() / 1e6 / damagedTime, blocks);
+  if (blocks != blockEnds.size() - damagedBlocks) {
+    std::printf("  FAILED, expected %zu blocks\n",
+                blockEnds.size() - damagedBlocks);
+    return 1;
+  }
+  std::printf("  every intact block recovered\n");
+  return 0;
+}
+
+// what SerialSink sends, damaged the ways a serial line damages it
+static int benchSerial(long records) {
+  std::vector<ROBOTLOG::LogMessage> messages = sampleMessages();
+  ROBOTLOG::RecordFramer framer;
+  std::uint8_t frame[ROBOTLOG::RecordFramer::MAX_FRAME];
+  std::vector<std::uint8_t> stream(1, ROBOTLOG::COBS::DELIMITER);
+  std::vector<std::vector<std::uint8_t>> wanted; // the intact records
+  std::string wantedText;
+  std::size_t badFrames = 0;
+  std::size_t skippedBytes = 0;
+  bool merging = false; // the frame before was cut short
+  for (long i = 0; i < records; i++) {
+    std::size_t length =
+        framer.frame(messages[i % messages.size()], frame, sizeof(frame));
+    if (length == 0) {
+      std::printf("serial: FAILED, a sample record didn't fit\n");
+      return 1;
+    }
+    if (merging) {
+      // the cut frame runs on into this one, and they're thrown away together
+      stream.insert(stream.end(), frame, frame + length);
+      skippedBytes += length;
+      merging = false;
+    } else if (i % 17 == 5 && (frame[length / 2] ^ 0x20) != 0) {
+      frame[length / 2] ^= 0x20; // a flipped bit, the CRC catches it
+      stream.insert(stream.end(), frame, frame + length);
+      badFrames++;
+      skippedBytes += length;
+    } else if (i % 23 == 11 && i + 1 < records) {
+      // bytes lost, delimiter and all
+      stream.insert(stream.end(), frame, frame + length / 2);
+      badFrames++;
+      skippedBytes += length / 2;
+      merging = true;
+    } else {
+      stream.insert(stream.end(), frame, frame + length);
+      std::vector<std::uint8_t> record(frame, frame + length - 1);
+      record.resize(ROBOTLOG::COBS::decode(record.data(), record.size()) -
+                    ROBOTLOG::COBS::CRC_SIZE);
+      wanted.push_back(std::move(record));
+      if (i % 10 == 0) {
+        std::string line = "battery " + std::to_string(i) + " mV\n";
+        stream.insert(stream.end(), line.begin(), line.end());
+        wantedText += line;
+      }
+    }
+  }
+
+  ROBOTLOG::COBS::Receiver receiver;
+  std::size_t matched = 0;
+  std::string text;
+  auto record = [&](const std::uint8_t *data, std::size_t size) {
+    if (matched < wanted.size() && wanted[matched].size() == size &&
+        std::equal(data, data + size, wanted[matched].begin())) {
+      matched++;
+    }
+  };
+  auto print = [&](const char *data, std::size_t size) {
+    text.append(data, size);
+  };
+  std::mt19937 random(7);
+  Clock::time_point start = Clock::now();
+  for (std::size_t offset = 0; offset < stream.size();) {
+    std::size_t piece =
+        std::min<std::size_t>(1 + random() % 300, stream.size() - offset);
+    receiver.feed(stream.data() + offset, piece, record, print);
+    offset += piece;
+  }
+  double elapsed = secondsSince(start);
+
+  std::printf("serial: %ld records, %zu bytes, %.0f MB/s\n", records,
+              stream.size(), stream.size() / 1e6 / elapsed);
+  std::printf("  %zu records, %zu bad frames, %zu bytes skipped, %zu bytes "
+              "of text\n",
+              receiver.records, receiver.badFrames, receiver.skippedBytes,
+              receiver.textBytes);
+  if (receiver.records != wanted.size() || matched != wanted.size() ||
+      receiver.badFrames != badFrames ||
+      receiver.skippedBytes != skippedBytes ||
+      receiver.textBytes != wantedText.size() || text != wantedText) {
+    std::printf("  FAILED, expected %zu records, %zu bad frames, %zu bytes "
+                "skipped, %zu bytes of text\n",
+                wanted.size(), badFrames, skippedBytes, wantedText.size());
+    return 1;
+  }
+  std::printf("  every intact record and line of text received\n");
+  return 0;
+}
+
+static int benchCorpus(const char *path, long megabytes, const char *format) {
+  std::vector<std::string> lines = syntheticLog();
+  std::filesystem::remove(path);
+  std::filesystem::remove(ROBOTLOG::TimeIndex::indexPath(path));
+  std::filesystem::remove(
+      std::string(path).substr(0, ROBOTLOG::extensionStart(path)) + ".idx");
+  ROBOTLOG::TextFileSink sink(path);
+  if (std::strcmp(format, "dict") == 0) {
+    sink.setDictionary(true);
+  } else if (std::strcmp(format, "framed") == 0) {
+    sink.setFraming(true);
+  } else if (std::strcmp(format, "compressed") == 0) {
+    sink.setCompression(true);
+    sink.setDictionary(true);
+  } else if (std::strcmp(format, "plain") != 0) {
+    std::fprintf(stderr, "unknown format %s\n", format);
+    return 1;
+  }
+  sink.setTimeIndex(16384);
+  ROBOTLOG::Session session;
+  session.mode = "driver";
+  sink.startSession(session);
+  std::size_t target = static_cast<std::size_t>(megabytes) << 20;
+  std::uint32_t time = 0;
+  std::size_t count = 0;
+  Clock::time_point start = Clock::now();
+  while (sink.getFileSize() < target) {
+    for (std::size_t i = 0; i < lines.size(); i++, count++) {
+      sink.writeLine(lines[i], time += 2);
+      if (i % 256 == 0) {
+        sink.flush();
+      }
+    }
+  }
+  sink.sync();
+  std::printf("corpus: %zu lines, %zu bytes of %s log in %.1f s\n", count,
+              sink.getFileSize(), format, secondsSince(start));
+  return 0;
+}
+
+static int benchSessions(long boots) {
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "vexlog-bench-sessions";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::string logPath = (dir / "main.txt").string();
+  std::string indexPath = (dir / "main.idx").string();
+  const char *failed = nullptr;
+  double startTime = 0;
+  for (long boot = 0; boot < boots && failed == nullptr; boot++) {
+    ROBOTLOG::TextFileSink sink(logPath, {4096, 16384, true});
+    sink.setTimeIndex(512);
+    ROBOTLOG::Session session;
+    session.mode = "driver";
+    Clock::time_point start = Clock::now();
+    std::uint32_t id = sink.startSession(session);
+    startTime += secondsSince(start);
+    if (id != static_cast<std::uint32_t>(boot)) {
+      failed = "session ids didn't go up by one";
+    }
+    for (int i = 0; i < 100; i++) {
+      ROBOTLOG::LogMessage msg(ROBOTLOG::Level::INFO,
+                               "line " + std::to_string(i), "auton.cpp", 7,
+                               static_cast<std::uint32_t>(i * 10));
+      sink.write(msg);
+    }
+    sink.flush();
+  }
+
+  std::size_t files = 0;
+  for (const std::filesystem::directory_entry &entry :
+       std::filesystem::directory_iterator(dir)) {
+    std::filesystem::path path = entry.path();
+    files += path.extension() == ".txt";
+    if (path.extension() == ".tix" &&
+        !std::filesystem::exists(path.replace_extension(".txt"))) {
+      failed = "a deleted file's time index was left behind";
+    }
+  }
+  std::vector<ROBOTLOG::SessionEntry> entries =
+      ROBOTLOG::SessionIndex(indexPath).load();
+  for (const ROBOTLOG::SessionEntry &entry : entries) {
+    if (!std::filesystem::exists(entry.file)) {
+      failed = "the index has sessions in deleted files";
+    }
+  }
+
+  // a power loss in the middle of writing an entry, on a log that doesn't
+  // rotate (rotating rewrites the index, which drops the cut line anyway)
+  std::string plainPath = (dir / "plain.txt").string();
+  std::string plainIndex = (dir / "plain.idx").string();
+  std::uint32_t id = 0;
+  for (int boot = 0; boot < 3; boot++) {
+    if (boot == 2) {
+      std::filesystem::resize_file(
+          plainIndex, std::filesystem::file_size(plainIndex) - 20);
+    }
+    ROBOTLOG::TextFileSink sink(plainPath);
+    ROBOTLOG::Session session;
+    id = sink.startSession(session);
+  }
+  std::vector<ROBOTLOG::SessionEntry> after =
+      ROBOTLOG::SessionIndex(plainIndex).load();
+  if (failed == nullptr &&
+      (after.size() != 2 || after.back().session.id != id)) {
+    failed = "an entry added after a cut short line didn't read back";
+  }
+
+  std::printf("sessions: %ld boots, %.0f us to start a session\n", boots,
+              startTime * 1e6 / boots);
+  std::printf("  %zu files and %zu sessions left in the index\n", files,
+              entries.size());
+  if (failed != nullptr) {
+    std::printf("  FAILED, %s\n", failed);
+    return 1;
+  }
+  std::printf("  ids, trimming and a cut short index ok\n");
+  return 0;
+}
+
+static int benchScan(const char *path) {
+  std::string text;
+  if (path != nullptr) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      std::fprintf(stderr, "can't open %s\n", path);
+      return 1;
+    }
+    text.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+  } else {
+    std::string once;
+    for (const std::string &line : syntheticLog()) {
+      once += line;
+      once += '\n';
+    }
+    while (text.size() < (256 << 20)) {
+      text += once;
+    }
+  }
+  std::vector<char> stripped(text.size());
+  std::vector<ROBOTLOG::Scan::Path> paths = {ROBOTLOG::Scan::Path::SCALAR};
+#ifdef ROBOTLOG_SCAN_X86
+  if (__builtin_cpu_supports("sse2")) {
+    paths.push_back(ROBOTLOG::Scan::Path::SSE2);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    paths.push_back(ROBOTLOG::Scan::Path::AVX2);
+  }
+#endif
+  std::printf("scan: %zu bytes, GB/s for each path\n", text.size());
+  std::printf("  %-8s %10s %10s %10s %10s %10s\n", "", "newlines", "count",
+              "[ERR]", "[WARN]", "colors");
+  std::size_t expected[5] = {};
+  bool agree = true;
+  for (ROBOTLOG::Scan::Path scanPath : paths) {
+    std::size_t found[5] = {};
+    double rates[5];
+    // the best of a few runs, a laptop's clock speed wanders
+    for (int kernel = 0; kernel < 5; kernel++) {
+      double best = 1e9;
+      for (int run = 0; run < 3; run++) {
+        Clock::time_point start = Clock::now();
+        std::size_t result = 0;
+        switch (kernel) {
+        case 0:
+          ROBOTLOG::Scan::eachByte(
+              text.data(), text.size(), '\n',
+              [&result](std::size_t at) { result += at & 1; }, scanPath);
+          break;
+        case 1:
+          result = ROBOTLOG::Scan::count(text.data(), text.size(), '\n',
+                                         scanPath);
+          break;
+        case 2:
+        case 3:
+          ROBOTLOG::Scan::eachToken(
+              text.data(), text.size(), kernel == 2 ? "[ERR]" : "[WARN]",
+              [&result](std::size_t) { result++; }, scanPath);
+          break;
+        default:
+          result = ROBOTLOG::Scan::stripColors(text.data(), text.size(),
+                                               stripped.data(), scanPath);
+        }
+        best = std::min(best, secondsSince(start));
+        found[kernel] = result;
+      }
+      rates[kernel] = text.size() / 1e9 / best;
+    }
+    std::printf("  %-8s %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+                ROBOTLOG::Scan::pathName(scanPath), rates[0], rates[1],
+                rates[2], rates[3], rates[4]);
+    if (scanPath == ROBOTLOG::Scan::Path::SCALAR) {
+      std::copy(found, found + 5, expected);
+    } else if (!std::equal(found, found + 5, expected)) {
+      agree = false;
+    }
+  }
+  std::printf("  %zu lines, %zu [ERR], %zu [WARN], %zu bytes without colors\n",
+              expected[1], expected[2], expected[3], expected[4]);
+  if (!agree) {
+    std::printf("  FAILED, the paths found different things\n");
+    return 1;
+  }
+  std::printf("  every path found the same things\n");
+  return 0;
+}
+
+static int benchMemory(long records) {
+  std::vector<ROBOTLOG::LogMessage> messages = sampleMessages();
+  for (ROBOTLOG::MemorySink::Format format :
+       {ROBOTLOG::MemorySink::TEXT, ROBOTLOG::MemorySink::BINARY}) {
+    ROBOTLOG::MemorySink sink(1 << 16, format);
+    std::size_t bytes = 0;
+    auto count = [&bytes](std::string_view record) {
+      bytes += record.size();
+    };
+    Clock::time_point start = Clock::now();
+    for (long i = 0; i < records; i++) {
+      sink.write(messages[i % messages.size()]);
+      if (i % 256 == 255) {
+        sink.drain(count);
+      }
+    }
+    sink.drain(count);
+    double elapsed = secondsSince(start);
+    std::printf("memory sink %s: %ld records, %.1f MB in %.3f s, %.0f "
+                "ns/record, %zu dropped\n",
+                format == ROBOTLOG::MemorySink::TEXT ? "text" : "cbor",
+                records, bytes / 1e6, elapsed, elapsed * 1e9 / records,
+                sink.getDropped());
+  }
+  return 0;
+}
+
+// a 10 ms loop during a match where things go wrong
+static std::vector<ROBOTLOG::LogMessage> faultStorm(long seconds) {
+  std::vector<ROBOTLOG::LogMessage> messages;
+  long ticks = seconds * 100;
+  for (long tick = 0; tick < ticks; tick++) {
+    std::uint32_t time = static_cast<std::uint32_t>(tick * 10);
+    if (tick % 50 == 0) {
+      messages.emplace_back(ROBOTLOG::Level::INFO,
+                            "auton step " + std::to_string(tick / 50),
+                            "auton.cpp", 88, time);
+    }
+    if (tick < ticks / 2) {
+      // the same call site, the same words, every loop
+      std::vector<ROBOTLOG::Field> fields;
+      fields.emplace_back("port", 3);
+      messages.emplace_back(ROBOTLOG::Level::WARN, "imu disconnected",
+                            "odom.cpp", 57, time, std::move(fields));
+    } else {
+      // two call sites taking turns, which never makes a run
+      messages.emplace_back(ROBOTLOG::Level::WARN, "left motor over temp",
+                            "drive.cpp", 120, time);
+      messages.emplace_back(ROBOTLOG::Level::WARN, "right motor over temp",
+                            "drive.cpp", 121, time);
+    }
+  }
+  return messages;
+}
+
+static int benchRepeats(long seconds) {
+  std::vector<ROBOTLOG::LogMessage> messages = faultStorm(seconds);
+  const std::string format = "<TIME> <BLEVEL> <FILE>:<LINE> - <MESSAGE>";
+  for (bool collapse : {false, true}) {
+    ROBOTLOG::RepeatFilter filter;
+    std::size_t lines = 0;
+    std::size_t bytes = 0;
+    auto write = [&](ROBOTLOG::LogMessage &msg) {
+      lines++;
+      bytes += msg.format(format).size() + 1;
+    };
+    Clock::time_point start = Clock::now();
+    for (ROBOTLOG::LogMessage &msg : messages) {
+      if (collapse) {
+        std::optional<ROBOTLOG::LogMessage> summary;
+        bool admitted = filter.admit(msg, summary);
+        if (summary) {
+          write(*summary);
+        }
+        if (!admitted) {
+          continue;
+        }
+      }
+      write(msg);
+      if (collapse) {
+        std::optional<ROBOTLOG::LogMessage> summary =
+            filter.due(msg.getTime());
+        if (summary) {
+          write(*summary);
+        }
+      }
+    }
+    double elapsed = secondsSince(start);
+    std::printf("%s: %zu messages, %zu lines, %zu bytes, %.0f ns/message\n",
+                collapse ? "collapsed" : "as is    ", messages.size(), lines,
+                bytes, elapsed * 1e9 / messages.size());
+    if (collapse) {
+      std::printf("%llu repeats collapsed\n",
+                  static_cast<unsigned long long>(filter.getCollapsed()));
+    }
+  }
+  return 0;
+}
+
+// a screen and a clock for ScreenRing that only exist in memory
+struct FakeScreen {
+  std::vector<std::string> rows =
+      std::vector<std::string>(ROBOTLOG::ScreenRing::MAX_ROWS);
+  std::size_t draws = 0;
+};
+
+static std::uint64_t fakeNowUs = 0;
+
+static std::uint64_t fakeClock() { return fakeNowUs; }
+
+static void fakeDraw(void *context, std::size_t row, const char *text,
+                     ROBOTLOG::Level) {
+  FakeScreen *screen = static_cast<FakeScreen *>(context);
+  screen->rows[row] = text;
+  screen->draws++;
+  fakeNowUs += 250; // drawing a row takes a while on a brain
+}
+
+static ROBOTLOG::LogMessage screenLine(long i) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "line %06ld", i);
+  return ROBOTLOG::LogMessage(ROBOTLOG::Level::INFO, text, "auton.cpp", 7,
+                              static_cast<std::uint32_t>(fakeNowUs / 1000));
+}
+
+static int benchScreen(long messages) {
+  constexpr std::size_t ROWS = ROBOTLOG::ScreenRing::MAX_ROWS;
+  FakeScreen fake;
+  ROBOTLOG::ScreenRing screen(ROWS, 10);
+  screen.setOutput(&fakeDraw, &fake);
+  screen.setClock(&fakeClock);
+  fakeNowUs = 1000000;
+
+  // a few lines, the first frame only draws their rows
+  for (long i = 0; i < 5; i++) {
+    ROBOTLOG::LogMessage msg = screenLine(i);
+    screen.write(msg);
+  }
+  screen.flush();
+  const char *failed = nullptr;
+  if (screen.getStats().frames != 1 || fake.draws != 5) {
+    failed = "the first frame didn't draw just the new rows";
+  } else if (screen.getStats().lastFrameUs != 5 * 250) {
+    failed = "the frame wasn't timed with the clock it was given";
+  }
+
+  // a burst inside one frame's time is held back, then drawn at once
+  for (long i = 5; i < 40 && failed == nullptr; i++) {
+    ROBOTLOG::LogMessage msg = screenLine(i);
+    screen.write(msg);
+    screen.flush();
+    fakeNowUs += 1000;
+  }
+  if (failed == nullptr && screen.getStats().frames != 1) {
+    failed = "frames weren't held to the frame rate";
+  }
+  fakeNowUs += 100000;
+  screen.flush();
+  for (std::size_t row = 0; row < ROWS && failed == nullptr; row++) {
+    char wanted[32];
+    std::snprintf(wanted, sizeof(wanted), "line %06ld",
+                  static_cast<long>(40 - ROWS + row));
+    if (fake.rows[row].size() != ROBOTLOG::ScreenRing::COLUMNS ||
+        fake.rows[row].find(wanted) == std::string::npos) {
+      failed = "the screen doesn't show the newest lines, oldest on top";
+    }
+  }
+  if (failed == nullptr && (screen.getStats().frames != 2 ||
+                            screen.getStats().rowsDrawn != 5 + ROWS)) {
+    failed = "the burst took more than one frame";
+  }
+  // nothing new, nothing drawn
+  fakeNowUs += 1000000;
+  screen.flush();
+  if (failed == nullptr &&
+      (screen.getStats().frames != 2 || screen.hasPending())) {
+    failed = "a frame was drawn with nothing new";
+  }
+  if (failed != nullptr) {
+    std::printf("screen: FAILED, %s\n", failed);
+    return 1;
+  }
+
+  // a 10 ms loop logging a few lines each time
+  std::size_t drawsBefore = fake.draws;
+  Clock::time_point start = Clock::now();
+  for (long i = 0; i < messages; i++) {
+    ROBOTLOG::LogMessage msg = screenLine(i);
+    screen.write(msg);
+    if (i % 4 == 3) {
+      fakeNowUs += 10000;
+      screen.flush();
+    }
+  }
+  double elapsed = secondsSince(start);
+  const ROBOTLOG::ScreenRing::Stats &stats = screen.getStats();
+  std::printf("screen: %ld messages, %.0f ns/message with the redraws\n",
+              messages, elapsed * 1e9 / messages);
+  std::printf("  %zu frames, %zu rows drawn (%.1f a frame), %.2f rows drawn "
+              "per message\n",
+              stats.frames, stats.rowsDrawn,
+              static_cast<double>(stats.rowsDrawn) / stats.frames,
+              static_cast<double>(fake.draws - drawsBefore) / messages);
+  std::printf("  frame rate, changed rows and scrolling ok\n");
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && std::strcmp(argv[1], "json") == 0) {
+    return benchJson(argc >= 3 ? std::atol(argv[2]) : 2000000);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "columns") == 0) {
+    return benchColumns(argc >= 3 ? std::atol(argv[2]) : 120);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "gorilla") == 0) {
+    return benchGorilla(argc >= 3 ? argv[2] : nullptr);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "dict") == 0) {
+    return benchDict(argc >= 3 ? argv[2] : nullptr);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "lz") == 0) {
+    return benchLz(argc >= 3 ? argv[2] : nullptr);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "recover") == 0) {
+    return benchRecover(argc >= 3 ? argv[2] : nullptr);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "serial") == 0) {
+    return benchSerial(argc >= 3 ? std::atol(argv[2]) : 200000);
+  }
+  if (argc >= 3 && std::strcmp(argv[1], "corpus") == 0) {
+    return benchCorpus(argv[2], argc >= 4 ? std::atol(argv[3]) : 1024,
+                       argc >= 5 ? argv[4] : "plain");
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "sessions") == 0) {
+    return benchSessions(argc >= 3 ? std::atol(argv[2]) : 200);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "scan") == 0) {
+    return benchScan(argc >= 3 ? argv[2] : nullptr);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "memory") == 0) {
+    return benchMemory(argc >= 3 ? std::atol(argv[2]) : 200000);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "repeats") == 0) {
+    return benchRepeats(argc >= 3 ? std::atol(argv[2]) : 120);
+  }
+  if (argc >= 2 && std::strcmp(argv[1], "screen") == 0) {
+    return benchScreen(argc >= 3 ? std::atol(argv[2]) : 200000);
+  }
+  std::fprintf(stderr,
+               "usage: %s json [records]\n       %s columns [seconds]\n"
+               "       %s gorilla [file.vxc]\n       %s dict [log.txt]\n"
+               "       %s lz [log.txt]\n       %s recover [log.txt]\n"
+               "       %s serial [records]\n"
+               "       %s corpus <out.txt> [MB] [plain|dict|framed|compressed]\n"
+               "       %s sessions [boots]\n"
+               "       %s scan [log.txt]\n       %s memory [records]\n"
+               "       %s repeats [seconds]\n       %s screen [messages]\n",
+               argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+               argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+  return 1;
+}
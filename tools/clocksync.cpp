@@ -0,0 +1,274 @@
+/*
+ * vexlog-clocksync: fit the brain's clock against another one, from the
+ * sync records in a log
+ *
+ * Build (from the repo root):
+ *   g++ -std=c++20 -O2 -Iinclude tools/clocksync.cpp -o vexlog-clocksync
+ *
+ * Usage:
+ *   vexlog-clocksync [--name <clock>] [--per-ms <n>] [file...]
+ *     --name <clock>    only this clock (every clock in the log by default)
+ *     --per-ms <n>      how many of the other clock's units are one of its
+ *                       log's milliseconds (1000 for a microsecond counter),
+ *                       default 1
+ *
+ * Reads the records logger.syncClock() and logger.syncSerial() write, from
+ * text or JSON lines files (or stdin) and CborFileSink files. Framed,
+ * compressed or dictionary logs can be piped through
+ * `vexlog-query --level DATA` first.
+ *
+ * For each clock it fits brain_ms = ext_ms * (1 + drift) + offset by least
+ * squares, weighting every pair by how exactly it was timed (window_us), then
+ * fits again without the pairs that were way off (the worker was held up,
+ * the line was garbled). Prints the fit, how far the pairs are from it, and
+ * the --offset/--drift to give vexlog-merge for that device's log.
+ */
+#include "robotlog/cbor.h"
+#include "robotlog/clocksync.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// windows are at least this wide, no pair is timed better than the clocks
+constexpr double MIN_WINDOW_US = 20;
+
+struct Pair {
+  double brainMs;
+  double extMs;
+  double weight;
+};
+
+struct Fit {
+  double slope = 1;
+  double offset = 0;
+  double rms = 0;   // ms
+  double worst = 0; // ms
+  std::size_t used = 0;
+};
+
+static bool fieldNumber(std::string_view text, std::string_view key,
+                        double &value) {
+  std::size_t at = text.find(key);
+  if (at == std::string_view::npos) {
+    return false;
+  }
+  value = std::strtod(std::string(text.substr(at + key.size(), 24)).c_str(),
+                      nullptr);
+  return true;
+}
+
+static void addPair(std::map<std::string, std::vector<Pair>> &clocks,
+                    const std::string &name, double brainUs, double ext,
+                    double windowUs, double perMs) {
+  double window = std::max(windowUs, MIN_WINDOW_US) / 1000;
+  // a window is a uniform spread, its variance is width^2 / 12
+  clocks[name].push_back(
+      {brainUs / 1000, ext / perMs, 12 / (window * window)});
+}
+
+// "name brain_us=1 ext=2 window_us=3" from a text log, or a JSON line with
+// those fields
+static void readLine(std::string_view line,
+                     std::map<std::string, std::vector<Pair>> &clocks,
+                     double perMs) {
+  double brainUs, ext, windowUs = 0;
+  std::string name;
+  if (line.starts_with('{')) {
+    if (line.find("\"file\":\"clock_sync\"") == std::string_view::npos ||
+        !fieldNumber(line, "\"brain_us\":", brainUs) ||
+        !fieldNumber(line, "\"ext\":", ext)) {
+      return;
+    }
+    fieldNumber(line, "\"window_us\":", windowUs);
+    std::size_t msg = line.find("\"msg\":\"");
+    if (msg != std::string_view::npos) {
+      msg += 7;
+      name = std::string(line.substr(msg, line.find('"', msg) - msg));
+    }
+  } else {
+    std::size_t fields = line.find(" brain_us=");
+    if (fields == std::string_view::npos ||
+        !fieldNumber(line, " brain_us=", brainUs) ||
+        !fieldNumber(line, " ext=", ext)) {
+      return;
+    }
+    fieldNumber(line, " window_us=", windowUs);
+    name = std::string(line.substr(0, fields));
+  }
+  addPair(clocks, name, brainUs, ext, windowUs, perMs);
+}
+
+static void readCbor(const std::string &data,
+                     std::map<std::string, std::vector<Pair>> &clocks,
+                     double perMs) {
+  ROBOTLOG::CBOR::Reader reader(data.data(), data.size());
+  std::unordered_set<std::string> keys;
+  ROBOTLOG::LogMessage msg(ROBOTLOG::DATA, "", "", 0);
+  while (reader.record(msg, keys)) {
+    if (msg.getFile() != ROBOTLOG::CLOCK_SYNC_FILE) {
+      continue;
+    }
+    double values[3] = {0, 0, 0};
+    bool found[3] = {false, false, false};
+    for (const ROBOTLOG::Field &field : msg.getFields()) {
+      const char *names[] = {"brain_us", "ext", "window_us"};
+      for (int i = 0; i < 3; i++) {
+        if (std::strcmp(field.key, names[i]) == 0) {
+          found[i] = true;
+          values[i] = field.type == ROBOTLOG::Field::DOUBLE
+                          ? field.d
+                          : static_cast<double>(field.i);
+        }
+      }
+    }
+    if (found[0] && found[1]) {
+      addPair(clocks, msg.getMessage(), values[0], values[1], values[2],
+              perMs);
+    }
+  }
+}
+
+// weighted least squares through the pairs that aren't skipped, centered so
+// millions of ms don't cost any precision
+static Fit fitLine(const std::vector<Pair> &pairs,
+                   const std::vector<bool> &skip) {
+  long double sw = 0, sx = 0, sy = 0;
+  for (std::size_t i = 0; i < pairs.size(); i++) {
+    if (!skip[i]) {
+      sw += pairs[i].weight;
+      sx += pairs[i].weight * pairs[i].extMs;
+      sy += pairs[i].weight * pairs[i].brainMs;
+    }
+  }
+  Fit fit;
+  if (sw == 0) {
+    return fit;
+  }
+  long double mx = sx / sw, my = sy / sw;
+  long double sxx = 0, sxy = 0;
+  for (std::size_t i = 0; i < pairs.size(); i++) {
+    if (!skip[i]) {
+      long double dx = pairs[i].extMs - mx;
+      sxx += pairs[i].weight * dx * dx;
+      sxy += pairs[i].weight * dx * (pairs[i].brainMs - my);
+    }
+  }
+  long double slope = sxx > 0 ? sxy / sxx : 1;
+  fit.slope = static_cast<double>(slope);
+  fit.offset = static_cast<double>(my - slope * mx);
+  long double squares = 0;
+  for (std::size_t i = 0; i < pairs.size(); i++) {
+    if (!skip[i]) {
+      double residual = pairs[i].brainMs -
+                        (fit.slope * pairs[i].extMs + fit.offset);
+      squares += residual * residual;
+      fit.worst = std::max(fit.worst, std::fabs(residual));
+      fit.used++;
+    }
+  }
+  fit.rms = static_cast<double>(std::sqrt(squares / fit.used));
+  return fit;
+}
+
+int main(int argc, char **argv) {
+  std::string only;
+  double perMs = 1;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+      only = argv[++i];
+    } else if (std::strcmp(argv[i], "--per-ms") == 0 && i + 1 < argc) {
+      perMs = std::strtod(argv[++i], nullptr);
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (perMs <= 0) {
+    std::fprintf(stderr,
+                 "usage: %s [--name <clock>] [--per-ms <n>] [file...]\n",
+                 argv[0]);
+    return 1;
+  }
+
+  std::map<std::string, std::vector<Pair>> clocks;
+  if (paths.empty()) {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      readLine(line, clocks, perMs);
+    }
+  }
+  for (const std::string &path : paths) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+      std::fprintf(stderr, "can't open %s\n", path.c_str());
+      return 1;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    if (data.size() >= 3 && static_cast<unsigned char>(data[0]) == 0xD9 &&
+        static_cast<unsigned char>(data[1]) == 0xD9 &&
+        static_cast<unsigned char>(data[2]) == 0xF7) {
+      readCbor(data, clocks, perMs);
+      continue;
+    }
+    std::size_t start = 0;
+    while (start < data.size()) {
+      std::size_t newline = data.find('\n', start);
+      newline = newline == std::string::npos ? data.size() : newline;
+      readLine(std::string_view(data).substr(start, newline - start), clocks,
+               perMs);
+      start = newline + 1;
+    }
+  }
+
+  std::size_t fitted = 0;
+  for (auto &[name, pairs] : clocks) {
+    if ((!only.empty() && name != only) || pairs.size() < 2) {
+      continue;
+    }
+    std::vector<bool> skip(pairs.size(), false);
+    Fit fit = fitLine(pairs, skip);
+    // pairs further off than their own window and a few times the spread
+    // can't be right, fit again without them
+    std::size_t dropped = 0;
+    for (std::size_t i = 0; i < pairs.size(); i++) {
+      double residual =
+          pairs[i].brainMs - (fit.slope * pairs[i].extMs + fit.offset);
+      double window = std::sqrt(12 / pairs[i].weight);
+      if (std::fabs(residual) > std::max(4 * fit.rms, window)) {
+        skip[i] = true;
+        dropped++;
+      }
+    }
+    if (dropped > 0 && dropped < pairs.size() - 1) {
+      fit = fitLine(pairs, skip);
+    }
+    double drift = (fit.slope - 1) * 1e6;
+    std::printf("%s: %zu pairs (%zu left out) over %.1f s\n", name.c_str(),
+                fit.used, pairs.size() - fit.used,
+                (pairs.back().brainMs - pairs.front().brainMs) / 1000);
+    std::printf("  brain_ms = ext_ms * %.9f %c %.3f\n", fit.slope,
+                fit.offset < 0 ? '-' : '+', std::fabs(fit.offset));
+    std::printf("  drift %+.2f ppm, pairs within %.3f ms (rms), %.3f ms "
+                "(worst)\n",
+                drift, fit.rms, fit.worst);
+    std::printf("  vexlog-merge ... --offset %.3f --drift %.2f <%s's log>\n",
+                fit.offset, drift, name.c_str());
+    fitted++;
+  }
+  if (fitted == 0) {
+    std::fprintf(stderr, "no clock sync records%s%s\n",
+                 only.empty() ? "" : " for ", only.c_str());
+    return 1;
+  }
+  return 0;
+}
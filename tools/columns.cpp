@@ -0,0 +1,63 @@
+/*
+ * vexlog-columns: read channels out of a ColumnarSink file
+ *
+ * Build (from the repo root):
+ *   g++ -std=c++20 -O2 -Iinclude tools/columns.cpp -o vexlog-columns
+ *
+ * Usage:
+ *   vexlog-columns <file.vxc>            list the channels in the file
+ *   vexlog-columns <file.vxc> <channel>  print one channel as CSV (t,value)
+ *
+ * The file is memory mapped, so loading one channel only reads that channel's
+ * chunks (plus the index).
+ */
+#include "robotlog/columnar.h"
+#include <charconv>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s <file.vxc> [channel]\n", argv[0]);
+    return 1;
+  }
+  int fd = open(argv[1], O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    std::fprintf(stderr, "can't open %s\n", argv[1]);
+    return 1;
+  }
+  if (info.st_size == 0) {
+    return 0;
+  }
+  void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    std::fprintf(stderr, "can't map %s\n", argv[1]);
+    return 1;
+  }
+
+  ROBOTLOG::Columnar::Reader reader(data, info.st_size);
+  if (!reader.usedIndex()) {
+    std::fprintf(stderr, "no index (file wasn't closed), walked the chunks\n");
+  }
+  if (argc < 3) {
+    for (const std::string &name : reader.channels()) {
+      std::printf("%s\n", name.c_str());
+    }
+  } else {
+    std::vector<ROBOTLOG::Columnar::Sample> samples = reader.load(argv[2]);
+    std::printf("t,%s\n", argv[2]);
+    char digits[32];
+    for (const ROBOTLOG::Columnar::Sample &sample : samples) {
+      auto result = std::to_chars(digits, digits + sizeof(digits), sample.value);
+      *result.ptr = '\0';
+      std::printf("%u,%s\n", sample.time, digits);
+    }
+  }
+  munmap(data, info.st_size);
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * vexlog-convert: turn binary VexLog files into JSON lines, CSV or text
+ *
+ * Build (from the repo root):
+ *   g++ -std=c++20 -O2 -Iinclude tools/convert.cpp -o vexlog-convert
+ *
+ * Usage:
+ *   vexlog-convert [--json|--csv] <file.cbor>
+ *   vexlog-convert --text <log.txt>
+ *
+ * --text turns a log file written with setFileDictionary(true) back into the
+ * plain text lines, anything that was already plain text is passed through.
+ * JSON output is the same as the JsonLinesSink writes. CSV output has one
+ * column per field name seen anywhere in the file, empty where a record didn't
+ * have that field.
+ */
+#include "robotlog/cbor.h"
+#include "robotlog/dictionary.h"
+#include "robotlog/json.h"
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+static void writeStdout(void *, const char *data, std::size_t length) {
+  std::fwrite(data, 1, length, stdout);
+}
+
+static void csvText(std::string_view text) {
+  std::fputc('"', stdout);
+  for (char c : text) {
+    if (c == '"') {
+      std::fputc('"', stdout);
+    }
+    std::fputc(c, stdout);
+  }
+  std::fputc('"', stdout);
+}
+
+static void csvField(const ROBOTLOG::Field &field) {
+  char digits[32];
+  switch (field.type) {
+  case ROBOTLOG::Field::BOOL:
+    std::fputs(field.b ? "true" : "false", stdout);
+    break;
+  case ROBOTLOG::Field::INT: {
+    auto result = std::to_chars(digits, digits + sizeof(digits), field.i);
+    std::fwrite(digits, 1, result.ptr - digits, stdout);
+    break;
+  }
+  case ROBOTLOG::Field::DOUBLE: {
+    // shortest text that reads back as the same double
+    auto result = std::to_chars(digits, digits + sizeof(digits), field.d);
+    std::fwrite(digits, 1, result.ptr - digits, stdout);
+    break;
+  }
+  case ROBOTLOG::Field::STRING:
+    csvText(field.s);
+    break;
+  default:
+    break;
+  }
+}
+
+static int decodeText(const std::vector<char> &data) {
+  ROBOTLOG::Dictionary::Decoder decoder;
+  std::string line;
+  std::size_t lines = 0;
+  std::size_t start = 0;
+  while (start < data.size()) {
+    const char *begin = data.data() + start;
+    const char *newline = static_cast<const char *>(
+        std::memchr(begin, '\n', data.size() - start));
+    std::size_t length =
+        newline != nullptr ? newline - begin : data.size() - start;
+    if (decoder.line(std::string_view(begin, length), line)) {
+      line.push_back('\n');
+      std::fwrite(line.data(), 1, line.size(), stdout);
+      lines++;
+    }
+    start += length + 1;
+  }
+  std::fprintf(stderr, "%zu lines\n", lines);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  bool csv = false;
+  bool text = false;
+  const char *path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else if (std::strcmp(argv[i], "--json") == 0) {
+      csv = false;
+    } else if (std::strcmp(argv[i], "--text") == 0) {
+      text = true;
+    } else {
+      path = argv[i];
+    }
+  }
+  if (path == nullptr) {
+    std::fprintf(stderr,
+                 "usage: %s [--json|--csv] <file.cbor>\n"
+                 "       %s --text <log.txt>\n",
+                 argv[0], argv[0]);
+    return 1;
+  }
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    std::fprintf(stderr, "can't open %s\n", path);
+    return 1;
+  }
+  std::vector<char> data((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  if (text) {
+    return decodeText(data);
+  }
+
+  std::unordered_set<std::string> keys;
+  ROBOTLOG::LogMessage msg(ROBOTLOG::Level::INFO, "", "", 0);
+  ROBOTLOG::CBOR::Reader reader(data.data(), data.size());
+  std::size_t records = 0;
+
+  if (!csv) {
+    char buffer[4096];
+    ROBOTLOG::JSON::JsonWriter writer(buffer, sizeof(buffer), &writeStdout,
+                                      nullptr);
+    while (reader.record(msg, keys)) {
+      writer.record(msg);
+      records++;
+    }
+    writer.drain();
+  } else {
+    // first pass only finds the columns
+    std::vector<std::string> columns;
+    while (reader.record(msg, keys)) {
+      for (const ROBOTLOG::Field &field : msg.getFields()) {
+        bool seen = false;
+        for (const std::string &column : columns) {
+          seen = seen || column == field.key;
+        }
+        if (!seen) {
+          columns.push_back(field.key);
+        }
+      }
+    }
+    std::fputs("t,level,file,line,msg", stdout);
+    for (const std::string &column : columns) {
+      std::fputc(',', stdout);
+      csvText(column);
+    }
+    std::fputc('\n', stdout);
+
+    reader = ROBOTLOG::CBOR::Reader(data.data(), data.size());
+    while (reader.record(msg, keys)) {
+      const char *level = ROBOTLOG::LogMessage::levelName(msg.getLevel());
+      std::printf("%u,", msg.getTime());
+      if (level != nullptr) {
+        std::fputs(level, stdout);
+      } else {
+        std::printf("%d", static_cast<int>(msg.getLevel()));
+      }
+      std::fputc(',', stdout);
+      csvText(msg.getFileView());
+      std::printf(",%d,", msg.getLineNumber());
+      csvText(msg.getMessageView());
+      for (const std::string &column : columns) {
+        std::fputc(',', stdout);
+        for (const ROBOTLOG::Field &field : msg.getFields()) {
+          if (column == field.key) {
+            csvField(field);
+            break;
+          }
+        }
+      }
+      std::fputc('\n', stdout);
+      records++;
+    }
+  }
+
+  if (!reader.atEnd()) {
+    std::fprintf(stderr, "stopped at byte %zu of %zu (truncated or corrupt)\n",
+                 reader.position(), data.size());
+  }
+  std::fprintf(stderr, "%zu records\n", records);
+  return 0;
+}
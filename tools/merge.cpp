@@ -0,0 +1,688 @@
+/*
+ * vexlog-merge: merge any number of logs into one timeline
+ *
+ * Build (from the repo root):
+ *   g++ -std=c++20 -O2 -Iinclude tools/merge.cpp -o vexlog-merge
+ *
+ * Usage:
+ *   vexlog-merge [options] <file>... [--offset <ms>] [--drift <ppm>] <file>...
+ *     --offset <ms>     add this to the times of the files after it
+ *     --drift <ppm>     and stretch them by this many parts per million
+ *                       (both stay set for every file after them)
+ *     --json            write JSON lines instead of text
+ *     --cbor <out>      write a CborFileSink file instead of text
+ *     --stats           print how much was read, and peak memory, to stderr
+ *
+ * Reads text logs (plain, dictionary, framed and compressed, mixed within a
+ * file too if its .idx is next to it), JsonLinesSink files and CborFileSink
+ * files, and writes the records of all of them in time order, with the
+ * clocks corrected by --offset/--drift (e.g. a coprocessor's, see the brain's
+ * time in its first line). Text output puts the time and the file's name in
+ * front of every line.
+ *
+ * Every file is read front to back, and only its next record waits in a heap,
+ * so memory doesn't grow with the files: each is mapped and the pages behind
+ * where it's been read to are dropped every few MB, and apart from that a file
+ * only needs its current block and its dictionary. Hundreds of files are fine.
+ *
+ * JSON and CBOR records have their own times. Text lines only have one if the
+ * format string starts with <TIME>, otherwise they get the time of the .tix
+ * index entry before them (see setFileTimeIndex()), which is only as exact
+ * as the index is dense. Lines with neither (DATA lines) go with the line
+ * before. Millis restart every boot, so when a file's times jump back (a new
+ * session) the rest of it is put after what came before, each file stays in
+ * its own order.
+ */
+#include "robotlog/cbor.h"
+#include "robotlog/dictionary.h"
+#include "robotlog/frame.h"
+#include "robotlog/json.h"
+#include "robotlog/logparse.h"
+#include "robotlog/session.h"
+#include "robotlog/timeindex.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <optional>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+// a jump back of more than this is a new session, less is tasks logging out
+// of order
+constexpr std::uint32_t RESTART_MS = 1000;
+// how much of a file is read before the pages behind get dropped, times the
+// number of files is about as much of them as is ever in memory
+constexpr std::uint64_t RELEASE_BYTES = 256 << 10;
+constexpr std::size_t OUT_BYTES = 1 << 20;
+
+enum class Kind { TEXT, JSON, CBOR };
+enum class Output { TEXT, JSON, CBOR };
+
+using ROBOTLOG::LogParse::baseName;
+using ROBOTLOG::LogParse::leadingTime;
+using ROBOTLOG::LogParse::parseNumber;
+using ROBOTLOG::LogParse::Region;
+using ROBOTLOG::LogParse::startsWith;
+
+// a level no tool knows the name of is written out as DATA, the records it
+// goes into need a level
+static ROBOTLOG::Level outputLevel(int level) {
+  return static_cast<ROBOTLOG::Level>(
+      level == ROBOTLOG::LogParse::NO_LEVEL ? ROBOTLOG::DATA : level);
+}
+
+// "[LEVEL] file:line - message" back into a message, anything else is DATA
+static ROBOTLOG::LogMessage parseText(std::string_view text,
+                                      std::uint32_t time) {
+  ROBOTLOG::LogParse::Record record = ROBOTLOG::LogParse::parseTextBody(text);
+  return ROBOTLOG::LogMessage(outputLevel(record.level),
+                              std::string(record.message),
+                              std::string(record.file), record.line, time);
+}
+
+// the string starting at i (on its opening quote), unescaped
+static std::string jsonString(std::string_view text, std::size_t &i) {
+  return ROBOTLOG::LogParse::unescapeJson(
+      ROBOTLOG::LogParse::jsonString(text, i));
+}
+
+// Field only points at its key, so each distinct one is kept here
+static const char *keyFor(std::deque<std::string> &keys, std::string key) {
+  for (const std::string &known : keys) {
+    if (known == key) {
+      return known.c_str();
+    }
+  }
+  return keys.emplace_back(std::move(key)).c_str();
+}
+
+// the fixed layout JSON::JsonWriter::record() writes, from just after "t"
+static void parseJson(std::string_view line, std::size_t i,
+                      std::uint32_t time, ROBOTLOG::LogMessage &msg,
+                      std::deque<std::string> &keys) {
+  int level = ROBOTLOG::DATA;
+  std::string file, message;
+  int number = 0;
+  std::vector<ROBOTLOG::Field> fields;
+  if (startsWith(line, i, ",\"level\":")) {
+    i += 9;
+    level = i < line.size() && line[i] == '"'
+                ? ROBOTLOG::LogParse::parseLevel(jsonString(line, i))
+                : static_cast<int>(parseNumber(line, i));
+  }
+  if (startsWith(line, i, ",\"file\":")) {
+    i += 8;
+    file = jsonString(line, i);
+  }
+  if (startsWith(line, i, ",\"line\":")) {
+    i += 8;
+    number = static_cast<int>(parseNumber(line, i));
+  }
+  if (startsWith(line, i, ",\"msg\":")) {
+    i += 7;
+    message = jsonString(line, i);
+  }
+  if (startsWith(line, i, ",\"fields\":{")) {
+    i += 11;
+    while (i < line.size() && line[i] == '"') {
+      const char *key = keyFor(keys, jsonString(line, i));
+      i++; // the colon
+      if (i < line.size() && line[i] == '"') {
+        fields.emplace_back(key, jsonString(line, i));
+      } else if (startsWith(line, i, "true") || startsWith(line, i, "false")) {
+        fields.emplace_back(key, line[i] == 't');
+        i += line[i] == 't' ? 4 : 5;
+      } else {
+        std::size_t end = line.find_first_of(",}", i);
+        std::string_view value = line.substr(i, end - i);
+        if (value.find_first_of(".eE") != std::string_view::npos) {
+          fields.emplace_back(key, std::strtod(std::string(value).c_str(),
+                                               nullptr));
+        } else if (value != "null") {
+          std::size_t at = 0;
+          fields.emplace_back(key, parseNumber(value, at));
+        }
+        i = end;
+      }
+      i += i < line.size() && line[i] == ',';
+    }
+  }
+  msg = ROBOTLOG::LogMessage(outputLevel(level), message,
+                             file, number, time, std::move(fields));
+}
+
+/**
+ * @brief One input file, read a record at a time
+ */
+class Source {
+public:
+  std::string path;
+  std::string label;
+  Kind kind = Kind::TEXT;
+  double offset = 0; // ms
+  double drift = 0;  // ppm
+
+  // the record next() found, text files fill line, the others message
+  std::int64_t time = 0;
+  std::string line;
+  ROBOTLOG::LogMessage message{ROBOTLOG::DATA, "", "", 0};
+
+  std::size_t records = 0;
+  std::size_t restarts = 0;
+  std::size_t untimed = 0; // text lines that had nothing to go on
+  std::uint64_t size = 0;
+
+private:
+  const char *data = nullptr;
+  std::uint64_t position = 0; // everything before this has been read
+  std::uint64_t released = 0; // and everything before this dropped
+
+  std::uint32_t last = 0; // the last raw time
+  std::uint64_t base = 0; // added to raw times, for sessions after the first
+
+  // text files
+  std::vector<Region> regions;
+  std::size_t region = 0;
+  bool dictionary = false; // whether the last raw line was
+  std::optional<ROBOTLOG::Frame::Scanner> scanner;
+  std::string block;      // the current block's text
+  std::size_t blockAt = 0; // how far into it the lines have been read
+  std::uint64_t blockOffset = 0;
+  std::string partial; // a line split between blocks
+  std::string raw;
+  ROBOTLOG::Dictionary::Decoder decoder;
+  std::vector<ROBOTLOG::TimeIndex::Entry> index;
+  std::size_t indexNext = 0;
+
+  // JSON and CBOR files
+  std::optional<ROBOTLOG::CBOR::Reader> reader;
+  std::unordered_set<std::string> keys;
+  std::deque<std::string> jsonKeys;
+
+  // millis since the session started to the merged timeline
+  void setTime(std::uint32_t time) {
+    if (time + RESTART_MS < this->last) {
+      this->base += this->last;
+      this->restarts++;
+    } else if (time < this->last) {
+      time = this->last;
+    }
+    this->last = time;
+    double corrected = static_cast<double>(this->base + time) *
+                           (1 + this->drift / 1e6) +
+                       this->offset;
+    this->time = std::llround(corrected);
+  }
+
+  // a new session, its times carry on from the last one's
+  void restart() {
+    if (this->last > 0) {
+      this->base += this->last;
+      this->last = 0;
+      this->restarts++;
+    }
+  }
+
+  void release() {
+    std::uint64_t page = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+    std::uint64_t end = this->position / page * page;
+    if (end >= this->released + RELEASE_BYTES) {
+      madvise(const_cast<char *>(this->data + this->released),
+              end - this->released, MADV_DONTNEED);
+      this->released = end;
+    }
+  }
+
+  // the next undecoded line of the current region, and where it (or its
+  // block) starts in the file
+  bool rawLine(std::string_view &text, std::uint64_t &at) {
+    while (this->region < this->regions.size()) {
+      const Region &current = this->regions[this->region];
+      this->dictionary = current.dictionary;
+      if (!current.framed) {
+        if (this->position < current.start) {
+          this->position = current.start;
+        }
+        if (this->position < current.end) {
+          const char *start = this->data + this->position;
+          const char *newline = static_cast<const char *>(
+              std::memchr(start, '\n', current.end - this->position));
+          std::uint64_t end =
+              newline != nullptr ? newline - this->data : current.end;
+          text = std::string_view(start, end - this->position);
+          at = this->position;
+          this->position = newline != nullptr ? end + 1 : end;
+          return true;
+        }
+      } else {
+        if (!this->scanner) {
+          this->scanner.emplace(this->data + current.start,
+                                current.end - current.start);
+          this->block.clear();
+          this->blockAt = 0;
+        }
+        while (true) {
+          std::size_t newline = this->block.find('\n', this->blockAt);
+          if (newline != std::string::npos) {
+            text = std::string_view(this->block)
+                       .substr(this->blockAt, newline - this->blockAt);
+            this->blockAt = newline + 1;
+            if (!this->partial.empty()) {
+              this->raw = this->partial;
+              this->raw.append(text);
+              this->partial.clear();
+              text = this->raw;
+            }
+            at = this->blockOffset;
+            return true;
+          }
+          this->partial.append(this->block, this->blockAt);
+          this->block.clear();
+          this->blockAt = 0;
+          ROBOTLOG::Frame::Header header;
+          const std::uint8_t *payload;
+          if (!this->scanner->next(header, payload)) {
+            break;
+          }
+          std::uint8_t decoded[ROBOTLOG::Frame::BLOCK_SIZE];
+          std::size_t length = ROBOTLOG::Frame::decode(header, payload, decoded);
+          if (length != ROBOTLOG::LZ::ERROR) {
+            this->block.assign(reinterpret_cast<const char *>(decoded), length);
+          }
+          this->blockOffset = reinterpret_cast<const char *>(payload) -
+                              ROBOTLOG::Frame::HEADER_SIZE - this->data;
+          this->position = this->blockOffset + ROBOTLOG::Frame::HEADER_SIZE +
+                           header.length;
+        }
+        this->scanner.reset();
+        this->position = current.end;
+        if (!this->partial.empty()) {
+          // the region's last line had no newline
+          this->raw.swap(this->partial);
+          this->partial.clear();
+          text = this->raw;
+          at = this->blockOffset;
+          this->region++;
+          return true;
+        }
+      }
+      this->region++;
+    }
+    return false;
+  }
+
+  bool nextText() {
+    std::string_view text;
+    std::uint64_t at;
+    while (this->rawLine(text, at)) {
+      if (text.starts_with(ROBOTLOG::SESSION_PREFIX)) {
+        this->restart();
+        continue;
+      }
+      if (this->dictionary) {
+        if (!this->decoder.line(text, this->line)) {
+          continue;
+        }
+      } else {
+        this->line.assign(text);
+      }
+      std::uint32_t time = this->last;
+      while (this->indexNext < this->index.size() &&
+             this->index[this->indexNext].offset <= at) {
+        time = this->index[this->indexNext++].time;
+      }
+      std::string_view rest = this->line;
+      std::optional<std::uint32_t> own = leadingTime(rest);
+      if (own) {
+        time = *own;
+        this->line.erase(0, this->line.size() - rest.size());
+      } else if (this->index.empty()) {
+        this->untimed++;
+      }
+      this->setTime(time);
+      return true;
+    }
+    return false;
+  }
+
+  bool nextJson() {
+    while (this->position < this->size) {
+      const char *start = this->data + this->position;
+      const char *newline = static_cast<const char *>(
+          std::memchr(start, '\n', this->size - this->position));
+      std::uint64_t end =
+          newline != nullptr ? newline - this->data : this->size;
+      std::string_view text(start, end - this->position);
+      this->position = newline != nullptr ? end + 1 : end;
+      if (startsWith(text, 0, "{\"t\":")) {
+        std::size_t i = 5;
+        this->setTime(static_cast<std::uint32_t>(parseNumber(text, i)));
+        parseJson(text, i, this->messageTime(), this->message, this->jsonKeys);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool nextCbor() {
+    if (!this->reader->record(this->message, this->keys)) {
+      return false;
+    }
+    this->position = this->reader->position();
+    this->setTime(this->message.getTime());
+    return true;
+  }
+
+  void unmap() {
+    if (this->data != nullptr) {
+      munmap(const_cast<char *>(this->data), this->size);
+      this->data = nullptr;
+    }
+  }
+
+public:
+  ~Source() { this->unmap(); }
+
+  /**
+   * @brief The corrected time as a record's time, which can't be negative
+   */
+  std::uint32_t messageTime() {
+    return static_cast<std::uint32_t>(
+        std::clamp<std::int64_t>(this->time, 0, UINT32_MAX));
+  }
+
+  bool open() {
+    int fd = ::open(this->path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+      return false;
+    }
+    this->size = static_cast<std::uint64_t>(info.st_size);
+    if (this->size > 0) {
+      void *mapped =
+          mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped == MAP_FAILED) {
+        close(fd);
+        return false;
+      }
+      this->data = static_cast<const char *>(mapped);
+      madvise(mapped, this->size, MADV_SEQUENTIAL);
+    }
+    close(fd); // the mapping keeps the file open
+    const unsigned char *bytes =
+        reinterpret_cast<const unsigned char *>(this->data);
+    if (this->size >= 3 && bytes[0] == 0xD9 && bytes[1] == 0xD9 &&
+        bytes[2] == 0xF7) {
+      this->kind = Kind::CBOR;
+      this->reader.emplace(this->data, this->size);
+    } else if (this->size > 0 && this->data[0] == '{') {
+      this->kind = Kind::JSON;
+    } else if (this->size > 0) {
+      this->regions =
+          ROBOTLOG::LogParse::textRegions(this->path, this->data, this->size);
+      this->index =
+          ROBOTLOG::TimeIndex::load(ROBOTLOG::TimeIndex::indexPath(this->path));
+    }
+    return true;
+  }
+
+  /**
+   * @brief Read the next record
+   *
+   * @return false at the end of the file
+   */
+  bool next() {
+    bool found = this->kind == Kind::CBOR   ? this->nextCbor()
+                 : this->kind == Kind::JSON ? this->nextJson()
+                                            : this->nextText();
+    this->records += found;
+    if (found) {
+      this->release();
+    } else {
+      this->unmap(); // done with it
+    }
+    return found;
+  }
+};
+
+static std::FILE *out = stdout;
+
+static void writeOut(void *, const char *data, std::size_t length) {
+  std::fwrite(data, 1, length, out);
+}
+
+// the record with its time corrected, JSON records already have it
+static ROBOTLOG::LogMessage &corrected(Source &source,
+                                       ROBOTLOG::LogMessage &copy) {
+  if (source.kind == Kind::TEXT) {
+    copy = parseText(source.line, source.messageTime());
+    return copy;
+  }
+  ROBOTLOG::LogMessage &msg = source.message;
+  if (msg.getTime() == source.messageTime()) {
+    return msg;
+  }
+  copy = ROBOTLOG::LogMessage(msg.getLevel(), msg.getMessage(), msg.getFile(),
+                              msg.getLineNumber(), source.messageTime(),
+                              msg.getFields());
+  return copy;
+}
+
+// like LogMessage::getFieldsAsString(), without a stringstream per record
+static void appendFields(const std::vector<ROBOTLOG::Field> &fields,
+                         std::string &text) {
+  char number[32];
+  for (const ROBOTLOG::Field &field : fields) {
+    text.push_back(' ');
+    text.append(field.key);
+    text.push_back('=');
+    switch (field.type) {
+    case ROBOTLOG::Field::BOOL:
+      text.append(field.b ? "true" : "false");
+      break;
+    case ROBOTLOG::Field::INT:
+      text.append(std::to_string(field.i));
+      break;
+    case ROBOTLOG::Field::DOUBLE:
+      std::snprintf(number, sizeof(number), "%g", field.d);
+      text.append(number);
+      break;
+    case ROBOTLOG::Field::STRING:
+      text.append(field.s);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+// lines are collected here and written a lot at a time
+static void writeText(Source &source, int width, std::string &text) {
+  char time[24];
+  char *end = time + sizeof(time);
+  char *digit = end;
+  std::uint64_t value = source.time < 0 ? -source.time : source.time;
+  do {
+    *--digit = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value > 0);
+  if (source.time < 0) {
+    *--digit = '-';
+  }
+  std::size_t length = end - digit;
+  text.append(length < 10 ? 10 - length : 0, ' ');
+  text.append(digit, length);
+  text.push_back(' ');
+  text.append(source.label);
+  text.append(width - source.label.size() + 1, ' ');
+  if (source.kind == Kind::TEXT) {
+    text.append(source.line);
+  } else {
+    // what the text log would have had, without the colors
+    ROBOTLOG::LogMessage &msg = source.message;
+    if (msg.getLevel() != ROBOTLOG::DATA) {
+      const char *name = ROBOTLOG::LogMessage::levelName(msg.getLevel());
+      text.push_back('[');
+      text.append(name != nullptr ? name
+                                  : std::to_string(msg.getLevel()).c_str());
+      text.append("] ");
+      text.append(msg.getFileView());
+      text.push_back(':');
+      text.append(std::to_string(msg.getLineNumber()));
+      text.append(" - ");
+    }
+    text.append(msg.getMessageView());
+    appendFields(msg.getFields(), text);
+  }
+  text.push_back('\n');
+  if (text.size() >= OUT_BYTES) {
+    std::fwrite(text.data(), 1, text.size(), out);
+    text.clear();
+  }
+}
+
+int main(int argc, char **argv) {
+  std::deque<Source> sources; // they can't move once they're mapped
+  Output output = Output::TEXT;
+  bool stats = false;
+  double offset = 0;
+  double drift = 0;
+  const char *cborPath = nullptr;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--offset" && hasValue) {
+      offset = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--drift" && hasValue) {
+      drift = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--json") {
+      output = Output::JSON;
+    } else if (arg == "--cbor" && hasValue) {
+      output = Output::CBOR;
+      cborPath = argv[++i];
+    } else if (arg == "--stats") {
+      stats = true;
+    } else if (!arg.empty() && arg[0] == '-') {
+      std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+      return 1;
+    } else {
+      sources.emplace_back();
+      sources.back().path = arg;
+      sources.back().label = baseName(arg);
+      sources.back().offset = offset;
+      sources.back().drift = drift;
+    }
+  }
+  if (sources.empty()) {
+    std::fprintf(stderr,
+                 "usage: %s [--json | --cbor <out>] [--stats] "
+                 "[--offset <ms>] [--drift <ppm>] <file>...\n",
+                 argv[0]);
+    return 1;
+  }
+  if (cborPath != nullptr) {
+    out = std::fopen(cborPath, "wb");
+    if (out == nullptr) {
+      std::fprintf(stderr, "can't write %s\n", cborPath);
+      return 1;
+    }
+  }
+  static char outBuffer[OUT_BYTES];
+  std::setvbuf(out, outBuffer, _IOFBF, sizeof(outBuffer));
+
+  auto begin = std::chrono::steady_clock::now();
+  // the next record of every file, earliest first, ties in file order
+  typedef std::pair<std::int64_t, std::size_t> Next;
+  std::priority_queue<Next, std::vector<Next>, std::greater<Next>> heap;
+  int width = 0;
+  for (std::size_t i = 0; i < sources.size(); i++) {
+    Source &source = sources[i];
+    if (!source.open()) {
+      std::fprintf(stderr, "can't open %s, skipped\n", source.path.c_str());
+      continue;
+    }
+    width = std::max(width, static_cast<int>(source.label.size()));
+    if (source.next()) {
+      heap.push({source.time, i});
+    }
+  }
+
+  char buffer[4096];
+  ROBOTLOG::JSON::JsonWriter json(buffer, sizeof(buffer), &writeOut, nullptr);
+  ROBOTLOG::CBOR::Writer cbor(buffer, sizeof(buffer), &writeOut, nullptr);
+  ROBOTLOG::CBOR::StringTable strings;
+  if (output == Output::CBOR) {
+    cbor.setStringTable(&strings);
+    cbor.head(ROBOTLOG::CBOR::TAG, ROBOTLOG::CBOR::SELF_DESCRIBE_TAG);
+  }
+  std::string text;
+  text.reserve(OUT_BYTES * 2);
+  ROBOTLOG::LogMessage copy(ROBOTLOG::DATA, "", "", 0);
+  std::size_t merged = 0;
+  while (!heap.empty()) {
+    std::size_t i = heap.top().second;
+    heap.pop();
+    Source &source = sources[i];
+    if (output == Output::TEXT) {
+      writeText(source, width, text);
+    } else {
+      ROBOTLOG::LogMessage &msg = corrected(source, copy);
+      if (output == Output::JSON) {
+        json.record(msg);
+      } else {
+        cbor.record(msg);
+      }
+    }
+    merged++;
+    if (source.next()) {
+      heap.push({source.time, i});
+    }
+  }
+  std::fwrite(text.data(), 1, text.size(), out);
+  json.drain();
+  cbor.drain();
+  std::fflush(out);
+  if (out != stdout) {
+    std::fclose(out);
+  }
+
+  if (stats) {
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - begin)
+                    .count();
+    std::uint64_t bytes = 0;
+    for (Source &source : sources) {
+      bytes += source.size;
+      if (source.untimed > 0) {
+        std::fprintf(stderr,
+                     "%s: %zu lines had no <TIME> and there's no .tix index, "
+                     "they went with the line before\n",
+                     source.path.c_str(), source.untimed);
+      }
+      if (source.restarts > 0) {
+        std::fprintf(stderr, "%s: %zu sessions put one after another\n",
+                     source.path.c_str(), source.restarts + 1);
+      }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::fprintf(stderr,
+                 "%zu files, %zu records, %.1f MB in %.1f ms (%.1f MB/s), "
+                 "peak memory %.1f MB\n",
+                 sources.size(), merged, bytes / 1e6, ms,
+                 ms > 0 ? bytes / 1e3 / ms : 0.0, usage.ru_maxrss / 1e3);
+  }
+  return 0;
+}
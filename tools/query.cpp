@@ -0,0 +1,841 @@
+/*
+ * vexlog-query: filter any number of log files, on every core
+ *
+ * Build (from the repo root):
+ *   g++ -std=c++20 -O2 -pthread -Iinclude tools/query.cpp -o vexlog-query
+ *
+ * Usage:
+ *   vexlog-query [options] <file>...
+ *     --level <L>       DEBUG, INFO, WARN or ERR and up, or exactly DATA or
+ *                       a custom level's number
+ *     --file <name>     lines logged from a file whose name contains this
+ *     --line <n>        lines logged from this line number
+ *     --grep <regex>    lines whose message matches (ECMAScript regex)
+ *     --from <ms> --to <ms> [--session <id>]
+ *                       a time window, see below
+ *     --no-color        print text lines without their color codes
+ *     --threads <n>     default is every core
+ *     --stats           print how much was read and how fast to stderr
+ *
+ * Reads text logs (plain, dictionary, framed and compressed, mixed within a
+ * file too if its .idx is next to it), JsonLinesSink files and CborFileSink
+ * files, and prints the matching lines in the same order they are in the
+ * files (CBOR records as JSON lines).
+ *
+ * Each file is mapped and cut into chunks that are decoded and filtered on
+ * separate threads, then printed in order. Text chunks don't need to start
+ * on a line: the bit of a line at each end of a chunk is put back together
+ * with the neighbouring chunk's when printing. Framed chunks own the blocks
+ * whose header starts in them. Dictionary lines need the templates from
+ * earlier in the file, so dictionary parts are read twice, once (cheaply) to
+ * find where templates are defined and then to decode with the templates
+ * each chunk starts with. CBOR files can only be read from the start, so
+ * each one is a single chunk.
+ *
+ * Text lines usually have no times in them, so --from/--to use the .tix time
+ * index (see setFileTimeIndex()) and print the stretch of the file the window
+ * is in, in the last session unless --session is given. JSON and CBOR records,
+ * and text lines written with <TIME> first in the format, have their own
+ * time, which is compared exactly.
+ */
+#include "robotlog/cbor.h"
+#include "robotlog/dictionary.h"
+#include "robotlog/frame.h"
+#include "robotlog/json.h"
+#include "robotlog/logparse.h"
+#include "robotlog/scan.h"
+#include "robotlog/session.h"
+#include "robotlog/timeindex.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+constexpr std::size_t CHUNK_SIZE = 4 << 20;
+
+enum class Kind { TEXT, JSON, CBOR };
+
+using ROBOTLOG::LogParse::jsonString;
+using ROBOTLOG::LogParse::NO_LEVEL;
+using ROBOTLOG::LogParse::parseLevel;
+using ROBOTLOG::LogParse::parseNumber;
+using ROBOTLOG::LogParse::parseText;
+using ROBOTLOG::LogParse::Record;
+using ROBOTLOG::LogParse::Region;
+using ROBOTLOG::LogParse::startsWith;
+
+struct Filter {
+  std::optional<int> level;
+  bool exactLevel = false; // DATA and custom levels only match themselves
+  std::string file;
+  std::optional<int> line;
+  std::optional<std::regex> grep;
+  std::string literal;     // text every match of grep has in it
+  bool onlyLiteral = false; // grep is nothing but that text
+  std::optional<std::uint32_t> from;
+  std::optional<std::uint32_t> to;
+  std::optional<std::uint32_t> session;
+  bool noColor = false; // not a filter, but it's done with the filtering
+};
+
+// the fixed layout JSON::JsonWriter::record() writes
+static Record parseJson(std::string_view line) {
+  Record record;
+  record.message = line;
+  std::size_t i = line.find("\"t\":");
+  if (i == std::string_view::npos) {
+    return record;
+  }
+  i += 4;
+  record.time = static_cast<std::uint32_t>(parseNumber(line, i));
+  i = line.find("\"level\":", i);
+  if (i == std::string_view::npos) {
+    return record;
+  }
+  i += 8;
+  if (i < line.size() && line[i] == '"') {
+    record.level = parseLevel(jsonString(line, i));
+  } else {
+    record.level = static_cast<int>(parseNumber(line, i));
+  }
+  if (startsWith(line, i, ",\"file\":")) {
+    i += 8;
+    record.file = jsonString(line, i);
+  }
+  if (startsWith(line, i, ",\"line\":")) {
+    i += 8;
+    record.line = static_cast<int>(parseNumber(line, i));
+  }
+  if (startsWith(line, i, ",\"msg\":")) {
+    i += 7;
+    record.message = jsonString(line, i);
+    if (record.message.find('\\') != std::string_view::npos) {
+      // so --grep sees the same message it would in the text log
+      thread_local std::string unescaped;
+      ROBOTLOG::LogParse::unescapeJson(record.message, unescaped);
+      record.message = unescaped;
+    }
+  }
+  return record;
+}
+
+// the text at the start of a regex that any match has to contain
+static std::string requiredLiteral(std::string_view pattern, bool &whole) {
+  whole = false;
+  if (pattern.find('|') != std::string_view::npos) {
+    return "";
+  }
+  bool anchored = pattern.starts_with('^');
+  if (anchored) {
+    pattern.remove_prefix(1); // the text is still somewhere in the message
+  }
+  std::size_t end = pattern.find_first_of("\\^$.*+?()[]{}");
+  if (end == std::string_view::npos) {
+    whole = !anchored;
+    return std::string(pattern);
+  }
+  // the last character is optional if a quantifier follows it
+  if (end > 0 && (pattern[end] == '*' || pattern[end] == '?' ||
+                  pattern[end] == '{')) {
+    end--;
+  }
+  return std::string(pattern.substr(0, end));
+}
+
+static bool levelMatches(const Filter &filter, int level) {
+  return filter.exactLevel ? level == *filter.level
+                           : level >= *filter.level && level <= ROBOTLOG::ERR;
+}
+
+static bool matches(const Filter &filter, const Record &record) {
+  if (filter.level && !levelMatches(filter, record.level)) {
+    return false;
+  }
+  if (filter.line && record.line != *filter.line) {
+    return false;
+  }
+  if (!filter.file.empty() &&
+      record.file.find(filter.file) == std::string_view::npos) {
+    return false;
+  }
+  // text lines were already narrowed down with the time index
+  if (record.time && ((filter.from && *record.time < *filter.from) ||
+                      (filter.to && *record.time > *filter.to))) {
+    return false;
+  }
+  // std::regex is slow, so skip it whenever plain searching can decide
+  if (!filter.literal.empty() &&
+      record.message.find(filter.literal) == std::string_view::npos) {
+    return false;
+  }
+  if (filter.grep && !filter.onlyLiteral &&
+      !std::regex_search(record.message.begin(), record.message.end(),
+                         *filter.grep)) {
+    return false;
+  }
+  return true;
+}
+
+struct Chunk {
+  std::size_t file = 0;
+  Kind kind = Kind::TEXT;
+  Region region;
+  std::uint64_t start = 0;
+  std::uint64_t end = 0;
+  bool regionStart = false; // the first chunk of its region
+  bool regionEnd = false;   // the last
+
+  // the first pass, dictionary chunks only
+  bool restart = false;                // the dictionary started over in it
+  std::vector<std::string> defines;    // after the last restart
+  std::vector<std::string> templates;  // what the middle lines start with
+  std::string stitched;                // the line from the chunk before, decoded
+  bool stitchedIsLine = false;
+  std::vector<std::string> lastTemplates; // for a last line with no newline
+
+  // the second pass
+  std::string head; // the bit before the first newline
+  std::string tail; // after the last one
+  bool hasNewline = false;
+  std::string out;
+  std::size_t lines = 0;
+  std::size_t decoded = 0;
+  bool done = false;
+};
+
+struct File {
+  std::string path;
+  const char *data = nullptr;
+  std::uint64_t size = 0;
+  Kind kind = Kind::TEXT;
+};
+
+// the stretches of a text log a time window is in, from its time index
+static bool timeRegions(const File &file, Filter &filter,
+                        std::vector<Region> &regions) {
+  std::string indexPath = ROBOTLOG::TimeIndex::indexPath(file.path);
+  std::vector<ROBOTLOG::TimeIndex::Entry> entries =
+      ROBOTLOG::TimeIndex::load(indexPath);
+  if (entries.empty()) {
+    std::fprintf(stderr, "%s: no time index at %s, skipped\n",
+                 file.path.c_str(), indexPath.c_str());
+    return false;
+  }
+  std::uint32_t session = filter.session ? *filter.session
+                                         : entries.back().session;
+  ROBOTLOG::TimeIndex::Range range;
+  if (!ROBOTLOG::TimeIndex::find(entries, session, filter.from.value_or(0),
+                                 filter.to.value_or(~0U), range)) {
+    return true; // that session isn't in this file
+  }
+  for (std::size_t i = range.begin; i < range.end; i++) {
+    Region region;
+    region.start = std::min<std::uint64_t>(entries[i].offset, file.size);
+    region.end = i + 1 < entries.size()
+                     ? std::min<std::uint64_t>(entries[i + 1].offset, file.size)
+                     : file.size;
+    region.framed = entries[i].flags & ROBOTLOG::TimeIndex::FRAMED;
+    region.dictionary = entries[i].flags & ROBOTLOG::TimeIndex::DICTIONARY;
+    if (region.end <= region.start) {
+      continue;
+    }
+    if (!regions.empty() && regions.back().end == region.start &&
+        regions.back().framed == region.framed &&
+        regions.back().dictionary == region.dictionary) {
+      regions.back().end = region.end; // the dictionary restarts in the data
+    } else {
+      regions.push_back(region);
+    }
+  }
+  return true;
+}
+
+// the text in a chunk, straight from the file or out of its blocks
+static std::string_view chunkText(const File &file, const Chunk &chunk,
+                                  std::string &buffer) {
+  if (!chunk.region.framed) {
+    return std::string_view(file.data + chunk.start, chunk.end - chunk.start);
+  }
+  buffer.clear();
+  const char *base = file.data + chunk.start;
+  ROBOTLOG::Frame::Scanner scanner(base, chunk.region.end - chunk.start);
+  ROBOTLOG::Frame::Header header;
+  const std::uint8_t *payload;
+  std::uint8_t block[ROBOTLOG::Frame::BLOCK_SIZE];
+  while (scanner.next(header, payload)) {
+    const char *at = reinterpret_cast<const char *>(payload) -
+                     ROBOTLOG::Frame::HEADER_SIZE;
+    if (at - base >= static_cast<std::ptrdiff_t>(chunk.end - chunk.start)) {
+      break; // the next chunk's
+    }
+    std::size_t length = ROBOTLOG::Frame::decode(header, payload, block);
+    if (length != ROBOTLOG::LZ::ERROR) {
+      buffer.append(reinterpret_cast<const char *>(block), length);
+    }
+  }
+  return buffer;
+}
+
+// splits text into the part of a line at each end and the lines in between
+static std::string_view middleLines(std::string_view text, Chunk &chunk) {
+  std::size_t first = ROBOTLOG::Scan::find(text.data(), text.size(), '\n');
+  if (first == text.size()) {
+    chunk.hasNewline = false;
+    chunk.head.assign(text);
+    chunk.tail.clear();
+    return {};
+  }
+  std::size_t last = text.rfind('\n');
+  chunk.hasNewline = true;
+  chunk.head.assign(text.substr(0, first));
+  chunk.tail.assign(text.substr(last + 1));
+  return text.substr(first + 1, last - first);
+}
+
+template <typename Callback>
+static void forEachLine(std::string_view text, Callback callback) {
+  std::size_t start = 0;
+  ROBOTLOG::Scan::eachByte(text.data(), text.size(), '\n',
+                           [&](std::size_t newline) {
+                             callback(text.substr(start, newline - start));
+                             start = newline + 1;
+                           });
+  if (start < text.size()) {
+    callback(text.substr(start));
+  }
+}
+
+// where the level tokens from lowest up are in text, found in bulk
+static void levelTokens(std::string_view text, int lowest,
+                        std::vector<std::size_t> &hits) {
+  static constexpr std::string_view TOKENS[] = {"[DEBUG]", "[INFO]", "[WARN]",
+                                                "[ERR]"};
+  for (int level = lowest; level <= ROBOTLOG::ERR; level++) {
+    ROBOTLOG::Scan::eachToken(text.data(), text.size(), TOKENS[level],
+                              [&hits](std::size_t at) { hits.push_back(at); });
+  }
+  if (lowest < ROBOTLOG::ERR) {
+    std::sort(hits.begin(), hits.end());
+  }
+}
+
+// only the lines the hits are in, so the rest are never looked at
+template <typename Callback>
+static void forEachHitLine(std::string_view text,
+                           const std::vector<std::size_t> &hits,
+                           Callback callback) {
+  std::size_t lineEnd = 0; // of the last line handed out
+  for (std::size_t hit : hits) {
+    if (hit < lineEnd) {
+      continue; // the same line again
+    }
+    const void *newline = memrchr(text.data() + lineEnd, '\n', hit - lineEnd);
+    std::size_t start =
+        newline != nullptr
+            ? static_cast<const char *>(newline) - text.data() + 1
+            : lineEnd;
+    std::size_t end = hit + ROBOTLOG::Scan::find(text.data() + hit,
+                                                 text.size() - hit, '\n');
+    callback(text.substr(start, end - start));
+    lineEnd = end;
+  }
+}
+
+// first pass: where the dictionary is defined or restarted
+static void scanDictionary(const File &file, Chunk &chunk) {
+  std::string buffer;
+  std::string_view middle = middleLines(chunkText(file, chunk, buffer), chunk);
+  // only what's after the last restart matters, so look for that backwards
+  std::size_t length = middle.size();
+  while (const void *found = memrchr(middle.data(),
+                                     ROBOTLOG::Dictionary::SESSION, length)) {
+    std::size_t at = static_cast<const char *>(found) - middle.data();
+    if (at == 0 || middle[at - 1] == '\n') {
+      chunk.restart = true;
+      middle = middle.substr(at);
+      break;
+    }
+    length = at;
+  }
+  // most chunks without a restart don't define anything either
+  if (std::memchr(middle.data(), ROBOTLOG::Dictionary::DEFINE,
+                  middle.size()) == nullptr) {
+    return;
+  }
+  forEachLine(middle, [&chunk](std::string_view line) {
+    if (!line.empty() && line[0] == ROBOTLOG::Dictionary::DEFINE) {
+      chunk.defines.emplace_back(line.substr(1));
+    }
+  });
+}
+
+// whether no line made from a template can match, going by the level and
+// file, which are only numbers (holes) in the template for custom levels and
+// file names with digits in them
+static bool templateRejects(const Filter &filter, std::string_view text) {
+  Record record = parseText(text);
+  if (filter.level &&
+      record.levelText.find(ROBOTLOG::Dictionary::HOLE) ==
+          std::string_view::npos &&
+      !levelMatches(filter, record.level)) {
+    return true;
+  }
+  return !filter.file.empty() &&
+         record.file.find(ROBOTLOG::Dictionary::HOLE) ==
+             std::string_view::npos &&
+         record.file.find(filter.file) == std::string_view::npos;
+}
+
+static void emit(const Filter &filter, Kind kind, std::string_view line,
+                 std::string &out) {
+  if (line.substr(0, ROBOTLOG::SESSION_PREFIX.size()) ==
+      ROBOTLOG::SESSION_PREFIX) {
+    return;
+  }
+  Record record = kind == Kind::JSON ? parseJson(line) : parseText(line);
+  if (matches(filter, record)) {
+    out.append(line);
+    out.push_back('\n');
+  }
+}
+
+static void stripColors(const Filter &filter, std::string &text) {
+  if (!filter.noColor) {
+    return;
+  }
+  std::string stripped(text.size(), '\0');
+  stripped.resize(
+      ROBOTLOG::Scan::stripColors(text.data(), text.size(), stripped.data()));
+  text.swap(stripped);
+}
+
+static void appendJson(void *context, const char *data, std::size_t length) {
+  static_cast<std::string *>(context)->append(data, length);
+}
+
+static void filterCbor(const Filter &filter, const File &file, Chunk &chunk) {
+  std::unordered_set<std::string> keys;
+  ROBOTLOG::LogMessage msg(ROBOTLOG::Level::INFO, "", "", 0);
+  ROBOTLOG::CBOR::Reader reader(file.data, file.size);
+  char buffer[4096];
+  ROBOTLOG::JSON::JsonWriter writer(buffer, sizeof(buffer), &appendJson,
+                                    &chunk.out);
+  while (reader.record(msg, keys)) {
+    chunk.lines++;
+    Record record;
+    record.level = msg.getLevel();
+    record.file = msg.getFileView();
+    record.line = msg.getLineNumber();
+    record.message = msg.getMessageView();
+    record.time = msg.getTime();
+    if (matches(filter, record)) {
+      writer.record(msg);
+    }
+  }
+  writer.drain();
+  chunk.decoded = reader.position();
+  if (!reader.atEnd()) {
+    std::fprintf(stderr, "%s: stopped at byte %zu of %llu\n",
+                 file.path.c_str(), reader.position(),
+                 static_cast<unsigned long long>(file.size));
+  }
+}
+
+// second pass: decode and filter the lines wholly inside the chunk
+static void filterChunk(const Filter &filter, const File &file, Chunk &chunk) {
+  if (chunk.kind == Kind::CBOR) {
+    filterCbor(filter, file, chunk);
+    return;
+  }
+  std::string buffer;
+  std::string_view text = chunkText(file, chunk, buffer);
+  chunk.decoded = text.size();
+  std::string_view middle = middleLines(text, chunk);
+  // warnings and errors are usually few enough that finding their tokens
+  // beats looking at every line, debug and info lines aren't
+  if (!chunk.region.dictionary && chunk.kind == Kind::TEXT && filter.level &&
+      *filter.level >= ROBOTLOG::WARN && !filter.exactLevel) {
+    std::size_t lines =
+        ROBOTLOG::Scan::count(middle.data(), middle.size(), '\n');
+    std::vector<std::size_t> hits;
+    levelTokens(middle, *filter.level, hits);
+    // unless this log is mostly warnings
+    if (hits.size() * 4 < lines) {
+      chunk.lines += lines;
+      forEachHitLine(middle, hits, [&](std::string_view line) {
+        emit(filter, chunk.kind, line, chunk.out);
+      });
+      return;
+    }
+  }
+  if (!chunk.region.dictionary) {
+    forEachLine(middle, [&](std::string_view line) {
+      chunk.lines++;
+      emit(filter, chunk.kind, line, chunk.out);
+    });
+    return;
+  }
+  ROBOTLOG::Dictionary::Decoder decoder;
+  decoder.setTemplates(std::move(chunk.templates));
+  std::string decoded;
+  // most lines can be turned down by their template, without decoding them
+  enum Verdict : std::uint8_t { UNKNOWN, REJECT, DECODE };
+  std::vector<Verdict> verdicts;
+  bool prefilter = filter.level || !filter.file.empty();
+  forEachLine(middle, [&](std::string_view line) {
+    if (prefilter && !line.empty()) {
+      if (line[0] == ROBOTLOG::Dictionary::SESSION) {
+        verdicts.clear();
+      } else if (line[0] == ROBOTLOG::Dictionary::USE) {
+        std::size_t i = 1;
+        std::size_t id = static_cast<std::size_t>(parseNumber(line, i));
+        const std::vector<std::string> &templates = decoder.getTemplates();
+        if (id < templates.size()) {
+          if (verdicts.size() <= id) {
+            verdicts.resize(templates.size(), UNKNOWN);
+          }
+          if (verdicts[id] == UNKNOWN) {
+            verdicts[id] =
+                templateRejects(filter, templates[id]) ? REJECT : DECODE;
+          }
+          if (verdicts[id] == REJECT) {
+            chunk.lines++;
+            return;
+          }
+        }
+      }
+    }
+    if (decoder.line(line, decoded)) {
+      chunk.lines++;
+      emit(filter, chunk.kind, decoded, chunk.out);
+    }
+  });
+}
+
+// runs work(i) for every chunk on every thread, and then done(i) in order on
+// this one, with at most window chunks finished but not yet done
+template <typename Work, typename Done>
+static void runOrdered(std::vector<Chunk> &chunks, unsigned threads,
+                       std::size_t window, Work work, Done done) {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::size_t next = 0;
+  std::size_t retired = 0;
+  auto worker = [&]() {
+    while (true) {
+      std::size_t i;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() {
+          return next >= chunks.size() || next < retired + window;
+        });
+        if (next >= chunks.size()) {
+          return;
+        }
+        i = next++;
+      }
+      work(i);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        chunks[i].done = true;
+      }
+      changed.notify_all();
+    }
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; t++) {
+    pool.emplace_back(worker);
+  }
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [&]() { return chunks[i].done; });
+    }
+    done(i);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      retired = i + 1;
+    }
+    changed.notify_all();
+  }
+  for (std::thread &thread : pool) {
+    thread.join();
+  }
+}
+
+int main(int argc, char **argv) {
+  Filter filter;
+  bool stats = false;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<File> files;
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--level" && hasValue) {
+      std::string_view name = argv[++i];
+      filter.level = parseLevel(name);
+      filter.exactLevel = *filter.level > ROBOTLOG::ERR;
+      if (*filter.level == NO_LEVEL) {
+        std::fprintf(stderr, "unknown level %s\n", argv[i]);
+        return 1;
+      }
+    } else if (arg == "--file" && hasValue) {
+      filter.file = argv[++i];
+    } else if (arg == "--line" && hasValue) {
+      filter.line = std::atoi(argv[++i]);
+    } else if (arg == "--grep" && hasValue) {
+      try {
+        filter.grep.emplace(argv[++i], std::regex::optimize);
+        filter.literal = requiredLiteral(argv[i], filter.onlyLiteral);
+      } catch (const std::regex_error &error) {
+        std::fprintf(stderr, "bad regex %s: %s\n", argv[i], error.what());
+        return 1;
+      }
+    } else if (arg == "--from" && hasValue) {
+      filter.from = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--to" && hasValue) {
+      filter.to = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--session" && hasValue) {
+      filter.session = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--threads" && hasValue) {
+      threads = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--no-color") {
+      filter.noColor = true;
+    } else if (arg == "--stats") {
+      stats = true;
+    } else {
+      File file;
+      file.path = argv[i];
+      files.push_back(file);
+    }
+  }
+  if (files.empty()) {
+    std::fprintf(stderr,
+                 "usage: %s [--level L] [--file name] [--line n] "
+                 "[--grep regex]\n"
+                 "       [--from ms] [--to ms] [--session id] [--no-color] "
+                 "[--threads n] [--stats] <file>...\n",
+                 argv[0]);
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Chunk> chunks;
+  std::uint64_t totalSize = 0;
+  for (std::size_t f = 0; f < files.size(); f++) {
+    File &file = files[f];
+    int fd = open(file.path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+      std::fprintf(stderr, "can't open %s\n", file.path.c_str());
+      return 1;
+    }
+    file.size = static_cast<std::uint64_t>(info.st_size);
+    if (file.size == 0) {
+      close(fd);
+      continue;
+    }
+    void *mapped = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+      std::fprintf(stderr, "can't map %s\n", file.path.c_str());
+      return 1;
+    }
+    madvise(mapped, file.size, MADV_SEQUENTIAL);
+    file.data = static_cast<const char *>(mapped);
+    totalSize += file.size;
+
+    const std::uint8_t *bytes = reinterpret_cast<const std::uint8_t *>(file.data);
+    if (file.size >= 3 && bytes[0] == 0xD9 && bytes[1] == 0xD9 &&
+        bytes[2] == 0xF7) {
+      file.kind = Kind::CBOR;
+    } else if (file.data[0] == '{') {
+      file.kind = Kind::JSON;
+    }
+    std::vector<Region> regions;
+    if (file.kind == Kind::CBOR) {
+      regions.push_back({0, file.size, false, false});
+    } else if (file.kind == Kind::JSON) {
+      regions.push_back({0, file.size, false, false});
+    } else if (filter.from || filter.to) {
+      if (!timeRegions(file, filter, regions)) {
+        continue;
+      }
+    } else {
+      regions =
+          ROBOTLOG::LogParse::textRegions(file.path, file.data, file.size);
+    }
+    for (const Region &region : regions) {
+      std::uint64_t size = file.kind == Kind::CBOR ? file.size : CHUNK_SIZE;
+      for (std::uint64_t at = region.start; at < region.end; at += size) {
+        Chunk chunk;
+        chunk.file = f;
+        chunk.kind = file.kind;
+        chunk.region = region;
+        chunk.start = at;
+        chunk.end = std::min(region.end, at + size);
+        chunk.regionStart = at == region.start;
+        chunk.regionEnd = chunk.end == region.end;
+        chunks.push_back(std::move(chunk));
+      }
+    }
+  }
+
+  // the first pass, only over dictionary parts, finds each chunk's templates
+  std::vector<std::size_t> dictionaryChunks;
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+    if (chunks[i].region.dictionary) {
+      dictionaryChunks.push_back(i);
+    }
+  }
+  {
+    std::atomic<std::size_t> next = 0;
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) {
+      pool.emplace_back([&]() {
+        for (std::size_t i; (i = next++) < dictionaryChunks.size();) {
+          Chunk &chunk = chunks[dictionaryChunks[i]];
+          scanDictionary(files[chunk.file], chunk);
+        }
+      });
+    }
+    for (std::thread &thread : pool) {
+      thread.join();
+    }
+  }
+  {
+    ROBOTLOG::Dictionary::Decoder decoder;
+    std::string carry;
+    for (std::size_t i : dictionaryChunks) {
+      Chunk &chunk = chunks[i];
+      if (chunk.regionStart) {
+        decoder.setTemplates({});
+        carry.clear();
+      }
+      if (chunk.hasNewline) {
+        carry += chunk.head;
+        chunk.stitchedIsLine = decoder.line(carry, chunk.stitched);
+        carry = chunk.tail;
+        chunk.templates = decoder.getTemplates();
+        std::vector<std::string> templates =
+            chunk.restart ? std::vector<std::string>() : chunk.templates;
+        templates.insert(templates.end(), chunk.defines.begin(),
+                         chunk.defines.end());
+        decoder.setTemplates(std::move(templates));
+      } else {
+        carry += chunk.head;
+      }
+      if (chunk.regionEnd && !carry.empty()) {
+        // a last line without a newline, decoded when it's printed
+        chunk.lastTemplates = decoder.getTemplates();
+      }
+      chunk.defines.clear();
+      chunk.defines.shrink_to_fit();
+    }
+  }
+
+  // the second pass filters, and the pieces of lines between chunks are put
+  // back together here, in order
+  std::string carry;
+  std::string out;
+  std::size_t lines = 0;
+  std::uint64_t decoded = 0;
+  runOrdered(
+      chunks, threads, threads * 4,
+      [&](std::size_t i) {
+        Chunk &chunk = chunks[i];
+        filterChunk(filter, files[chunk.file], chunk);
+        stripColors(filter, chunk.out);
+      },
+      [&](std::size_t i) {
+        Chunk &chunk = chunks[i];
+        out.clear();
+        if (chunk.regionStart) {
+          carry.clear();
+        }
+        if (chunk.kind != Kind::CBOR) {
+          if (chunk.hasNewline) {
+            if (chunk.region.dictionary) {
+              if (chunk.stitchedIsLine) {
+                lines++;
+                emit(filter, chunk.kind, chunk.stitched, out);
+              }
+            } else {
+              carry += chunk.head;
+              lines++;
+              emit(filter, chunk.kind, carry, out);
+            }
+            carry = chunk.tail;
+          } else {
+            carry += chunk.head;
+          }
+          if (chunk.regionEnd && !carry.empty()) {
+            std::string last;
+            if (!chunk.region.dictionary) {
+              last = carry;
+            } else {
+              ROBOTLOG::Dictionary::Decoder decoder;
+              decoder.setTemplates(std::move(chunk.lastTemplates));
+              if (!decoder.line(carry, last)) {
+                last.clear();
+              }
+            }
+            if (!last.empty()) {
+              lines++;
+              emit(filter, chunk.kind, last, out);
+            }
+            carry.clear();
+          }
+        }
+        stripColors(filter, out);
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fwrite(chunk.out.data(), 1, chunk.out.size(), stdout);
+        lines += chunk.lines;
+        decoded += chunk.decoded;
+        chunk.out = std::string();
+        chunk.head = std::string();
+        chunk.tail = std::string();
+        chunk.stitched = std::string();
+      });
+  std::fflush(stdout);
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  if (stats) {
+    std::uint64_t read = 0;
+    for (const Chunk &chunk : chunks) {
+      read += chunk.end - chunk.start;
+    }
+    std::fprintf(stderr,
+                 "%zu files, %llu of %llu bytes read (%llu decoded), "
+                 "%zu lines, %zu chunks, %u threads\n"
+                 "%.3f s, %.2f GB/s read, %.2f GB/s decoded\n",
+                 files.size(), static_cast<unsigned long long>(read),
+                 static_cast<unsigned long long>(totalSize),
+                 static_cast<unsigned long long>(decoded), lines,
+                 chunks.size(), threads, seconds, read / 1e9 / seconds,
+                 decoded / 1e9 / seconds);
+  }
+  for (const File &file : files) {
+    if (file.data != nullptr) {
+      munmap(const_cast<char *>(file.data), file.size);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * vexlog-recover: get the text back out of a framed (or compressed) log file
+ *
+ * Build (from the repo root):
+ *   g++ -std=c++20 -O2 -Iinclude tools/recover.cpp -o vexlog-recover
+ *
+ * Usage:
+ *   vexlog-recover [--raw] <file> [out.txt]
+ *
+ * Reads a file written by a TextFileSink with framing (or compression) on,
+ * e.g. the logger's file after setFileFraming(true), or a CompressedFileSink.
+ * Every block with a good CRC is decoded, in one pass over the file, anything
+ * else (a block cut off by a power loss, junk the card never finished writing)
+ * is skipped and counted. Dictionary lines are decoded back into text unless
+ * --raw is given. The text goes to out.txt, or stdout.
+ */
+#include "robotlog/dictionary.h"
+#include "robotlog/frame.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+  bool raw = false;
+  const char *path = nullptr;
+  const char *outPath = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--raw") == 0) {
+      raw = true;
+    } else if (path == nullptr) {
+      path = argv[i];
+    } else {
+      outPath = argv[i];
+    }
+  }
+  if (path == nullptr) {
+    std::fprintf(stderr, "usage: %s [--raw] <file> [out.txt]\n", argv[0]);
+    return 1;
+  }
+  int fd = open(path, O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    std::fprintf(stderr, "can't open %s\n", path);
+    return 1;
+  }
+  if (info.st_size == 0) {
+    return 0;
+  }
+  void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    std::fprintf(stderr, "can't map %s\n", path);
+    return 1;
+  }
+  std::FILE *out = outPath != nullptr ? std::fopen(outPath, "wb") : stdout;
+  if (out == nullptr) {
+    std::fprintf(stderr, "can't write %s\n", outPath);
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  ROBOTLOG::Frame::Scanner scanner(data, info.st_size);
+  ROBOTLOG::Frame::Header header;
+  const std::uint8_t *payload;
+  std::uint8_t block[ROBOTLOG::Frame::BLOCK_SIZE];
+  ROBOTLOG::Dictionary::Decoder decoder;
+  std::string partial; // a line that carries on into the next block
+  std::string line;
+  std::size_t blocks = 0;
+  std::size_t undecodable = 0;
+  std::size_t lost = 0;
+  std::size_t lines = 0;
+  std::uint32_t expected = 0;
+  bool skipToNewline = false;
+
+  while (scanner.next(header, payload)) {
+    std::size_t length = ROBOTLOG::Frame::decode(header, payload, block);
+    // sequences restart at 0 every time the file is opened
+    if (header.sequence != expected && header.sequence != 0) {
+      lost += header.sequence > expected ? header.sequence - expected : 1;
+    }
+    if (header.sequence != expected || length == ROBOTLOG::LZ::ERROR) {
+      // whatever was before this block is gone, and so is the start of the
+      // line it begins with (unless the file was reopened)
+      partial.clear();
+      skipToNewline = header.sequence != 0;
+    }
+    expected = header.sequence + 1;
+    if (length == ROBOTLOG::LZ::ERROR) {
+      undecodable++;
+      continue;
+    }
+    blocks++;
+    if (raw) {
+      std::fwrite(block, 1, length, out);
+      continue;
+    }
+    std::size_t lineStart = 0;
+    for (std::size_t i = 0; i < length; i++) {
+      if (block[i] != '\n') {
+        continue;
+      }
+      if (skipToNewline) {
+        skipToNewline = false;
+        lineStart = i + 1;
+        continue;
+      }
+      partial.append(reinterpret_cast<const char *>(block) + lineStart,
+                     i - lineStart);
+      lineStart = i + 1;
+      if (decoder.line(partial, line)) {
+        line.push_back('\n');
+        std::fwrite(line.data(), 1, line.size(), out);
+        lines++;
+      }
+      partial.clear();
+    }
+    if (!skipToNewline) {
+      partial.append(reinterpret_cast<const char *>(block) + lineStart,
+                     length - lineStart);
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  std::fprintf(stderr,
+               "%zu blocks recovered, %zu lines\n"
+               "%zu damaged or cut off, %zu missing, %zu undecodable\n"
+               "%zu of %lld bytes skipped, %.0f MB/s\n",
+               blocks, lines, scanner.getBadBlocks(), lost, undecodable,
+               scanner.getSkipped(), static_cast<long long>(info.st_size),
+               info.st_size / 1e6 / seconds);
+  if (blocks == 0) {
+    std::fprintf(stderr, "no blocks found, is this a framed file?\n");
+  }
+  if (out != stdout) {
+    std::fclose(out);
+  }
+  munmap(data, info.st_size);
+  close(fd);
+  return 0;
+}
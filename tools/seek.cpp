@@ -0,0 +1,165 @@
+/*
+ * vexlog-seek: print a time window of a log, without reading the whole file
+ *
+ * Build (from the repo root):
+ *   g++ -std=c++20 -O2 -Iinclude tools/seek.cpp -o vexlog-seek
+ *
+ * Usage:
+ *   vexlog-seek [--session <id>] <log> <from_ms> <to_ms>
+ *
+ * Needs the time index the logger keeps next to its log after
+ * setFileTimeIndex() (main.tix for main.txt). The window's start and end are
+ * found by binary searching it, then only the part of the log in between is
+ * read (mapped, so the rest never leaves the disk). Times are millis since
+ * the program started, so they're looked up in one session, the last one in
+ * the file unless --session is given. The index only has an entry every so
+ * many KB, so a few lines either side of the window are printed too.
+ */
+#include "robotlog/dictionary.h"
+#include "robotlog/frame.h"
+#include "robotlog/session.h"
+#include "robotlog/timeindex.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static std::size_t printed = 0;
+
+static void printLines(std::string_view text, bool dictionary,
+                       ROBOTLOG::Dictionary::Decoder &decoder,
+                       std::string &line) {
+  std::size_t start = 0;
+  while (start < text.size()) {
+    std::size_t newline = text.find('\n', start);
+    if (newline == std::string_view::npos) {
+      newline = text.size();
+    }
+    std::string_view raw = text.substr(start, newline - start);
+    start = newline + 1;
+    if (raw.substr(0, ROBOTLOG::SESSION_PREFIX.size()) ==
+        ROBOTLOG::SESSION_PREFIX) {
+      continue;
+    }
+    if (!dictionary) {
+      std::fwrite(raw.data(), 1, raw.size(), stdout);
+      std::fputc('\n', stdout);
+      printed++;
+    } else if (decoder.line(raw, line)) {
+      line.push_back('\n');
+      std::fwrite(line.data(), 1, line.size(), stdout);
+      printed++;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  std::vector<const char *> args;
+  long session = -1;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--session") == 0 && i + 1 < argc) {
+      session = std::strtol(argv[++i], nullptr, 10);
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  if (args.size() != 3) {
+    std::fprintf(stderr,
+                 "usage: %s [--session <id>] <log> <from_ms> <to_ms>\n",
+                 argv[0]);
+    return 1;
+  }
+  const char *path = args[0];
+  std::uint32_t from =
+      static_cast<std::uint32_t>(std::strtoul(args[1], nullptr, 10));
+  std::uint32_t to =
+      static_cast<std::uint32_t>(std::strtoul(args[2], nullptr, 10));
+
+  auto begin = std::chrono::steady_clock::now();
+  std::string indexPath = ROBOTLOG::TimeIndex::indexPath(path);
+  std::vector<ROBOTLOG::TimeIndex::Entry> entries =
+      ROBOTLOG::TimeIndex::load(indexPath);
+  if (entries.empty()) {
+    std::fprintf(stderr, "no time index at %s, turn on setFileTimeIndex()\n",
+                 indexPath.c_str());
+    return 1;
+  }
+  if (session < 0) {
+    session = entries.back().session;
+  }
+  ROBOTLOG::TimeIndex::Range range;
+  if (!ROBOTLOG::TimeIndex::find(entries, static_cast<std::uint32_t>(session),
+                                 from, to, range)) {
+    std::fprintf(stderr, "no session %ld in %s\n", session, indexPath.c_str());
+    return 1;
+  }
+
+  int fd = open(path, O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    std::fprintf(stderr, "can't open %s\n", path);
+    return 1;
+  }
+  std::uint64_t size = static_cast<std::uint64_t>(info.st_size);
+  if (size == 0) {
+    return 0;
+  }
+  void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    std::fprintf(stderr, "can't map %s\n", path);
+    return 1;
+  }
+  const char *data = static_cast<const char *>(mapped);
+
+  ROBOTLOG::Dictionary::Decoder decoder;
+  std::string line;
+  std::uint8_t block[ROBOTLOG::Frame::BLOCK_SIZE];
+  std::uint64_t bytesRead = 0;
+  for (std::size_t i = range.begin; i < range.end; i++) {
+    const ROBOTLOG::TimeIndex::Entry &entry = entries[i];
+    // each entry's bytes end where the next one's start
+    std::uint64_t start = entry.offset < size ? entry.offset : size;
+    std::uint64_t end = i + 1 < entries.size() ? entries[i + 1].offset : size;
+    end = end < start ? start : end < size ? end : size;
+    bytesRead += end - start;
+    bool dictionary = entry.flags & ROBOTLOG::TimeIndex::DICTIONARY;
+    if (!(entry.flags & ROBOTLOG::TimeIndex::FRAMED)) {
+      printLines(std::string_view(data + start, end - start), dictionary,
+                 decoder, line);
+      continue;
+    }
+    // the entry starts a block, and nothing before it is needed
+    std::string text;
+    ROBOTLOG::Frame::Scanner scanner(data + start, end - start);
+    ROBOTLOG::Frame::Header header;
+    const std::uint8_t *payload;
+    while (scanner.next(header, payload)) {
+      std::size_t length = ROBOTLOG::Frame::decode(header, payload, block);
+      if (length != ROBOTLOG::LZ::ERROR) {
+        text.append(reinterpret_cast<const char *>(block), length);
+      }
+    }
+    printLines(text, dictionary, decoder, line);
+  }
+  std::fflush(stdout);
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - begin)
+                  .count();
+
+  std::fprintf(stderr,
+               "session %ld, %zu lines, read %llu of %llu bytes, "
+               "%zu of %zu index entries probed, %.2f ms\n",
+               session, printed, static_cast<unsigned long long>(bytesRead),
+               static_cast<unsigned long long>(size), range.probes,
+               entries.size(), ms);
+  munmap(mapped, size);
+  close(fd);
+  return 0;
+}
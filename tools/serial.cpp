@@ -0,0 +1,216 @@
+/*
+ * vexlog-serial: read what a SerialSink (or a framed console) sends, live
+ *
+ * Build (from the repo root):
+ *   g++ -std=c++20 -O2 -Iinclude tools/serial.cpp -o vexlog-serial
+ *
+ * Usage:
+ *   vexlog-serial [--baud <n>] [--console] [--json | --cbor <out.cbor>]
+ *                 [--no-color] [--stats] <tty|file|->
+ *     --baud <n>    the rate the sink was made with, default 921600 (only
+ *                   matters for a real serial port)
+ *     --console     the brain's console with logger.setConsoleFraming(true),
+ *                   anything else printed on it is passed through as is
+ *                   (to stderr with --json or --cbor)
+ *     --json        print JSON lines, the same as the JsonLinesSink writes
+ *     --cbor <out>  save the records as a file vexlog-convert can read
+ *     --no-color    plain text, for piping into a file
+ *     --stats       print how many frames came in and how many were bad
+ *
+ * Reads a serial port (put into raw mode at --baud), a pseudo-terminal, a
+ * capture file, or stdin with -, until it ends or Ctrl-C. Frames that don't
+ * check out are skipped and reading carries on at the next one, so it can be
+ * started or restarted while the robot is already running.
+ */
+#include "robotlog/cbor.h"
+#include "robotlog/cobs.h"
+#include "robotlog/json.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+#include <unordered_set>
+
+static volatile std::sig_atomic_t stopping = 0;
+
+static void stop(int) { stopping = 1; }
+
+static void writeFile(void *context, const char *data, std::size_t length) {
+  std::fwrite(data, 1, length, static_cast<std::FILE *>(context));
+}
+
+static speed_t baudConstant(long baud) {
+  switch (baud) {
+  case 9600:
+    return B9600;
+  case 19200:
+    return B19200;
+  case 38400:
+    return B38400;
+  case 57600:
+    return B57600;
+  case 115200:
+    return B115200;
+  case 230400:
+    return B230400;
+  case 460800:
+    return B460800;
+  case 921600:
+    return B921600;
+  default:
+    return B0;
+  }
+}
+
+// raw bytes in, no echo, no line editing, no translating \r or \n
+static bool makeRaw(int fd, long baud) {
+  termios tty;
+  if (tcgetattr(fd, &tty) != 0) {
+    return false;
+  }
+  cfmakeraw(&tty);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cc[VMIN] = 1;
+  tty.c_cc[VTIME] = 0;
+  speed_t speed = baudConstant(baud);
+  if (speed != B0) {
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+  }
+  return tcsetattr(fd, TCSANOW, &tty) == 0;
+}
+
+int main(int argc, char **argv) {
+  long baud = 921600;
+  bool console = false;
+  bool json = false;
+  bool color = true;
+  bool stats = false;
+  const char *cborPath = nullptr;
+  const char *path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--baud") == 0 && i + 1 < argc) {
+      baud = std::strtol(argv[++i], nullptr, 10);
+    } else if (std::strcmp(argv[i], "--console") == 0) {
+      console = true;
+    } else if (std::strcmp(argv[i], "--json") == 0) {
+      json = true;
+    } else if (std::strcmp(argv[i], "--cbor") == 0 && i + 1 < argc) {
+      cborPath = argv[++i];
+    } else if (std::strcmp(argv[i], "--no-color") == 0) {
+      color = false;
+    } else if (std::strcmp(argv[i], "--stats") == 0) {
+      stats = true;
+    } else {
+      path = argv[i];
+    }
+  }
+  if (path == nullptr) {
+    std::fprintf(stderr,
+                 "usage: %s [--baud <n>] [--console] [--json | --cbor <out.cbor>] "
+                 "[--no-color] [--stats] <tty|file|->\n",
+                 argv[0]);
+    return 1;
+  }
+
+  int fd = std::strcmp(path, "-") == 0 ? STDIN_FILENO
+                                       : open(path, O_RDONLY | O_NOCTTY);
+  if (fd < 0) {
+    std::fprintf(stderr, "can't open %s: %s\n", path, std::strerror(errno));
+    return 1;
+  }
+  if (isatty(fd) && !makeRaw(fd, baud)) {
+    std::fprintf(stderr, "can't set up %s: %s\n", path, std::strerror(errno));
+    return 1;
+  }
+  if (baudConstant(baud) == B0 && isatty(fd)) {
+    std::fprintf(stderr, "%ld isn't a baud rate I know, leaving it as is\n",
+                 baud);
+  }
+
+  std::FILE *out = stdout;
+  if (cborPath != nullptr) {
+    out = std::fopen(cborPath, "wb");
+    if (out == nullptr) {
+      std::fprintf(stderr, "can't open %s\n", cborPath);
+      return 1;
+    }
+    // the records are already CBOR, they only need the file's tag in front
+    const std::uint8_t tag[] = {0xD9, 0xD9, 0xF7};
+    std::fwrite(tag, 1, sizeof(tag), out);
+  }
+
+  struct sigaction action = {};
+  action.sa_handler = &stop;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  char buffer[4096];
+  ROBOTLOG::JSON::JsonWriter writer(buffer, sizeof(buffer), &writeFile, out);
+  ROBOTLOG::COBS::Receiver receiver;
+  std::unordered_set<std::string> keys;
+  ROBOTLOG::LogMessage msg(ROBOTLOG::Level::INFO, "", "", 0);
+  std::size_t unreadable = 0;
+  const std::string format = color ? "<CBLEVEL> <FILE>:<LINE> - <MESSAGE>"
+                                   : "<BLEVEL> <FILE>:<LINE> - <MESSAGE>";
+
+  auto onRecord = [&](const std::uint8_t *record, std::size_t size) {
+    if (cborPath != nullptr) {
+      std::fwrite(record, 1, size, out);
+      return;
+    }
+    ROBOTLOG::CBOR::Reader reader(record, size);
+    if (!reader.record(msg, keys)) {
+      unreadable++; // the CRC was fine, so it's from a newer logger
+      return;
+    }
+    if (json) {
+      writer.record(msg);
+    } else {
+      std::string line = msg.format(format);
+      std::fprintf(out, "%10u %s\n", msg.getTime(), line.c_str());
+    }
+  };
+  // text goes wherever the records don't, so it can't break the JSON or CBOR
+  std::FILE *textOut = json || cborPath != nullptr ? stderr : out;
+  auto onText = [&](const char *text, std::size_t size) {
+    writer.drain();
+    std::fwrite(text, 1, size, textOut);
+  };
+
+  std::uint8_t input[4096];
+  while (!stopping) {
+    ssize_t count = read(fd, input, sizeof(input));
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      break; // end of the file, or the other end of the pty closed (EIO)
+    }
+    if (console) {
+      receiver.feed(input, static_cast<std::size_t>(count), onRecord, onText);
+    } else {
+      receiver.feed(input, static_cast<std::size_t>(count), onRecord);
+    }
+    writer.drain();
+    std::fflush(out);
+  }
+  writer.drain();
+  if (out != stdout) {
+    std::fclose(out);
+  }
+
+  if (stats) {
+    std::fprintf(stderr,
+                 "%zu records, %zu bad frames, %zu bytes skipped, %zu "
+                 "records not understood, %zu bytes of text\n",
+                 receiver.records, receiver.badFrames, receiver.skippedBytes,
+                 unreadable, receiver.textBytes);
+  }
+  return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * vexlog-sessions: list the sessions in a log, or print just one of them
+ *
+ * Build (from the repo root):
+ *   g++ -std=c++20 -O2 -Iinclude tools/sessions.cpp -o vexlog-sessions
+ *
+ * Usage:
+ *   vexlog-sessions <main.idx>          list every session
+ *   vexlog-sessions <main.idx> <id>     print one session as text
+ *
+ * Uses the index file the logger writes next to its log, so printing a session
+ * only reads that session's bytes, however big the files are. The log files
+ * are looked for next to the index (the paths in it are the brain's).
+ * Framed, compressed and dictionary parts are all decoded back to text.
+ */
+#include "robotlog/dictionary.h"
+#include "robotlog/frame.h"
+#include "robotlog/session.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// the brain's /usd/main.0.txt is wherever the index was copied to
+static std::string localPath(const std::string &indexPath,
+                             const std::string &file) {
+  std::size_t slash = indexPath.find_last_of('/');
+  std::string directory =
+      slash == std::string::npos ? "" : indexPath.substr(0, slash + 1);
+  std::size_t name = file.find_last_of('/');
+  std::string local =
+      directory + (name == std::string::npos ? file : file.substr(name + 1));
+  std::ifstream test(local);
+  return test.is_open() ? local : file;
+}
+
+// the text of one part, from its offset to where the next part in the same
+// file starts
+static bool readPart(const std::string &path, std::uint64_t start,
+                     std::uint64_t end, bool framed, std::string &text) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in.is_open()) {
+    return false;
+  }
+  std::uint64_t size = static_cast<std::uint64_t>(in.tellg());
+  end = end < size ? end : size;
+  if (start >= end) {
+    return true;
+  }
+  std::string bytes(end - start, '\0');
+  in.seekg(start);
+  in.read(bytes.data(), bytes.size());
+  if (!framed) {
+    text += bytes;
+    return true;
+  }
+  ROBOTLOG::Frame::Scanner scanner(bytes.data(), bytes.size());
+  ROBOTLOG::Frame::Header header;
+  const std::uint8_t *payload;
+  std::uint8_t block[ROBOTLOG::Frame::BLOCK_SIZE];
+  while (scanner.next(header, payload)) {
+    std::size_t length = ROBOTLOG::Frame::decode(header, payload, block);
+    if (length != ROBOTLOG::LZ::ERROR) {
+      text.append(reinterpret_cast<const char *>(block), length);
+    }
+  }
+  return true;
+}
+
+static void list(const std::vector<ROBOTLOG::SessionEntry> &entries) {
+  std::printf("%8s  %-24s %10s  %-10s %-5s  %s\n", "session", "build",
+              "start_ms", "mode", "field", "parts");
+  for (std::size_t i = 0; i < entries.size(); i++) {
+    const ROBOTLOG::SessionEntry &entry = entries[i];
+    if (entry.part != 0) {
+      continue;
+    }
+    std::printf("%8u  %-24s %10u  %-10s %-5s ", entry.session.id,
+                entry.session.build.c_str(), entry.session.startMs,
+                entry.session.mode.c_str(),
+                entry.session.field ? "yes" : "no");
+    for (const ROBOTLOG::SessionEntry &part : entries) {
+      if (part.session.id == entry.session.id) {
+        std::size_t name = part.file.find_last_of('/');
+        std::printf(" %s@%llu%s%s",
+                    part.file.substr(name == std::string::npos ? 0 : name + 1)
+                        .c_str(),
+                    static_cast<unsigned long long>(part.offset),
+                    part.framed ? "(framed)" : "",
+                    part.dictionary ? "(dict)" : "");
+      }
+    }
+    std::printf("\n");
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s <main.idx> [session]\n", argv[0]);
+    return 1;
+  }
+  std::string indexPath = argv[1];
+  std::vector<ROBOTLOG::SessionEntry> entries =
+      ROBOTLOG::SessionIndex(indexPath).load();
+  if (entries.empty()) {
+    std::fprintf(stderr, "no sessions in %s\n", argv[1]);
+    return 1;
+  }
+  if (argc < 3) {
+    list(entries);
+    return 0;
+  }
+
+  std::uint32_t id = static_cast<std::uint32_t>(std::strtoul(argv[2], nullptr, 10));
+  ROBOTLOG::Dictionary::Decoder decoder;
+  std::string line;
+  std::size_t parts = 0;
+  for (std::size_t i = 0; i < entries.size(); i++) {
+    const ROBOTLOG::SessionEntry &entry = entries[i];
+    if (entry.session.id != id) {
+      continue;
+    }
+    std::uint64_t end = ~0ULL;
+    for (std::size_t j = i + 1; j < entries.size(); j++) {
+      if (entries[j].file == entry.file && entries[j].offset >= entry.offset) {
+        end = entries[j].offset;
+        break;
+      }
+    }
+    std::string path = localPath(indexPath, entry.file);
+    std::string text;
+    if (!readPart(path, entry.offset, end, entry.framed, text)) {
+      std::fprintf(stderr, "part %u: can't open %s\n", entry.part,
+                   path.c_str());
+      continue;
+    }
+    parts++;
+    std::size_t start = 0;
+    while (start < text.size()) {
+      std::size_t newline = text.find('\n', start);
+      if (newline == std::string::npos) {
+        newline = text.size();
+      }
+      if (decoder.line(std::string_view(text).substr(start, newline - start),
+                       line)) {
+        std::printf("%s\n", line.c_str());
+      }
+      start = newline + 1;
+    }
+  }
+  if (parts == 0) {
+    std::fprintf(stderr, "no session %u\n", id);
+    return 1;
+  }
+  return 0;
+}